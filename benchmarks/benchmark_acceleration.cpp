@@ -0,0 +1,93 @@
+#include <anton/console.hpp>
+#include <anton/format.hpp>
+#include <benchmarks.hpp>
+#include <bvh.hpp>
+#include <kd_tree.hpp>
+
+namespace raytracing {
+    struct Acceleration_Result {
+        f64 build_time;
+        i64 size_bytes;
+        f64 mrays;
+        i64 hits;
+    };
+
+    [[nodiscard]] static Acceleration_Result measure_traversal(Acceleration_Structure const& structure, Scene const& scene, Slice<Ray const> const rays) {
+        i64 const repetitions = 3;
+        f64 best_time = math::infinity;
+        i64 hits = 0;
+        for(i64 repetition = 0; repetition < repetitions; ++repetition) {
+            hits = 0;
+            Benchmark_Clock::time_point const start = Benchmark_Clock::now();
+            for(Ray const& ray: rays) {
+                Optional<Surface_Interaction> const result = structure.intersect(scene, ray);
+                hits += result.holds_value();
+            }
+            best_time = math::min(best_time, seconds_since(start));
+        }
+
+        Acceleration_Result result;
+        result.build_time = 0.0;
+        result.size_bytes = structure.size_bytes();
+        result.mrays = static_cast<f64>(rays.size()) / best_time / 1000000.0;
+        result.hits = hits;
+        return result;
+    }
+
+    static void print_result(String_View const structure, Acceleration_Result const& result) {
+        Console_Output cout;
+        cout.write(format("  {}: build {} ms, {} MiB, {} Mrays/s, {} hits\n"_sv, structure, format_fixed(1000.0 * result.build_time, 1),
+                          format_fixed(static_cast<f64>(result.size_bytes) / (1024.0 * 1024.0), 2), format_fixed(result.mrays, 3), result.hits));
+    }
+
+    static void benchmark_scene(String_View const name, Scene const& scene, i64 const ray_count) {
+        Console_Output cout;
+        cout.write(format("{}: {} triangles, {} spheres\n"_sv, name, scene.triangles.size(), scene.spheres.size()));
+        Array<Ray> const rays = generate_rays(calculate_scene_bounds(scene), ray_count, 4920184);
+        {
+            KD_Tree kd_tree;
+            Benchmark_Clock::time_point const start = Benchmark_Clock::now();
+            kd_tree.build(scene, KD_Tree::Build_Options{.max_primitives = 16, .empty_bonus = 0.2f});
+            f64 const build_time = seconds_since(start);
+            Acceleration_Result result = measure_traversal(kd_tree, scene, rays);
+            result.build_time = build_time;
+            print_result("kd_tree"_sv, result);
+        }
+        {
+            BVH bvh;
+            Benchmark_Clock::time_point const start = Benchmark_Clock::now();
+            bvh.build(scene, BVH::Build_Options{});
+            f64 const build_time = seconds_since(start);
+            Acceleration_Result result = measure_traversal(bvh, scene, rays);
+            result.build_time = build_time;
+            print_result("bvh"_sv, result);
+        }
+    }
+
+    // run_acceleration_benchmark
+    // Compares build time, memory footprint and single-threaded closest-hit
+    // throughput of KD_Tree and BVH on an OBJ asset and on synthetic meshes
+    // of increasing size.
+    //
+    // Arguments:
+    // [path to an OBJ file] [largest synthetic mesh in triangles] [number of rays]
+    //
+    int run_acceleration_benchmark(Slice<String_View const> const arguments) {
+        String_View const path = (arguments.size() > 0 ? arguments[0] : "./assets/skull.obj"_sv);
+        i64 const max_triangles = (arguments.size() > 1 ? str_to_i64(arguments[1]) : 4000000);
+        i64 const ray_count = (arguments.size() > 2 ? str_to_i64(arguments[2]) : 500000);
+        Console_Output cout;
+        Expected<Scene, String> scene_result = load_obj_scene(path);
+        if(scene_result) {
+            benchmark_scene(path, scene_result.value(), ray_count);
+        } else {
+            cout.write(format("skipping {}: {}\n"_sv, path, scene_result.error()));
+        }
+
+        for(i64 triangles = 250000; triangles <= max_triangles; triangles *= 4) {
+            Scene const scene = generate_tessellated_mesh(triangles);
+            benchmark_scene(format("tessellated mesh {}"_sv, triangles), scene, ray_count);
+        }
+        return 0;
+    }
+} // namespace raytracing
@@ -0,0 +1,81 @@
+#include <anton/console.hpp>
+#include <anton/format.hpp>
+#include <benchmarks.hpp>
+#include <renderer.hpp>
+
+namespace raytracing {
+    // run_adaptive_benchmark
+    // Compares fixed sampling with progressive adaptive sampling. Both are measured by
+    // render time and by the error against a reference rendered with the maximum
+    // number of samples.
+    //
+    // Arguments:
+    // [path to an OBJ file] [image height in pixels] [maximum samples per pixel] [threads]
+    //
+    int run_adaptive_benchmark(Slice<String_View const> const arguments) {
+        String_View const path = (arguments.size() > 0 ? arguments[0] : "./assets/skull.obj"_sv);
+        i64 const image_height = (arguments.size() > 1 ? str_to_i64(arguments[1]) : 90);
+        i64 const max_samples = (arguments.size() > 2 ? str_to_i64(arguments[2]) : 256);
+        i64 const threads = (arguments.size() > 3 ? str_to_i64(arguments[3]) : 0);
+        Console_Output cout;
+        Expected<Scene, String> scene_result = load_obj_scene(path);
+        if(!scene_result) {
+            cout.write(scene_result.error());
+            return -1;
+        }
+
+        Scene& scene = scene_result.value();
+        add_material_spheres(scene);
+        Camera const camera{Vec3{2.0f, 2.0f, 5.0f}, 90.0f, 16.0f / 9.0f, image_height};
+        Camera_Target const target{Vec3{0.0f, 0.0f, 0.0f}};
+        cout.write(format("adaptive: {} triangles, {}x{} pixels, reference with {} samples\n"_sv, scene.triangles.size(), camera.image_width,
+                          camera.image_height, max_samples));
+
+        Context base_ctx;
+        base_ctx.seed = 7849034;
+        base_ctx.bounces = 8;
+        base_ctx.threads = threads;
+        // The reference uses uncorrelated samples to not share the structure of the errors of the
+        // other renders. A threshold of 0 only stops pixels without any variance, e.g. the sky, early.
+        Context reference_ctx = base_ctx;
+        reference_ctx.samples = max_samples;
+        reference_ctx.seed = 1290842;
+        reference_ctx.sampler = Sampler_Kind::independent;
+        reference_ctx.progressive = true;
+        reference_ctx.adaptive_threshold = 0.0f;
+        Benchmark_Clock::time_point const reference_start = Benchmark_Clock::now();
+        Array<Vec3> const reference = render_scene(reference_ctx, scene, camera, target);
+        cout.write(format("  reference: {} s\n"_sv, format_fixed(seconds_since(reference_start), 3)));
+
+        struct Configuration {
+            String_View name;
+            i64 samples;
+            bool progressive;
+            f32 threshold;
+            i64 time_budget;
+        };
+
+        Configuration const configurations[] = {
+            {"fixed 16 samples"_sv, 16, false, 0.0f, 0},
+            {"fixed 64 samples"_sv, 64, false, 0.0f, 0},
+            {"progressive 64 samples"_sv, 64, true, -1.0f, 0},
+            {"adaptive, threshold 0.02"_sv, max_samples, true, 0.02f, 0},
+            {"adaptive, threshold 0.01"_sv, max_samples, true, 0.01f, 0},
+            {"adaptive, threshold 0.005"_sv, max_samples, true, 0.005f, 0},
+            {"adaptive, threshold 0.005, 500 ms budget"_sv, max_samples, true, 0.005f, 500},
+        };
+
+        for(Configuration const& configuration: configurations) {
+            Context ctx = base_ctx;
+            ctx.samples = configuration.samples;
+            ctx.progressive = configuration.progressive;
+            ctx.adaptive_threshold = configuration.threshold;
+            ctx.time_budget = configuration.time_budget;
+            Benchmark_Clock::time_point const start = Benchmark_Clock::now();
+            Array<Vec3> const pixels = render_scene(ctx, scene, camera, target);
+            f64 const time = seconds_since(start);
+            cout.write(format("  {}: {} s, RMSE {}\n"_sv, configuration.name, format_fixed(time, 3), format_fixed(root_mean_square_error(pixels, reference), 5)));
+        }
+        return 0;
+    }
+} // namespace raytracing
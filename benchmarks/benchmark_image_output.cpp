@@ -0,0 +1,120 @@
+#include <anton/console.hpp>
+#include <anton/filesystem.hpp>
+#include <anton/format.hpp>
+#include <benchmarks.hpp>
+#include <filesystem.hpp>
+#include <image_writer.hpp>
+#include <renderer.hpp>
+
+namespace raytracing {
+    // The writer used before write_ppm_file became binary: ASCII P3 formatted pixel by pixel.
+    static void write_ppm_file_ascii(Output_Stream& stream, Slice<Vec3 const> const pixels, i64 const width, i64 const height) {
+        String header = format("P3\n{} {}\n255\n"_sv, width, height);
+        stream.write(header);
+        for(Vec3 const pixel: pixels) {
+            i64 const r = static_cast<i64>(255.999f * pixel.x);
+            i64 const g = static_cast<i64>(255.999f * pixel.y);
+            i64 const b = static_cast<i64>(255.999f * pixel.z);
+            String value = format("{} {} {}\n"_sv, r, g, b);
+            stream.write(value);
+        }
+    }
+
+    // run_image_output_benchmark
+    // Measures writing a 3840x2160 image in the ASCII PPM, binary PPM and PFM formats and
+    // compares writing a rendered image after the render with streaming its tiles while rendering.
+    //
+    // Arguments:
+    // [directory to write the images to] [image height of the render in pixels] [threads]
+    //
+    int run_image_output_benchmark(Slice<String_View const> const arguments) {
+        String_View const directory = (arguments.size() > 0 ? arguments[0] : "."_sv);
+        i64 const image_height = (arguments.size() > 1 ? str_to_i64(arguments[1]) : 1080);
+        i64 const threads = (arguments.size() > 2 ? str_to_i64(arguments[2]) : 0);
+        Console_Output cout;
+        String const ppm_path = fs::concat_paths(directory, "benchmark_image.ppm"_sv);
+        String const pfm_path = fs::concat_paths(directory, "benchmark_image.pfm"_sv);
+
+        i64 const width = 3840;
+        i64 const height = 2160;
+        Array<Vec3> pixels{reserve, width * height};
+        for(i64 y = 0; y < height; ++y) {
+            for(i64 x = 0; x < width; ++x) {
+                pixels.push_back(Vec3{static_cast<f32>(x) / width, static_cast<f32>(y) / height, 0.5f});
+            }
+        }
+
+        cout.write(format("image output: {}x{} pixels\n"_sv, width, height));
+        struct Writer {
+            String_View name;
+            String const* path;
+            void (*write)(Output_Stream& stream, Slice<Vec3 const> pixels, i64 width, i64 height);
+        };
+
+        Writer const writers[] = {
+            {"ascii ppm (P3)"_sv, &ppm_path, write_ppm_file_ascii},
+            {"binary ppm (P6)"_sv, &ppm_path, write_ppm_file},
+            {"pfm"_sv, &pfm_path, write_pfm_file},
+        };
+
+        for(Writer const& writer: writers) {
+            Benchmark_Clock::time_point const start = Benchmark_Clock::now();
+            {
+                fs::Output_File_Stream stream(*writer.path);
+                if(!stream) {
+                    cout.write(format("could not open {} for writing\n"_sv, *writer.path));
+                    return -1;
+                }
+
+                writer.write(stream, pixels, width, height);
+            }
+            f64 const time = seconds_since(start);
+            cout.write(format("  {}: {} ms, {} Mpixels/s\n"_sv, writer.name, format_fixed(time * 1000.0, 1),
+                              format_fixed(static_cast<f64>(width * height) / time / 1000000.0, 1)));
+        }
+
+        Scene scene = generate_tessellated_mesh(20000);
+        add_material_spheres(scene);
+        Camera const camera{Vec3{2.0f, 2.0f, 5.0f}, 90.0f, 16.0f / 9.0f, image_height};
+        Camera_Target const target{Vec3{0.0f, 0.0f, 0.0f}};
+        Context ctx;
+        ctx.seed = 7849034;
+        ctx.bounces = 2;
+        ctx.samples = 1;
+        ctx.threads = threads;
+        cout.write(format("render: {}x{} pixels, {} sample, {} bounces\n"_sv, camera.image_width, camera.image_height, ctx.samples, ctx.bounces));
+        for(i64 i = 0; i < 2; ++i) {
+            Benchmark_Clock::time_point const start = Benchmark_Clock::now();
+            Array<Vec3> const image = render_scene(ctx, scene, camera, target);
+            f64 const render_time = seconds_since(start);
+            {
+                fs::Output_File_Stream stream(ppm_path);
+                if(i == 0) {
+                    write_ppm_file_ascii(stream, image, camera.image_width, camera.image_height);
+                } else {
+                    write_ppm_file(stream, image, camera.image_width, camera.image_height);
+                }
+            }
+            f64 const time = seconds_since(start);
+            cout.write(format("  render, then write {}: {} ms ({} ms writing)\n"_sv, i == 0 ? "ascii ppm"_sv : "binary ppm"_sv, format_fixed(time * 1000.0, 1),
+                              format_fixed((time - render_time) * 1000.0, 1)));
+        }
+
+        {
+            Benchmark_Clock::time_point const start = Benchmark_Clock::now();
+            Image_File_Writer writer;
+            if(!writer.open(ppm_path, Image_Format::ppm, camera.image_width, camera.image_height)) {
+                cout.write(format("could not open {} for writing\n"_sv, ppm_path));
+                return -1;
+            }
+
+            Array<Vec3> const image = render_scene(ctx, scene, camera, target, &writer);
+            f64 const render_time = seconds_since(start);
+            bool const written = writer.finish();
+            f64 const time = seconds_since(start);
+            cout.write(format("  render streaming binary ppm: {} ms ({} ms after the render){}\n"_sv, format_fixed(time * 1000.0, 1),
+                              format_fixed((time - render_time) * 1000.0, 1), written ? ""_sv : ", incomplete"_sv));
+        }
+        return 0;
+    }
+} // namespace raytracing
@@ -0,0 +1,115 @@
+#include <anton/console.hpp>
+#include <anton/format.hpp>
+#include <benchmarks.hpp>
+#include <instancing.hpp>
+#include <kd_tree.hpp>
+#include <random_engine.hpp>
+
+namespace raytracing {
+    [[nodiscard]] static i64 calculate_scene_bytes(Scene const& scene) {
+        return scene.vertices.size() * sizeof(Vec3) + scene.triangles.size() * sizeof(Indexed_Triangle) + scene.spheres.size() * sizeof(Sphere);
+    }
+
+    // run_instancing_benchmark
+    // Places randomly rotated and scaled instances of a synthetic mesh on a grid and compares
+    // a single KD_Tree over the flattened instances with an Instance_BVH over the instances
+    // sharing one KD_Tree. Reports the memory of the primitives and the structures, the
+    // single-threaded closest-hit throughput and checks that both find the same hits.
+    //
+    // Arguments:
+    // [number of triangles of the mesh] [number of instances along each side of the grid] [number of rays]
+    //
+    int run_instancing_benchmark(Slice<String_View const> const arguments) {
+        i64 const triangle_count = (arguments.size() > 0 ? str_to_i64(arguments[0]) : 20000);
+        i64 const grid_size = (arguments.size() > 1 ? str_to_i64(arguments[1]) : 16);
+        i64 const ray_count = (arguments.size() > 2 ? str_to_i64(arguments[2]) : 1000000);
+        Console_Output cout;
+        Scene const mesh = generate_tessellated_mesh(triangle_count);
+        Random_Engine random_engine = create_random_engine(9381723);
+        Array<Instance> instances{reserve, grid_size * grid_size};
+        for(i64 z = 0; z < grid_size; ++z) {
+            for(i64 x = 0; x < grid_size; ++x) {
+                f32 const angle = random_f32(random_engine, 0.0f, 2.0f * math::pi);
+                f32 const factor = random_f32(random_engine, 0.5f, 1.2f);
+                Transform const placement = translate(Vec3{3.0f * static_cast<f32>(x), 0.0f, 3.0f * static_cast<f32>(z)});
+                instances.push_back(Instance{0, compose(placement, compose(rotate(Vec3{0.0f, 1.0f, 0.0f}, angle), scale(factor)))});
+            }
+        }
+
+        KD_Tree::Build_Options const options{.max_primitives = 16, .empty_bonus = 0.2f};
+        Scene flattened;
+        flattened.materials = mesh.materials;
+        flattened.vertices.ensure_capacity(instances.size() * mesh.vertices.size());
+        flattened.triangles.ensure_capacity(instances.size() * mesh.triangles.size());
+        for(Instance const& instance: instances) {
+            u32 const vertex_offset = static_cast<u32>(flattened.vertices.size());
+            for(Vec3 const v: mesh.vertices) {
+                (void)add_vertex(flattened, transform_point(instance.object_to_world, v));
+            }
+
+            for(Indexed_Triangle const& triangle: mesh.triangles) {
+                add_triangle(flattened, vertex_offset + triangle.v1, vertex_offset + triangle.v2, vertex_offset + triangle.v3,
+                             Handle<Material>{triangle.material});
+            }
+        }
+
+        KD_Tree flattened_tree;
+        Benchmark_Clock::time_point const flattened_start = Benchmark_Clock::now();
+        flattened_tree.build(flattened, options);
+        f64 const flattened_build_time = seconds_since(flattened_start);
+
+        KD_Tree mesh_tree;
+        Instance_BVH instance_bvh;
+        Benchmark_Clock::time_point const instanced_start = Benchmark_Clock::now();
+        mesh_tree.build(mesh, options);
+        Mesh const mesh_reference{&mesh, &mesh_tree};
+        instance_bvh.build(Slice<Mesh const>{&mesh_reference, 1}, instances, {});
+        f64 const instanced_build_time = seconds_since(instanced_start);
+
+        Array<Ray> const rays = generate_rays(calculate_scene_bounds(flattened), ray_count, 4920184);
+        cout.write(format("instancing: {} instances of {} triangles, {} rays\n"_sv, instances.size(), mesh.triangles.size(), rays.size()));
+        Array<Optional<Surface_Interaction>> flattened_hits{reserve, rays.size()};
+        Array<Optional<Surface_Interaction>> instanced_hits{reserve, rays.size()};
+        f64 flattened_time = math::infinity;
+        f64 instanced_time = math::infinity;
+        for(i64 repetition = 0; repetition < 3; ++repetition) {
+            flattened_hits.clear();
+            Benchmark_Clock::time_point const start = Benchmark_Clock::now();
+            for(Ray const& ray: rays) {
+                flattened_hits.push_back(flattened_tree.intersect(flattened, ray));
+            }
+            flattened_time = math::min(flattened_time, seconds_since(start));
+        }
+
+        for(i64 repetition = 0; repetition < 3; ++repetition) {
+            instanced_hits.clear();
+            Benchmark_Clock::time_point const start = Benchmark_Clock::now();
+            for(Ray const& ray: rays) {
+                instanced_hits.push_back(instance_bvh.intersect(flattened, ray));
+            }
+            instanced_time = math::min(instanced_time, seconds_since(start));
+        }
+
+        // The rays are transformed into the object space of the instances, hence the distances
+        // differ by rounding and rays grazing the edges of the triangles may hit or miss differently.
+        i64 mismatches = 0;
+        for(i64 i = 0; i < rays.size(); ++i) {
+            Optional<Surface_Interaction> const& a = flattened_hits[i];
+            Optional<Surface_Interaction> const& b = instanced_hits[i];
+            if(a.holds_value() != b.holds_value() || (a && math::abs(a->distance - b->distance) > 1e-3f * a->distance)) {
+                mismatches += 1;
+            }
+        }
+
+        f64 const mebibyte = 1024.0 * 1024.0;
+        f64 const flattened_bytes = static_cast<f64>(calculate_scene_bytes(flattened) + flattened_tree.size_bytes());
+        f64 const instanced_bytes = static_cast<f64>(calculate_scene_bytes(mesh) + mesh_tree.size_bytes() + instance_bvh.size_bytes());
+        cout.write(format("  flattened: build {} ms, {} MiB, {} Mrays/s\n"_sv, format_fixed(1000.0 * flattened_build_time, 1),
+                          format_fixed(flattened_bytes / mebibyte, 2), format_fixed(rays.size() / flattened_time / 1000000.0, 3)));
+        cout.write(format("  instanced: build {} ms, {} MiB, {} Mrays/s\n"_sv, format_fixed(1000.0 * instanced_build_time, 1),
+                          format_fixed(instanced_bytes / mebibyte, 2), format_fixed(rays.size() / instanced_time / 1000000.0, 3)));
+        cout.write(format("  {} mismatched hits\n"_sv, mismatches));
+        // A few rays grazing the edges are expected to differ.
+        return (mismatches * 1000 <= rays.size()) ? 0 : -1;
+    }
+} // namespace raytracing
@@ -0,0 +1,69 @@
+#include <anton/console.hpp>
+#include <anton/format.hpp>
+#include <benchmarks.hpp>
+#include <renderer.hpp>
+
+namespace raytracing {
+    // run_integrators_benchmark
+    // Renders the scene with the recursive and the wavefront integrators at 8 bounces,
+    // with and without Russian roulette, and compares their throughput in samples per second.
+    // The mean pixels of the renders with Russian roulette should match the ones without.
+    //
+    // Arguments:
+    // [path to an OBJ file] [image height in pixels] [samples per pixel] [threads]
+    //
+    int run_integrators_benchmark(Slice<String_View const> const arguments) {
+        String_View const path = (arguments.size() > 0 ? arguments[0] : "./assets/skull.obj"_sv);
+        i64 const image_height = (arguments.size() > 1 ? str_to_i64(arguments[1]) : 180);
+        i64 const samples = (arguments.size() > 2 ? str_to_i64(arguments[2]) : 16);
+        i64 const threads = (arguments.size() > 3 ? str_to_i64(arguments[3]) : 1);
+        Console_Output cout;
+        Expected<Scene, String> scene_result = load_obj_scene(path);
+        if(!scene_result) {
+            cout.write(scene_result.error());
+            return -1;
+        }
+
+        Scene& scene = scene_result.value();
+        add_material_spheres(scene);
+        Camera const camera{Vec3{2.0f, 2.0f, 5.0f}, 90.0f, 16.0f / 9.0f, image_height};
+        Camera_Target const target{Vec3{0.0f, 0.0f, 0.0f}};
+        cout.write(format("integrators: {} triangles, {}x{} pixels, {} samples, 8 bounces, {} threads\n"_sv, scene.triangles.size(), camera.image_width,
+                          camera.image_height, samples, threads));
+
+        struct Configuration {
+            String_View name;
+            Integrator integrator;
+            bool russian_roulette;
+        };
+
+        Configuration const configurations[] = {
+            {"recursive"_sv, Integrator::recursive, false},
+            {"recursive with russian roulette"_sv, Integrator::recursive, true},
+            {"wavefront"_sv, Integrator::wavefront, false},
+            {"wavefront with russian roulette"_sv, Integrator::wavefront, true},
+        };
+
+        f64 const total_samples = static_cast<f64>(camera.image_width * camera.image_height * samples);
+        for(Configuration const& configuration: configurations) {
+            Context ctx;
+            ctx.seed = 7849034;
+            ctx.bounces = 8;
+            ctx.samples = samples;
+            ctx.threads = threads;
+            ctx.integrator = configuration.integrator;
+            ctx.russian_roulette = configuration.russian_roulette;
+            Benchmark_Clock::time_point const start = Benchmark_Clock::now();
+            Array<Vec3> const pixels = render_scene(ctx, scene, camera, target);
+            f64 const time = seconds_since(start);
+            Vec3 mean{0.0f};
+            for(Vec3 const pixel: pixels) {
+                mean += pixel;
+            }
+            mean /= pixels.size();
+            cout.write(format("  {}: {} s, {} Msamples/s, mean pixel ({}, {}, {})\n"_sv, configuration.name, format_fixed(time, 3),
+                              format_fixed(total_samples / time / 1000000.0, 3), format_fixed(mean.x, 4), format_fixed(mean.y, 4), format_fixed(mean.z, 4)));
+        }
+        return 0;
+    }
+} // namespace raytracing
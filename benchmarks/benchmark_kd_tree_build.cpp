@@ -0,0 +1,42 @@
+#include <anton/console.hpp>
+#include <anton/format.hpp>
+#include <benchmarks.hpp>
+#include <kd_tree.hpp>
+#include <scheduler.hpp>
+
+namespace raytracing {
+    // run_kd_tree_build_benchmark
+    // Measures KD_Tree build time for increasing numbers of threads and checks
+    // that the parallel builds produce the same tree as the serial build.
+    //
+    // Arguments:
+    // [number of triangles of the synthetic mesh] [maximum number of threads]
+    //
+    int run_kd_tree_build_benchmark(Slice<String_View const> const arguments) {
+        i64 const triangles = (arguments.size() > 0 ? str_to_i64(arguments[0]) : 1000000);
+        i64 const max_threads = (arguments.size() > 1 ? str_to_i64(arguments[1]) : get_hardware_concurrency());
+        Console_Output cout;
+        Scene const scene = generate_tessellated_mesh(triangles);
+        cout.write(format("kd_tree_build: {} triangles\n"_sv, scene.triangles.size()));
+        f64 serial_time = 0.0;
+        u64 serial_hash = 0;
+        bool identical = true;
+        for(i64 threads = 1; threads <= max_threads; threads *= 2) {
+            KD_Tree tree;
+            Benchmark_Clock::time_point const start = Benchmark_Clock::now();
+            tree.build(scene, KD_Tree::Build_Options{.max_primitives = 16, .empty_bonus = 0.2f, .threads = threads});
+            f64 const build_time = seconds_since(start);
+            u64 const hash = tree.hash();
+            if(threads == 1) {
+                serial_time = build_time;
+                serial_hash = hash;
+            }
+
+            bool const matches = (hash == serial_hash);
+            identical = identical && matches;
+            cout.write(format("  {} threads: {} ms, speedup {}, {}\n"_sv, threads, format_fixed(1000.0 * build_time, 1),
+                              format_fixed(serial_time / build_time, 2), matches ? "identical"_sv : "DIFFERENT"_sv));
+        }
+        return identical ? 0 : -1;
+    }
+} // namespace raytracing
@@ -0,0 +1,120 @@
+#include <anton/console.hpp>
+#include <anton/filesystem.hpp>
+#include <anton/format.hpp>
+#include <anton/import.hpp>
+#include <anton/math/math.hpp>
+#include <benchmarks.hpp>
+#include <filesystem.hpp>
+#include <obj_loader.hpp>
+#include <scheduler.hpp>
+
+namespace raytracing {
+    // The loader used before load_obj_mesh: the file is copied into a buffer, imported
+    // into anton::Mesh objects and the meshes are copied into de-indexed triangles.
+    static Expected<i64, String> load_obj_triangles_legacy(String_View const path, Handle<Material> const material, Array<Triangle>& triangles) {
+        Expected<Array<u8>, String> file_read_result = read_file(path);
+        if(!file_read_result) {
+            return {expected_error, ANTON_MOV(file_read_result.error())};
+        }
+
+        Expected<Array<anton::Mesh>, String> import_result = import_obj(file_read_result.value(), {});
+        if(!import_result) {
+            return {expected_error, ANTON_MOV(import_result.error())};
+        }
+
+        i64 const first_triangle = triangles.size();
+        for(anton::Mesh const& mesh: import_result.value()) {
+            for(i64 i = 0; i < mesh.indices.size(); i += 3) {
+                Vec3 const v1 = mesh.vertices[mesh.indices[i]];
+                Vec3 const v2 = mesh.vertices[mesh.indices[i + 1]];
+                Vec3 const v3 = mesh.vertices[mesh.indices[i + 2]];
+                triangles.push_back(Triangle{v1, v2, v3, material});
+            }
+        }
+        return {expected_value, triangles.size() - first_triangle};
+    }
+
+    // max_vertex_difference
+    //
+    // Returns:
+    // The largest difference between the vertices of the corresponding triangles.
+    //
+    [[nodiscard]] static f32 max_vertex_difference(Scene const& scene, Slice<Triangle const> const reference) {
+        f32 difference = 0.0f;
+        for(i64 i = 0; i < scene.triangles.size(); ++i) {
+            Triangle const a = get_triangle(scene, i);
+            Triangle const& b = reference[i];
+            f32 const d = math::max(math::max(math::length(a.v1 - b.v1), math::length(a.v2 - b.v2)), math::length(a.v3 - b.v3));
+            difference = math::max(difference, d);
+        }
+        return difference;
+    }
+
+    // run_mesh_loading_benchmark
+    // Writes a synthetic mesh to an OBJ file and measures loading it into triangles with
+    // the legacy importer and with the memory mapped parallel loader for increasing numbers
+    // of threads. Checks that both loaders produce the same triangles.
+    //
+    // Arguments:
+    // [number of triangles of the synthetic mesh] [maximum number of threads] [directory to write the OBJ file to]
+    //
+    int run_mesh_loading_benchmark(Slice<String_View const> const arguments) {
+        i64 const triangle_count = (arguments.size() > 0 ? str_to_i64(arguments[0]) : 2000000);
+        i64 const max_threads = (arguments.size() > 1 ? str_to_i64(arguments[1]) : get_hardware_concurrency());
+        String_View const directory = (arguments.size() > 2 ? arguments[2] : "."_sv);
+        Console_Output cout;
+        String const path = fs::concat_paths(directory, "benchmark_mesh.obj"_sv);
+        {
+            Scene const scene = generate_tessellated_mesh(triangle_count);
+            if(!write_obj_file(path, scene)) {
+                cout.write(format("could not open {} for writing\n"_sv, path));
+                return -1;
+            }
+        }
+
+        Mapped_File file;
+        if(!file.open(path)) {
+            cout.write(format("could not map {}\n"_sv, path));
+            return -1;
+        }
+        f64 const megabytes = static_cast<f64>(file.data().size()) / 1000000.0;
+        file.close();
+
+        // The scenes are only compared, hence their triangles refer to a store of their own.
+        Material_Store materials;
+        Handle<Material> const material = materials.create_material(Material{Vec3{0.4f, 0.4f, 0.4f}});
+        Array<Triangle> reference;
+        f64 legacy_time = 0.0;
+        {
+            Benchmark_Clock::time_point const start = Benchmark_Clock::now();
+            Expected<i64, String> result = load_obj_triangles_legacy(path, material, reference);
+            legacy_time = seconds_since(start);
+            if(!result) {
+                cout.write(format("{}\n"_sv, result.error()));
+                return -1;
+            }
+        }
+
+        cout.write(format("mesh_loading: {} triangles, {} MB\n"_sv, reference.size(), format_fixed(megabytes, 1)));
+        cout.write(format("  legacy (read_file + import_obj): {} ms, {} MB/s\n"_sv, format_fixed(1000.0 * legacy_time, 1),
+                          format_fixed(megabytes / legacy_time, 1)));
+        bool identical = true;
+        for(i64 threads = 1; threads <= max_threads; threads *= 2) {
+            Scene scene;
+            Benchmark_Clock::time_point const start = Benchmark_Clock::now();
+            Expected<i64, String> result = load_obj_mesh(path, material, scene, Obj_Load_Options{.threads = threads});
+            f64 const time = seconds_since(start);
+            if(!result) {
+                cout.write(format("{}\n"_sv, result.error()));
+                return -1;
+            }
+
+            // Both parsers round the same decimal digits, but not necessarily identically.
+            bool const matches = (scene.triangles.size() == reference.size() && max_vertex_difference(scene, reference) <= 1e-6f);
+            identical = identical && matches;
+            cout.write(format("  mapped, {} threads: {} ms, {} MB/s, speedup {}, {}\n"_sv, threads, format_fixed(1000.0 * time, 1),
+                              format_fixed(megabytes / time, 1), format_fixed(legacy_time / time, 2), matches ? "identical"_sv : "DIFFERENT"_sv));
+        }
+        return identical ? 0 : -1;
+    }
+} // namespace raytracing
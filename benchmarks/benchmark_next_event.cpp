@@ -0,0 +1,98 @@
+#include <anton/console.hpp>
+#include <anton/format.hpp>
+#include <benchmarks.hpp>
+#include <kd_tree.hpp>
+#include <materials.hpp>
+#include <renderer.hpp>
+
+namespace raytracing {
+    // run_next_event_benchmark
+    // Compares the single-threaded throughput of the occlusion query with the closest-hit
+    // query of a KD_Tree and checks that both agree on which rays hit the scene. Then renders
+    // the scene lit by a small sphere light with and without next-event estimation and
+    // measures the error of both against a reference rendered with next-event estimation.
+    //
+    // Arguments:
+    // [path to an OBJ file] [image height in pixels] [samples per pixel] [number of rays]
+    //
+    int run_next_event_benchmark(Slice<String_View const> const arguments) {
+        String_View const path = (arguments.size() > 0 ? arguments[0] : "./assets/skull.obj"_sv);
+        i64 const image_height = (arguments.size() > 1 ? str_to_i64(arguments[1]) : 90);
+        i64 const samples = (arguments.size() > 2 ? str_to_i64(arguments[2]) : 16);
+        i64 const ray_count = (arguments.size() > 3 ? str_to_i64(arguments[3]) : 1000000);
+        Console_Output cout;
+        Expected<Scene, String> scene_result = load_obj_scene(path);
+        if(!scene_result) {
+            cout.write(scene_result.error());
+            return -1;
+        }
+
+        Scene& scene = scene_result.value();
+        add_material_spheres(scene);
+        Handle<Material> const light = scene.materials.create_material(Material{Vec3{0.0f}, false, 0.0f, false, 1.0f, Vec3{40.0f}});
+        scene.spheres.push_back(Sphere{Vec3{-1.0f, 4.0f, 2.0f}, 0.3f, light});
+
+        KD_Tree tree;
+        tree.build(scene, KD_Tree::Build_Options{.max_primitives = 16, .empty_bonus = 0.2f});
+        Array<Ray> const rays = generate_rays(calculate_scene_bounds(scene), ray_count, 4920184);
+        cout.write(format("next_event: {} triangles, {} rays\n"_sv, scene.triangles.size(), rays.size()));
+        Array<Optional<Surface_Interaction>> hits{reserve, rays.size()};
+        Array<bool> occlusions{reserve, rays.size()};
+        f64 intersect_time = math::infinity;
+        f64 occluded_time = math::infinity;
+        for(i64 repetition = 0; repetition < 3; ++repetition) {
+            hits.clear();
+            Benchmark_Clock::time_point const start = Benchmark_Clock::now();
+            for(Ray const& ray: rays) {
+                hits.push_back(tree.intersect(scene, ray));
+            }
+            intersect_time = math::min(intersect_time, seconds_since(start));
+        }
+
+        for(i64 repetition = 0; repetition < 3; ++repetition) {
+            occlusions.clear();
+            Benchmark_Clock::time_point const start = Benchmark_Clock::now();
+            for(Ray const& ray: rays) {
+                occlusions.push_back(tree.occluded(scene, ray, math::infinity));
+            }
+            occluded_time = math::min(occluded_time, seconds_since(start));
+        }
+
+        i64 mismatches = 0;
+        for(i64 i = 0; i < rays.size(); ++i) {
+            mismatches += hits[i].holds_value() != occlusions[i];
+        }
+
+        cout.write(format("  intersect: {} Mrays/s\n"_sv, format_fixed(rays.size() / intersect_time / 1000000.0, 3)));
+        cout.write(format("  occluded: {} Mrays/s\n"_sv, format_fixed(rays.size() / occluded_time / 1000000.0, 3)));
+        cout.write(format("  {} mismatched rays\n"_sv, mismatches));
+
+        Camera const camera{Vec3{2.0f, 2.0f, 5.0f}, 90.0f, 16.0f / 9.0f, image_height};
+        Camera_Target const target{Vec3{0.0f, 0.0f, 0.0f}};
+        Context base_ctx;
+        base_ctx.seed = 7849034;
+        base_ctx.bounces = 8;
+        base_ctx.prebuilt_acceleration_structure = &tree;
+        // The reference uses uncorrelated samples to not share the structure of the errors of the other renders.
+        Context reference_ctx = base_ctx;
+        reference_ctx.samples = 16 * samples;
+        reference_ctx.seed = 1290842;
+        reference_ctx.sampler = Sampler_Kind::independent;
+        Array<Vec3> const reference = render_scene(reference_ctx, scene, camera, target);
+        bool const configurations[] = {false, true};
+        for(bool const next_event_estimation: configurations) {
+            Context ctx = base_ctx;
+            ctx.samples = samples;
+            ctx.next_event_estimation = next_event_estimation;
+            Benchmark_Clock::time_point const start = Benchmark_Clock::now();
+            Array<Vec3> const pixels = render_scene(ctx, scene, camera, target);
+            f64 const time = seconds_since(start);
+            cout.write(format("  {}: {} s, rmse {}\n"_sv, next_event_estimation ? "next-event estimation"_sv : "scattering only"_sv, format_fixed(time, 3),
+                              format_fixed(root_mean_square_error(pixels, reference), 5)));
+        }
+
+        // The leaves are tested in a different order by the two queries, hence a few rays
+        // grazing the edges of the triangles are expected to differ.
+        return (mismatches * 1000 <= rays.size()) ? 0 : -1;
+    }
+} // namespace raytracing
@@ -0,0 +1,124 @@
+#include <anton/console.hpp>
+#include <anton/format.hpp>
+#include <benchmarks.hpp>
+#include <kd_tree.hpp>
+
+namespace raytracing {
+    struct Packet_Benchmark_Result {
+        f64 single_mrays;
+        f64 packet_mrays;
+        i64 mismatches;
+    };
+
+    // measure_packets
+    // Intersects the rays one by one and in groups of group_size coherent rays
+    // and compares the hits of both.
+    //
+    [[nodiscard]] static Packet_Benchmark_Result measure_packets(KD_Tree const& tree, Scene const& scene, Slice<Ray const> const rays, i64 const group_size) {
+        i64 const repetitions = 5;
+        Array<Optional<Surface_Interaction>> single_hits{rays.size()};
+        Array<Optional<Surface_Interaction>> packet_hits{rays.size()};
+        f64 single_time = math::infinity;
+        f64 packet_time = math::infinity;
+        for(i64 repetition = 0; repetition < repetitions; ++repetition) {
+            Benchmark_Clock::time_point const single_start = Benchmark_Clock::now();
+            for(i64 i = 0; i < rays.size(); ++i) {
+                single_hits[i] = tree.intersect(scene, rays[i]);
+            }
+            single_time = math::min(single_time, seconds_since(single_start));
+
+            Benchmark_Clock::time_point const packet_start = Benchmark_Clock::now();
+            for(i64 i = 0; i < rays.size(); i += group_size) {
+                i64 const count = math::min(group_size, rays.size() - i);
+                tree.intersect_packet(scene, Slice<Ray const>{rays.data() + i, count}, Slice<Optional<Surface_Interaction>>{packet_hits.data() + i, count});
+            }
+            packet_time = math::min(packet_time, seconds_since(packet_start));
+        }
+
+        i64 mismatches = 0;
+        for(i64 i = 0; i < rays.size(); ++i) {
+            Optional<Surface_Interaction> const& single = single_hits[i];
+            Optional<Surface_Interaction> const& packet = packet_hits[i];
+            if(single.holds_value() != packet.holds_value() || (single && single->distance != packet->distance)) {
+                mismatches += 1;
+            }
+        }
+
+        f64 const ray_count = static_cast<f64>(rays.size());
+        return Packet_Benchmark_Result{ray_count / single_time / 1000000.0, ray_count / packet_time / 1000000.0, mismatches};
+    }
+
+    // run_packets_benchmark
+    // Compares single-ray and packet traversal of KD_Tree with camera rays through
+    // the pixels of an image of the scene and with shadow-like rays from the points
+    // the camera rays hit towards a point light.
+    //
+    // Arguments:
+    // [path to an OBJ file] [image width and height in pixels]
+    //
+    int run_packets_benchmark(Slice<String_View const> const arguments) {
+        String_View const path = (arguments.size() > 0 ? arguments[0] : "./assets/skull.obj"_sv);
+        i64 const resolution = (arguments.size() > 1 ? str_to_i64(arguments[1]) : 512);
+        Console_Output cout;
+        Expected<Scene, String> scene_result = load_obj_scene(path);
+        if(!scene_result) {
+            cout.write(scene_result.error());
+            return -1;
+        }
+
+        Scene const& scene = scene_result.value();
+        KD_Tree tree;
+        tree.build(scene, KD_Tree::Build_Options{.max_primitives = 16, .empty_bonus = 0.2f});
+
+        // The camera looks at the center of the scene from outside of its bounds.
+        // Each pixel is sampled with a 2x2 grid whose rays form one packet.
+        i64 const samples_root = 2;
+        i64 const group_size = samples_root * samples_root;
+        Extent3 const bounds = calculate_scene_bounds(scene);
+        Vec3 const center = 0.5f * (bounds.min + bounds.max);
+        f32 const radius = math::length(bounds.max - center);
+        Vec3 const camera_position = center + Vec3{0.0f, 0.0f, 2.0f * radius};
+        Array<Ray> camera_rays{reserve, resolution * resolution * group_size};
+        for(i64 y = 0; y < resolution; ++y) {
+            for(i64 x = 0; x < resolution; ++x) {
+                for(i64 sample = 0; sample < group_size; ++sample) {
+                    f32 const u = (static_cast<f32>(x) + static_cast<f32>(sample % samples_root) / samples_root) / resolution - 0.5f;
+                    f32 const v = (static_cast<f32>(y) + static_cast<f32>(sample / samples_root) / samples_root) / resolution - 0.5f;
+                    Vec3 const target = center + Vec3{u * 2.0f * radius, v * 2.0f * radius, 0.0f};
+                    camera_rays.push_back(Ray{camera_position, math::normalize(target - camera_position)});
+                }
+            }
+        }
+
+        // Rays towards the light from the points hit by the camera rays. The points of
+        // a pixel are close to each other, hence their rays are coherent too.
+        Vec3 const light_position = center + Vec3{radius, 2.0f * radius, radius};
+        Array<Ray> shadow_rays{reserve, camera_rays.size()};
+        for(Ray const& ray: camera_rays) {
+            Optional<Surface_Interaction> const result = tree.intersect(scene, ray);
+            if(result) {
+                Vec3 const point = ray.origin + ray.direction * result->distance;
+                shadow_rays.push_back(Ray{point, math::normalize(light_position - point)});
+            }
+        }
+
+        cout.write(format("packets: {} triangles, packets of {} rays\n"_sv, scene.triangles.size(), group_size));
+        struct Ray_Set {
+            String_View name;
+            Slice<Ray const> rays;
+        };
+
+        Ray_Set const ray_sets[] = {
+            {"camera"_sv, camera_rays},
+            {"shadow"_sv, shadow_rays},
+        };
+
+        for(Ray_Set const& ray_set: ray_sets) {
+            Packet_Benchmark_Result const result = measure_packets(tree, scene, ray_set.rays, group_size);
+            cout.write(format("  {} rays ({}): single {} Mrays/s, packet {} Mrays/s, speedup {}, {} mismatches\n"_sv, ray_set.name, ray_set.rays.size(),
+                              format_fixed(result.single_mrays, 3), format_fixed(result.packet_mrays, 3),
+                              format_fixed(result.packet_mrays / result.single_mrays, 2), result.mismatches));
+        }
+        return 0;
+    }
+} // namespace raytracing
@@ -0,0 +1,163 @@
+#include <anton/console.hpp>
+#include <anton/format.hpp>
+#include <anton/math/math.hpp>
+#include <benchmarks.hpp>
+#include <random_engine.hpp>
+#include <renderer.hpp>
+
+#include <random>
+
+namespace raytracing {
+    // The engine used before Random_Engine: mt19937_64 allocated on the heap behind
+    // functions that are not inlined, f64 remapping and normalized cube samples.
+    struct Legacy_Random_Engine {
+        std::mt19937_64 engine;
+    };
+
+    [[gnu::noinline]] static f32 legacy_random_f32(Legacy_Random_Engine* const engine, f32 const min, f32 const max) {
+        u64 const random = engine->engine();
+        bool const odd = random & 1;
+        i64 halved = random / 2;
+        halved -= 4611686018427387904;
+        halved *= 2;
+        halved += odd;
+        f64 const random_double = halved / f64(~0ULL >> 1);
+        f64 const range_half = 0.5 * (max - min);
+        f64 const remapped = random_double * range_half + range_half + min;
+        return remapped;
+    }
+
+    [[gnu::noinline]] static Vec3 legacy_random_unit_vec3(Legacy_Random_Engine* const engine) {
+        f32 const x = legacy_random_f32(engine, -1.0f, 1.0f);
+        f32 const y = legacy_random_f32(engine, -1.0f, 1.0f);
+        f32 const z = legacy_random_f32(engine, -1.0f, 1.0f);
+        return math::normalize(Vec3{x, y, z});
+    }
+
+    // Moments of the z coordinate of sampled directions. Uniform directions have
+    // E[z^2] = 1/3 and E[z^4] = 1/5.
+    struct Direction_Moments {
+        f64 z2 = 0.0;
+        f64 z4 = 0.0;
+    };
+
+    static void write_throughput(Console_Output& cout, String_View const name, i64 const count, f64 const time, f64 const checksum) {
+        cout.write(format("  {}: {} M/s (checksum {})\n"_sv, name, format_fixed(static_cast<f64>(count) / time / 1000000.0, 1), format_fixed(checksum, 2)));
+    }
+
+    static void write_moments(Console_Output& cout, String_View const name, i64 const count, Direction_Moments const moments) {
+        cout.write(format("  {} direction moments: E[z^2] = {}, E[z^4] = {}\n"_sv, name, format_fixed(moments.z2 / count, 4),
+                          format_fixed(moments.z4 / count, 4)));
+    }
+
+    // run_random_benchmark
+    // Compares the throughput of Random_Engine with the previous mt19937_64 based engine,
+    // checks the uniformity of the sampled directions and renders a small scene with
+    // different numbers of threads to verify that the image does not depend on the scheduling.
+    //
+    // Arguments:
+    // [count of random numbers] [threads of the reproducibility check]
+    //
+    int run_random_benchmark(Slice<String_View const> const arguments) {
+        i64 const count = (arguments.size() > 0 ? str_to_i64(arguments[0]) : 50000000);
+        i64 const threads = (arguments.size() > 1 ? str_to_i64(arguments[1]) : 4);
+        Console_Output cout;
+        cout.write(format("random: {} numbers\n"_sv, count));
+
+        {
+            Legacy_Random_Engine* const engine = new Legacy_Random_Engine{std::mt19937_64{7849034}};
+            Benchmark_Clock::time_point const start = Benchmark_Clock::now();
+            f64 checksum = 0.0;
+            for(i64 i = 0; i < count; ++i) {
+                checksum += legacy_random_f32(engine, 0.0f, 1.0f);
+            }
+            write_throughput(cout, "mt19937_64 random_f32"_sv, count, seconds_since(start), checksum);
+            delete engine;
+        }
+
+        {
+            Random_Engine engine = create_random_engine(7849034);
+            Benchmark_Clock::time_point const start = Benchmark_Clock::now();
+            f64 checksum = 0.0;
+            for(i64 i = 0; i < count; ++i) {
+                checksum += random_f32(engine);
+            }
+            write_throughput(cout, "pcg32 random_f32"_sv, count, seconds_since(start), checksum);
+        }
+
+        // Creating an engine per sample is part of the cost of the per-sample streams.
+        {
+            Benchmark_Clock::time_point const start = Benchmark_Clock::now();
+            f64 checksum = 0.0;
+            for(i64 i = 0; i < count; ++i) {
+                Random_Engine engine = create_random_engine(7849034, i);
+                checksum += random_f32(engine);
+            }
+            write_throughput(cout, "pcg32 create_random_engine + random_f32"_sv, count, seconds_since(start), checksum);
+        }
+
+        i64 const vectors = count / 4;
+        Direction_Moments legacy_moments;
+        {
+            Legacy_Random_Engine* const engine = new Legacy_Random_Engine{std::mt19937_64{7849034}};
+            Benchmark_Clock::time_point const start = Benchmark_Clock::now();
+            for(i64 i = 0; i < vectors; ++i) {
+                Vec3 const v = legacy_random_unit_vec3(engine);
+                f64 const z2 = v.z * v.z;
+                legacy_moments.z2 += z2;
+                legacy_moments.z4 += z2 * z2;
+            }
+            write_throughput(cout, "mt19937_64 random_unit_vec3"_sv, vectors, seconds_since(start), legacy_moments.z2);
+            delete engine;
+        }
+
+        Direction_Moments moments;
+        {
+            Random_Engine engine = create_random_engine(7849034);
+            Benchmark_Clock::time_point const start = Benchmark_Clock::now();
+            for(i64 i = 0; i < vectors; ++i) {
+                Vec3 const v = random_unit_vec3(engine);
+                f64 const z2 = v.z * v.z;
+                moments.z2 += z2;
+                moments.z4 += z2 * z2;
+            }
+            write_throughput(cout, "pcg32 random_unit_vec3"_sv, vectors, seconds_since(start), moments.z2);
+        }
+
+        write_moments(cout, "mt19937_64"_sv, vectors, legacy_moments);
+        write_moments(cout, "pcg32"_sv, vectors, moments);
+
+        Scene scene = generate_tessellated_mesh(20000);
+        add_material_spheres(scene);
+        Camera const camera{Vec3{2.0f, 2.0f, 5.0f}, 90.0f, 16.0f / 9.0f, 72};
+        Camera_Target const target{Vec3{0.0f, 0.0f, 0.0f}};
+        bool reproducible = true;
+        for(Integrator const integrator: {Integrator::recursive, Integrator::wavefront}) {
+            Array<Vec3> reference;
+            for(i64 const render_threads: {(i64)1, threads}) {
+                Context ctx;
+                ctx.seed = 7849034;
+                ctx.bounces = 8;
+                ctx.samples = 16;
+                ctx.threads = render_threads;
+                ctx.tile_size = 8;
+                ctx.integrator = integrator;
+                ctx.russian_roulette = true;
+                Array<Vec3> pixels = render_scene(ctx, scene, camera, target);
+                if(render_threads == 1) {
+                    reference = ANTON_MOV(pixels);
+                    continue;
+                }
+
+                for(i64 i = 0; i < pixels.size(); ++i) {
+                    Vec3 const a = pixels[i];
+                    Vec3 const b = reference[i];
+                    reproducible = reproducible && a.x == b.x && a.y == b.y && a.z == b.z;
+                }
+            }
+        }
+
+        cout.write(format("  renders on 1 and {} threads are {}\n"_sv, threads, reproducible ? "identical"_sv : "different"_sv));
+        return reproducible ? 0 : -1;
+    }
+} // namespace raytracing
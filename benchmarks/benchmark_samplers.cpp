@@ -0,0 +1,102 @@
+#include <anton/console.hpp>
+#include <anton/format.hpp>
+#include <anton/math/math.hpp>
+#include <benchmarks.hpp>
+#include <renderer.hpp>
+
+namespace raytracing {
+    // filtered_root_mean_square_error
+    // Error of the pixels after the difference to the reference has been averaged over
+    // 3x3 neighbourhoods. Errors of neighbouring pixels with opposite signs, e.g. blue noise,
+    // cancel out like they do when the image is viewed from a distance.
+    //
+    [[nodiscard]] static f64 filtered_root_mean_square_error(Slice<Vec3 const> const pixels, Slice<Vec3 const> const reference, i64 const width,
+                                                             i64 const height) {
+        f64 sum = 0.0;
+        for(i64 y = 0; y < height; ++y) {
+            for(i64 x = 0; x < width; ++x) {
+                Vec3 difference{0.0f};
+                i64 count = 0;
+                for(i64 ny = math::max(y - 1, (i64)0); ny <= math::min(y + 1, height - 1); ++ny) {
+                    for(i64 nx = math::max(x - 1, (i64)0); nx <= math::min(x + 1, width - 1); ++nx) {
+                        difference += pixels[ny * width + nx] - reference[ny * width + nx];
+                        count += 1;
+                    }
+                }
+                difference /= static_cast<f32>(count);
+                sum += math::dot(difference, difference) / 3.0f;
+            }
+        }
+        return math::sqrt(sum / (width * height));
+    }
+
+    // run_samplers_benchmark
+    // Renders the scene through a camera with a finite aperture with every sampler at several
+    // sample counts and compares the errors against a reference rendered with many samples.
+    //
+    // Arguments:
+    // [path to an OBJ file] [image height in pixels] [samples per pixel of the reference] [threads]
+    //
+    int run_samplers_benchmark(Slice<String_View const> const arguments) {
+        String_View const path = (arguments.size() > 0 ? arguments[0] : "./assets/skull.obj"_sv);
+        i64 const image_height = (arguments.size() > 1 ? str_to_i64(arguments[1]) : 72);
+        i64 const reference_samples = (arguments.size() > 2 ? str_to_i64(arguments[2]) : 1024);
+        i64 const threads = (arguments.size() > 3 ? str_to_i64(arguments[3]) : 0);
+        Console_Output cout;
+        Expected<Scene, String> scene_result = load_obj_scene(path);
+        if(!scene_result) {
+            cout.write(scene_result.error());
+            return -1;
+        }
+
+        Scene& scene = scene_result.value();
+        add_material_spheres(scene);
+        Camera camera{Vec3{2.0f, 2.0f, 5.0f}, 90.0f, 16.0f / 9.0f, image_height};
+        Camera_Target const target{Vec3{0.0f, 0.0f, 0.0f}};
+        camera.aperture = 0.1f;
+        camera.focus_distance = math::length(target.position - camera.position);
+        cout.write(format("samplers: {} triangles, {}x{} pixels, aperture {}, reference with {} samples\n"_sv, scene.triangles.size(), camera.image_width,
+                          camera.image_height, format_fixed(camera.aperture, 2), reference_samples));
+
+        Context base_ctx;
+        base_ctx.seed = 7849034;
+        base_ctx.bounces = 8;
+        base_ctx.threads = threads;
+        Context reference_ctx = base_ctx;
+        reference_ctx.seed = 1290842;
+        reference_ctx.samples = reference_samples;
+        reference_ctx.sampler = Sampler_Kind::independent;
+        Benchmark_Clock::time_point const reference_start = Benchmark_Clock::now();
+        Array<Vec3> const reference = render_scene(reference_ctx, scene, camera, target);
+        cout.write(format("  reference: {} s\n"_sv, format_fixed(seconds_since(reference_start), 3)));
+
+        struct Configuration {
+            String_View name;
+            Sampler_Kind sampler;
+        };
+
+        Configuration const configurations[] = {
+            {"independent"_sv, Sampler_Kind::independent},
+            {"stratified"_sv, Sampler_Kind::stratified},
+            {"sobol"_sv, Sampler_Kind::sobol},
+            {"blue noise"_sv, Sampler_Kind::blue_noise},
+        };
+
+        i64 const sample_counts[] = {4, 16, 64};
+        for(Configuration const& configuration: configurations) {
+            for(i64 const samples: sample_counts) {
+                Context ctx = base_ctx;
+                ctx.samples = samples;
+                ctx.sampler = configuration.sampler;
+                Benchmark_Clock::time_point const start = Benchmark_Clock::now();
+                Array<Vec3> const pixels = render_scene(ctx, scene, camera, target);
+                f64 const time = seconds_since(start);
+                f64 const error = root_mean_square_error(pixels, reference);
+                f64 const filtered_error = filtered_root_mean_square_error(pixels, reference, camera.image_width, camera.image_height);
+                cout.write(format("  {} {} samples: {} s, RMSE {}, 3x3 filtered RMSE {}\n"_sv, configuration.name, samples, format_fixed(time, 3),
+                                  format_fixed(error, 5), format_fixed(filtered_error, 5)));
+            }
+        }
+        return 0;
+    }
+} // namespace raytracing
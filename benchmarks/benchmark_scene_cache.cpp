@@ -0,0 +1,98 @@
+#include <anton/console.hpp>
+#include <anton/filesystem.hpp>
+#include <anton/format.hpp>
+#include <benchmarks.hpp>
+#include <filesystem.hpp>
+#include <kd_tree.hpp>
+#include <obj_loader.hpp>
+#include <scene_cache.hpp>
+
+namespace raytracing {
+    // run_scene_cache_benchmark
+    // Measures the startup of a render of an OBJ mesh: importing the mesh and building
+    // KD_Tree and writing the scene cache on the first run, loading the scene cache on
+    // the following runs. Checks that the cached tree is identical to the built one.
+    //
+    // Arguments:
+    // [number of triangles of the synthetic mesh] [directory to write the OBJ file and the cache to]
+    //
+    int run_scene_cache_benchmark(Slice<String_View const> const arguments) {
+        i64 const triangle_count = (arguments.size() > 0 ? str_to_i64(arguments[0]) : 1000000);
+        String_View const directory = (arguments.size() > 1 ? arguments[1] : "."_sv);
+        Console_Output cout;
+        String const obj_path = fs::concat_paths(directory, "benchmark_scene.obj"_sv);
+        String const cache_path = fs::concat_paths(directory, "benchmark_scene.rtcache"_sv);
+        {
+            Scene const scene = generate_tessellated_mesh(triangle_count);
+            if(!write_obj_file(obj_path, scene)) {
+                cout.write(format("could not open {} for writing\n"_sv, obj_path));
+                return -1;
+            }
+        }
+
+        KD_Tree::Build_Options const options{.max_primitives = 16, .empty_bonus = 0.2f};
+        u64 built_hash = 0;
+        {
+            Benchmark_Clock::time_point const start = Benchmark_Clock::now();
+            Mapped_File source;
+            if(!source.open(obj_path)) {
+                cout.write(format("could not map {}\n"_sv, obj_path));
+                return -1;
+            }
+
+            Scene scene;
+            add_material_spheres(scene);
+            Handle<Material> const material = scene.materials.create_material(Material{Vec3{0.4f, 0.4f, 0.4f}});
+            u64 const key = calculate_scene_cache_key(source.data(), scene.materials, material, scene, options);
+            Expected<i64, String> load_result = parse_obj_mesh(source.data(), material, scene, {});
+            if(!load_result) {
+                cout.write(format("{}\n"_sv, load_result.error()));
+                return -1;
+            }
+
+            f64 const import_time = seconds_since(start);
+            KD_Tree tree;
+            tree.build(scene, options);
+            built_hash = tree.hash();
+            f64 const build_time = seconds_since(start);
+            if(!write_scene_cache(cache_path, key, scene.materials, scene, tree)) {
+                cout.write(format("could not write {}\n"_sv, cache_path));
+                return -1;
+            }
+
+            f64 const time = seconds_since(start);
+            cout.write(format("scene_cache: {} triangles\n"_sv, scene.triangles.size()));
+            cout.write(format("  import + build + write cache: {} ms (import {} ms, build {} ms, write {} ms)\n"_sv, format_fixed(1000.0 * time, 1),
+                              format_fixed(1000.0 * import_time, 1), format_fixed(1000.0 * (build_time - import_time), 1),
+                              format_fixed(1000.0 * (time - build_time), 1)));
+        }
+
+        bool identical = true;
+        for(i64 i = 0; i < 2; ++i) {
+            Benchmark_Clock::time_point const start = Benchmark_Clock::now();
+            Mapped_File source;
+            if(!source.open(obj_path)) {
+                cout.write(format("could not map {}\n"_sv, obj_path));
+                return -1;
+            }
+
+            Scene scene;
+            add_material_spheres(scene);
+            Handle<Material> const material = scene.materials.create_material(Material{Vec3{0.4f, 0.4f, 0.4f}});
+            u64 const key = calculate_scene_cache_key(source.data(), scene.materials, material, scene, options);
+            f64 const hash_time = seconds_since(start);
+            KD_Tree tree;
+            if(!load_scene_cache(cache_path, key, scene.materials, scene, tree)) {
+                cout.write(format("could not load {}\n"_sv, cache_path));
+                return -1;
+            }
+
+            f64 const time = seconds_since(start);
+            bool const matches = (tree.hash() == built_hash);
+            identical = identical && matches;
+            cout.write(format("  load cache: {} ms (hash source {} ms), {}\n"_sv, format_fixed(1000.0 * time, 1), format_fixed(1000.0 * hash_time, 1),
+                              matches ? "identical"_sv : "DIFFERENT"_sv));
+        }
+        return identical ? 0 : -1;
+    }
+} // namespace raytracing
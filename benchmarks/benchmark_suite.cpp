@@ -0,0 +1,562 @@
+#include <anton/algorithm/sort.hpp>
+#include <anton/console.hpp>
+#include <anton/filesystem.hpp>
+#include <anton/format.hpp>
+#include <benchmarks.hpp>
+#include <bvh.hpp>
+#include <camera.hpp>
+#include <filesystem.hpp>
+#include <kd_tree.hpp>
+#include <materials.hpp>
+#include <random_engine.hpp>
+#include <renderer.hpp>
+#include <triangle_packets.hpp>
+
+#include <math.h>
+#include <stdlib.h>
+
+namespace raytracing {
+    // Version of the layout of the results file. Results of other versions are not compared.
+    constexpr i64 suite_results_version = 2;
+
+    struct Suite_Result {
+        // Unique name of the measurement, e.g. "sphere_field_1000/kd_tree_build".
+        String name;
+        String_View unit;
+        f64 value;
+        bool higher_is_better;
+    };
+
+    static void add_result(Array<Suite_Result>& results, String_View const scene, String_View const metric, String_View const unit, f64 const value,
+                           bool const higher_is_better) {
+        Console_Output cout;
+        String name = format("{}/{}"_sv, scene, metric);
+        cout.write(format("  {}: {} {}\n"_sv, name, format_fixed(value, 3), unit));
+        results.push_back(Suite_Result{ANTON_MOV(name), unit, value, higher_is_better});
+    }
+
+    // generate_sphere_field
+    // Scatters count spheres of random sizes in a cube with the volume growing with count.
+    //
+    [[nodiscard]] static Scene generate_sphere_field(i64 const count) {
+        Random_Engine random_engine = create_random_engine(184729);
+        f32 const half_side = 2.0f * cbrtf(static_cast<f32>(count));
+        Scene scene;
+        Handle<Material> const material = scene.materials.create_material(Material{Vec3{0.6f, 0.3f, 0.2f}});
+        scene.spheres.ensure_capacity(count);
+        for(i64 i = 0; i < count; ++i) {
+            Vec3 const position{random_f32(random_engine, -half_side, half_side), random_f32(random_engine, -half_side, half_side),
+                                random_f32(random_engine, -half_side, half_side)};
+            scene.spheres.push_back(Sphere{position, random_f32(random_engine, 0.2f, 0.8f), material});
+        }
+        return scene;
+    }
+
+    // measure_median_seconds
+    // Calls measure repetitions times.
+    //
+    // Returns:
+    // The median duration of the calls in seconds.
+    //
+    template<typename Measure>
+    [[nodiscard]] static f64 measure_median_seconds(i64 const repetitions, Measure&& measure) {
+        Array<f64> durations{reserve, repetitions};
+        for(i64 repetition = 0; repetition < repetitions; ++repetition) {
+            Benchmark_Clock::time_point const start = Benchmark_Clock::now();
+            measure();
+            durations.push_back(seconds_since(start));
+        }
+
+        quick_sort(durations.data(), durations.data() + durations.size(), [](f64 const lhs, f64 const rhs) { return lhs < rhs; });
+        return durations[durations.size() / 2];
+    }
+
+    [[nodiscard]] static f64 measure_mrays(Acceleration_Structure const& structure, Scene const& scene, Slice<Ray const> const rays, i64 const repetitions) {
+        i64 hits = 0;
+        f64 const time = measure_median_seconds(repetitions, [&structure, &scene, rays, &hits]() {
+            for(Ray const& ray: rays) {
+                Optional<Surface_Interaction> const result = structure.intersect(scene, ray);
+                hits += result.holds_value();
+            }
+        });
+        // Keep the traversal from being optimized away.
+        if(hits < 0) {
+            return 0.0;
+        }
+        return static_cast<f64>(rays.size()) / time / 1000000.0;
+    }
+
+    static void run_scene_suite(Array<Suite_Result>& results, String_View const name, Scene const& scene, i64 const ray_count, i64 const repetitions) {
+        Console_Output cout;
+        cout.write(format("{}: {} triangles, {} spheres\n"_sv, name, scene.triangles.size(), scene.spheres.size()));
+        Extent3 const bounds = calculate_scene_bounds(scene);
+        Array<Ray> const rays = generate_rays(bounds, ray_count, 4920184);
+        KD_Tree kd_tree;
+        {
+            KD_Tree::Build_Options const options{.max_primitives = 16, .empty_bonus = 0.2f};
+            f64 const build_time = measure_median_seconds(repetitions, [&kd_tree, &scene, &options]() { kd_tree.build(scene, options); });
+            add_result(results, name, "kd_tree_build"_sv, "ms"_sv, 1000.0 * build_time, false);
+            add_result(results, name, "kd_tree_memory"_sv, "MiB"_sv, static_cast<f64>(kd_tree.size_bytes()) / (1024.0 * 1024.0), false);
+            add_result(results, name, "kd_tree_traversal"_sv, "Mrays/s"_sv, measure_mrays(kd_tree, scene, rays, repetitions), true);
+        }
+        {
+            BVH bvh;
+            f64 const build_time = measure_median_seconds(repetitions, [&bvh, &scene]() { bvh.build(scene, BVH::Build_Options{}); });
+            add_result(results, name, "bvh_build"_sv, "ms"_sv, 1000.0 * build_time, false);
+            add_result(results, name, "bvh_memory"_sv, "MiB"_sv, static_cast<f64>(bvh.size_bytes()) / (1024.0 * 1024.0), false);
+            add_result(results, name, "bvh_traversal"_sv, "Mrays/s"_sv, measure_mrays(bvh, scene, rays, repetitions), true);
+        }
+
+        if(scene.triangles.size() > 0) {
+            // The triangle kernels are exercised by the leaves of KD_Tree.
+            struct Kernel {
+                String_View metric;
+                Triangle_Kernel kernel;
+            };
+
+            Kernel const kernels[] = {
+                {"triangle_kernel_scalar"_sv, Triangle_Kernel::scalar},
+                {"triangle_kernel_sse"_sv, Triangle_Kernel::sse},
+                {"triangle_kernel_avx2"_sv, Triangle_Kernel::avx2},
+            };
+
+            for(Kernel const& kernel: kernels) {
+                if(select_triangle_kernel(kernel.kernel)) {
+                    add_result(results, name, kernel.metric, "Mrays/s"_sv, measure_mrays(kd_tree, scene, rays, repetitions), true);
+                }
+            }
+            (void)select_triangle_kernel(get_supported_triangle_kernel());
+        }
+
+        // Full frame render looking at the scene from outside of its bounds.
+        Vec3 const center = 0.5f * (bounds.min + bounds.max);
+        f32 const radius = 0.5f * math::length(bounds.max - bounds.min);
+        Camera const camera{center + Vec3{0.6f, 0.5f, 1.0f} * radius, 60.0f, 16.0f / 9.0f, 360};
+        Camera_Target const target{center};
+        Context ctx;
+        ctx.seed = 7849034;
+        ctx.bounces = 4;
+        ctx.samples = 4;
+        ctx.prebuilt_acceleration_structure = &kd_tree;
+        f64 const render_time = measure_median_seconds(repetitions, [&ctx, &scene, &camera, &target]() { (void)render_scene(ctx, scene, camera, target); });
+        add_result(results, name, "render"_sv, "ms"_sv, 1000.0 * render_time, false);
+    }
+
+    static void run_image_output_suite(Array<Suite_Result>& results, String_View const directory, i64 const repetitions) {
+        Console_Output cout;
+        i64 const width = 1920;
+        i64 const height = 1080;
+        Array<Vec3> pixels{reserve, width * height};
+        for(i64 y = 0; y < height; ++y) {
+            for(i64 x = 0; x < width; ++x) {
+                pixels.push_back(Vec3{static_cast<f32>(x) / width, static_cast<f32>(y) / height, 0.5f});
+            }
+        }
+
+        cout.write(format("image_output: {}x{} pixels\n"_sv, width, height));
+        struct Writer {
+            String_View metric;
+            String_View file;
+            void (*write)(Output_Stream& stream, Slice<Vec3 const> pixels, i64 width, i64 height);
+        };
+
+        Writer const writers[] = {
+            {"ppm"_sv, "benchmark_suite.ppm"_sv, write_ppm_file},
+            {"pfm"_sv, "benchmark_suite.pfm"_sv, write_pfm_file},
+        };
+
+        for(Writer const& writer: writers) {
+            String const path = fs::concat_paths(directory, writer.file);
+            if(!fs::Output_File_Stream(path)) {
+                cout.write(format("could not open {} for writing\n"_sv, path));
+                continue;
+            }
+
+            f64 const write_time = measure_median_seconds(repetitions, [&writer, &path, &pixels]() {
+                fs::Output_File_Stream stream(path);
+                writer.write(stream, pixels, width, height);
+            });
+            add_result(results, "image_output"_sv, writer.metric, "ms"_sv, 1000.0 * write_time, false);
+        }
+    }
+
+    [[nodiscard]] static bool write_suite_results(String_View const path, Slice<Suite_Result const> const results) {
+        fs::Output_File_Stream stream(String{path});
+        if(!stream) {
+            return false;
+        }
+
+        // The braces of the objects are written separately since they delimit the replacement fields of format.
+        stream.write("{\n"_sv);
+        stream.write(format("  \"version\": {},\n  \"results\": [\n"_sv, suite_results_version));
+        for(i64 i = 0; i < results.size(); ++i) {
+            Suite_Result const& result = results[i];
+            stream.write("    {"_sv);
+            stream.write(format("\"name\": \"{}\", \"unit\": \"{}\", \"value\": {}, \"better\": \"{}\""_sv, result.name, result.unit,
+                                format_fixed(result.value, 3), result.higher_is_better ? "higher"_sv : "lower"_sv));
+            stream.write(i + 1 < results.size() ? "},\n"_sv : "}\n"_sv);
+        }
+        stream.write("  ]\n}\n"_sv);
+        return true;
+    }
+
+    // run_suite_benchmark
+    // Runs the build, traversal, triangle kernel and render measurements over procedurally
+    // generated sphere fields and tessellated meshes of increasing size and over the bundled
+    // assets, followed by the image output measurements. Every timing is the median of
+    // repetitions runs. The peak memory is reported once for the whole run since it only
+    // ever grows within the process. Writes the results as JSON to be compared with
+    // the compare benchmark.
+    //
+    // Arguments:
+    // [path of the JSON results file] [number of rays] [largest tessellated mesh in triangles] [directory to write the images to]
+    // [repetitions]
+    //
+    int run_suite_benchmark(Slice<String_View const> const arguments) {
+        String_View const output_path = (arguments.size() > 0 ? arguments[0] : "benchmark_results.json"_sv);
+        i64 const ray_count = (arguments.size() > 1 ? str_to_i64(arguments[1]) : 500000);
+        i64 const max_triangles = (arguments.size() > 2 ? str_to_i64(arguments[2]) : 1000000);
+        String_View const directory = (arguments.size() > 3 ? arguments[3] : "."_sv);
+        i64 const repetitions = math::max(arguments.size() > 4 ? str_to_i64(arguments[4]) : 5, (i64)1);
+        Console_Output cout;
+        Array<Suite_Result> results;
+        for(i64 count = 1000; count <= 100000; count *= 10) {
+            Scene const scene = generate_sphere_field(count);
+            run_scene_suite(results, format("sphere_field_{}"_sv, count), scene, ray_count, repetitions);
+        }
+
+        for(i64 triangles = 10000; triangles <= max_triangles; triangles *= 10) {
+            Scene const scene = generate_tessellated_mesh(triangles);
+            run_scene_suite(results, format("tessellated_mesh_{}"_sv, triangles), scene, ray_count, repetitions);
+        }
+
+        struct Asset {
+            String_View name;
+            String_View path;
+        };
+
+        Asset const assets[] = {
+            {"asset_cube"_sv, "./assets/cube.obj"_sv},
+            {"asset_skull"_sv, "./assets/skull.obj"_sv},
+        };
+
+        for(Asset const& asset: assets) {
+            Expected<Scene, String> scene_result = load_obj_scene(asset.path);
+            if(!scene_result) {
+                cout.write(format("skipping {}: {}\n"_sv, asset.path, scene_result.error()));
+                continue;
+            }
+
+            run_scene_suite(results, asset.name, scene_result.value(), ray_count, repetitions);
+        }
+
+        run_image_output_suite(results, directory, repetitions);
+        add_result(results, "process"_sv, "peak_memory"_sv, "MiB"_sv, static_cast<f64>(get_peak_memory_bytes()) / (1024.0 * 1024.0), false);
+        if(!write_suite_results(output_path, results)) {
+            cout.write(format("could not write {}\n"_sv, output_path));
+            return -1;
+        }
+
+        cout.write(format("wrote {} results to {}\n"_sv, results.size(), output_path));
+        return 0;
+    }
+
+    struct Parsed_Result {
+        String name;
+        f64 value;
+        bool higher_is_better;
+    };
+
+    // Json_Reader
+    // Reads the subset of JSON written by write_suite_results. Strings with escape sequences
+    // are not supported since the suite never writes them.
+    //
+    struct Json_Reader {
+        char8 const* current;
+        char8 const* end;
+
+        void skip_whitespace() {
+            while(current != end && (*current == ' ' || *current == '\n' || *current == '\r' || *current == '\t')) {
+                ++current;
+            }
+        }
+
+        [[nodiscard]] bool consume(char8 const c) {
+            skip_whitespace();
+            if(current != end && *current == c) {
+                ++current;
+                return true;
+            }
+            return false;
+        }
+
+        [[nodiscard]] bool peek(char8 const c) {
+            skip_whitespace();
+            return current != end && *current == c;
+        }
+
+        [[nodiscard]] bool read_string(String_View& string) {
+            if(!consume('"')) {
+                return false;
+            }
+
+            char8 const* const begin = current;
+            while(current != end && *current != '"') {
+                if(*current == '\\') {
+                    return false;
+                }
+                ++current;
+            }
+
+            if(current == end) {
+                return false;
+            }
+
+            string = String_View{begin, current};
+            ++current;
+            return true;
+        }
+
+        [[nodiscard]] bool read_number(f64& number) {
+            skip_whitespace();
+            char buffer[64];
+            i64 length = 0;
+            while(current != end && length < 63 &&
+                  ((*current >= '0' && *current <= '9') || *current == '-' || *current == '+' || *current == '.' || *current == 'e' || *current == 'E')) {
+                buffer[length] = *current;
+                ++length;
+                ++current;
+            }
+
+            if(length == 0) {
+                return false;
+            }
+
+            buffer[length] = '\0';
+            char* number_end = nullptr;
+            number = strtod(buffer, &number_end);
+            return number_end == buffer + length;
+        }
+
+        // skip_value
+        // Skips a string, a number, a literal, an object or an array.
+        //
+        [[nodiscard]] bool skip_value() {
+            skip_whitespace();
+            if(peek('"')) {
+                String_View string;
+                return read_string(string);
+            }
+
+            char8 const open = (current != end ? *current : '\0');
+            if(open == '{' || open == '[') {
+                char8 const close = (open == '{' ? '}' : ']');
+                ++current;
+                if(consume(close)) {
+                    return true;
+                }
+
+                do {
+                    if(open == '{') {
+                        String_View key;
+                        if(!read_string(key) || !consume(':')) {
+                            return false;
+                        }
+                    }
+
+                    if(!skip_value()) {
+                        return false;
+                    }
+                } while(consume(','));
+                return consume(close);
+            }
+
+            // Numbers and the literals true, false and null.
+            char8 const* const begin = current;
+            while(current != end && *current != ',' && *current != '}' && *current != ']' && *current != ' ' && *current != '\n') {
+                ++current;
+            }
+            return current != begin;
+        }
+    };
+
+    [[nodiscard]] static bool read_result(Json_Reader& reader, Parsed_Result& result) {
+        if(!reader.consume('{')) {
+            return false;
+        }
+
+        bool has_name = false;
+        bool has_value = false;
+        result.higher_is_better = false;
+        do {
+            String_View key;
+            if(!reader.read_string(key) || !reader.consume(':')) {
+                return false;
+            }
+
+            if(key == "name"_sv) {
+                String_View name;
+                if(!reader.read_string(name)) {
+                    return false;
+                }
+                result.name = String{name};
+                has_name = true;
+            } else if(key == "value"_sv) {
+                if(!reader.read_number(result.value)) {
+                    return false;
+                }
+                has_value = true;
+            } else if(key == "better"_sv) {
+                String_View better;
+                if(!reader.read_string(better)) {
+                    return false;
+                }
+                result.higher_is_better = (better == "higher"_sv);
+            } else if(!reader.skip_value()) {
+                return false;
+            }
+        } while(reader.consume(','));
+        return reader.consume('}') && has_name && has_value;
+    }
+
+    [[nodiscard]] static Expected<Array<Parsed_Result>, String> read_suite_results(String_View const path) {
+        Expected<Array<u8>, String> file = read_file(path);
+        if(!file) {
+            return {expected_error, ANTON_MOV(file.error())};
+        }
+
+        Array<u8> const& data = file.value();
+        Json_Reader reader{reinterpret_cast<char8 const*>(data.data()), reinterpret_cast<char8 const*>(data.data() + data.size())};
+        Array<Parsed_Result> results;
+        f64 version = 0.0;
+        bool has_results = false;
+        if(!reader.consume('{')) {
+            return {expected_error, format("{}: expected an object"_sv, path)};
+        }
+
+        do {
+            String_View key;
+            if(!reader.read_string(key) || !reader.consume(':')) {
+                return {expected_error, format("{}: malformed object"_sv, path)};
+            }
+
+            if(key == "version"_sv) {
+                if(!reader.read_number(version)) {
+                    return {expected_error, format("{}: malformed version"_sv, path)};
+                }
+            } else if(key == "results"_sv) {
+                if(!reader.consume('[')) {
+                    return {expected_error, format("{}: expected an array of results"_sv, path)};
+                }
+
+                if(!reader.consume(']')) {
+                    do {
+                        Parsed_Result result;
+                        if(!read_result(reader, result)) {
+                            return {expected_error, format("{}: malformed result"_sv, path)};
+                        }
+                        results.push_back(ANTON_MOV(result));
+                    } while(reader.consume(','));
+
+                    if(!reader.consume(']')) {
+                        return {expected_error, format("{}: unterminated array of results"_sv, path)};
+                    }
+                }
+                has_results = true;
+            } else if(!reader.skip_value()) {
+                return {expected_error, format("{}: malformed value"_sv, path)};
+            }
+        } while(reader.consume(','));
+
+        if(!reader.consume('}') || !has_results) {
+            return {expected_error, format("{}: malformed results file"_sv, path)};
+        }
+
+        if(static_cast<i64>(version) != suite_results_version) {
+            return {expected_error, format("{}: unsupported version {}"_sv, path, static_cast<i64>(version))};
+        }
+        return {expected_value, ANTON_MOV(results)};
+    }
+
+    // run_compare_benchmark
+    // Compares two results files written by the suite benchmark and flags every measurement
+    // that became worse than the baseline by more than the tolerance. Measurements of the
+    // baseline missing from the current results are flagged as well.
+    //
+    // Arguments:
+    // <baseline JSON results file> <current JSON results file> [tolerance in percent]
+    //
+    // Returns:
+    // 0 if there are no regressions and no missing measurements, -1 otherwise.
+    //
+    int run_compare_benchmark(Slice<String_View const> const arguments) {
+        Console_Output cout;
+        if(arguments.size() < 2) {
+            cout.write("usage: raytracing_benchmarks compare <baseline.json> <current.json> [tolerance in percent]\n"_sv);
+            return -1;
+        }
+
+        f64 const tolerance = (arguments.size() > 2 ? static_cast<f64>(str_to_i64(arguments[2])) : 5.0);
+        Expected<Array<Parsed_Result>, String> baseline = read_suite_results(arguments[0]);
+        if(!baseline) {
+            cout.write(format("{}\n"_sv, baseline.error()));
+            return -1;
+        }
+
+        Expected<Array<Parsed_Result>, String> current = read_suite_results(arguments[1]);
+        if(!current) {
+            cout.write(format("{}\n"_sv, current.error()));
+            return -1;
+        }
+
+        i64 regressions = 0;
+        i64 improvements = 0;
+        for(Parsed_Result const& result: current.value()) {
+            Parsed_Result const* reference = nullptr;
+            for(Parsed_Result const& candidate: baseline.value()) {
+                if(candidate.name == result.name) {
+                    reference = &candidate;
+                    break;
+                }
+            }
+
+            if(reference == nullptr) {
+                cout.write(format("  {}: {} (new)\n"_sv, result.name, format_fixed(result.value, 3)));
+                continue;
+            }
+
+            f64 const change = (reference->value != 0.0 ? 100.0 * (result.value - reference->value) / reference->value : 0.0);
+            f64 const worsening = (result.higher_is_better ? -change : change);
+            String_View status = ""_sv;
+            if(worsening > tolerance) {
+                status = " REGRESSION"_sv;
+                regressions += 1;
+            } else if(worsening < -tolerance) {
+                status = " improvement"_sv;
+                improvements += 1;
+            }
+
+            cout.write(format("  {}: {} -> {} ({}%){}\n"_sv, result.name, format_fixed(reference->value, 3), format_fixed(result.value, 3),
+                              format_fixed(change, 1), status));
+        }
+
+        i64 missing = 0;
+        for(Parsed_Result const& reference: baseline.value()) {
+            bool found = false;
+            for(Parsed_Result const& result: current.value()) {
+                if(result.name == reference.name) {
+                    found = true;
+                    break;
+                }
+            }
+
+            if(!found) {
+                cout.write(format("  {}: {} (missing)\n"_sv, reference.name, format_fixed(reference.value, 3)));
+                missing += 1;
+            }
+        }
+
+        cout.write(format("{} regressions, {} missing, {} improvements beyond {}%\n"_sv, regressions, missing, improvements, format_fixed(tolerance, 1)));
+        return (regressions > 0 || missing > 0) ? -1 : 0;
+    }
+} // namespace raytracing
@@ -0,0 +1,47 @@
+#include <anton/console.hpp>
+#include <anton/format.hpp>
+#include <benchmarks.hpp>
+#include <kd_tree.hpp>
+
+namespace raytracing {
+    // run_traversal_benchmark
+    // Measures the single-threaded closest-hit throughput of KD_Tree::intersect
+    // with incoherent rays.
+    //
+    // Arguments:
+    // [path to an OBJ file] [number of rays]
+    //
+    int run_traversal_benchmark(Slice<String_View const> const arguments) {
+        String_View const path = (arguments.size() > 0 ? arguments[0] : "./assets/skull.obj"_sv);
+        i64 const ray_count = (arguments.size() > 1 ? str_to_i64(arguments[1]) : 1000000);
+        Console_Output cout;
+        Expected<Scene, String> scene_result = load_obj_scene(path);
+        if(!scene_result) {
+            cout.write(scene_result.error());
+            return -1;
+        }
+
+        Scene const& scene = scene_result.value();
+        KD_Tree tree;
+        tree.build(scene, KD_Tree::Build_Options{.max_primitives = 16, .empty_bonus = 0.2f});
+        Array<Ray> const rays = generate_rays(calculate_scene_bounds(scene), ray_count, 4920184);
+        cout.write(format("traversal: {} triangles, {} rays\n"_sv, scene.triangles.size(), rays.size()));
+
+        i64 const repetitions = 5;
+        f64 best_time = math::infinity;
+        i64 hits = 0;
+        for(i64 repetition = 0; repetition < repetitions; ++repetition) {
+            hits = 0;
+            Benchmark_Clock::time_point const start = Benchmark_Clock::now();
+            for(Ray const& ray: rays) {
+                Optional<Surface_Interaction> const result = tree.intersect(scene, ray);
+                hits += result.holds_value();
+            }
+            best_time = math::min(best_time, seconds_since(start));
+        }
+
+        f64 const mrays = static_cast<f64>(rays.size()) / best_time / 1000000.0;
+        cout.write(format("  best of {}: {} s, {} Mrays/s, {} hits\n"_sv, repetitions, format_fixed(best_time, 3), format_fixed(mrays, 3), hits));
+        return 0;
+    }
+} // namespace raytracing
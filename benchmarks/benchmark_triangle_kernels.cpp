@@ -0,0 +1,93 @@
+#include <anton/console.hpp>
+#include <anton/format.hpp>
+#include <benchmarks.hpp>
+#include <kd_tree.hpp>
+#include <triangle_packets.hpp>
+
+namespace raytracing {
+    // run_triangle_kernels_benchmark
+    // Measures the single-threaded throughput of KD_Tree::intersect with each of the
+    // leaf triangle kernels and compares their hits with the scalar kernel.
+    //
+    // Arguments:
+    // [path to an OBJ file] [number of rays]
+    //
+    int run_triangle_kernels_benchmark(Slice<String_View const> const arguments) {
+        String_View const path = (arguments.size() > 0 ? arguments[0] : "./assets/skull.obj"_sv);
+        i64 const ray_count = (arguments.size() > 1 ? str_to_i64(arguments[1]) : 1000000);
+        Console_Output cout;
+        Expected<Scene, String> scene_result = load_obj_scene(path);
+        if(!scene_result) {
+            cout.write(scene_result.error());
+            return -1;
+        }
+
+        Scene const& scene = scene_result.value();
+        KD_Tree tree;
+        tree.build(scene, KD_Tree::Build_Options{.max_primitives = 16, .empty_bonus = 0.2f});
+        Array<Ray> const rays = generate_rays(calculate_scene_bounds(scene), ray_count, 4920184);
+        cout.write(format("triangle_kernels: {} triangles, {} rays\n"_sv, scene.triangles.size(), rays.size()));
+
+        struct Kernel {
+            String_View name;
+            Triangle_Kernel kernel;
+        };
+
+        Kernel const kernels[] = {
+            {"scalar"_sv, Triangle_Kernel::scalar},
+            {"sse"_sv, Triangle_Kernel::sse},
+            {"avx2"_sv, Triangle_Kernel::avx2},
+        };
+
+        Triangle_Kernel const default_kernel = get_supported_triangle_kernel();
+        // Distances of the scalar kernel. Misses are stored as infinity.
+        Array<f32> reference{reserve, rays.size()};
+        for(Kernel const& kernel: kernels) {
+            if(!select_triangle_kernel(kernel.kernel)) {
+                cout.write(format("  {}: not supported\n"_sv, kernel.name));
+                continue;
+            }
+
+            i64 const repetitions = 5;
+            f64 best_time = math::infinity;
+            Array<f32> distances{reserve, rays.size()};
+            for(i64 repetition = 0; repetition < repetitions; ++repetition) {
+                distances.clear();
+                Benchmark_Clock::time_point const start = Benchmark_Clock::now();
+                for(Ray const& ray: rays) {
+                    Optional<Surface_Interaction> const result = tree.intersect(scene, ray);
+                    distances.push_back(result ? result->distance : math::infinity);
+                }
+                best_time = math::min(best_time, seconds_since(start));
+            }
+
+            if(kernel.kernel == Triangle_Kernel::scalar) {
+                reference = ANTON_MOV(distances);
+                f64 const mrays = static_cast<f64>(rays.size()) / best_time / 1000000.0;
+                cout.write(format("  {}: {} Mrays/s\n"_sv, kernel.name, format_fixed(mrays, 3)));
+            } else {
+                i64 mismatches = 0;
+                f32 max_difference = 0.0f;
+                for(i64 i = 0; i < rays.size(); ++i) {
+                    if(distances[i] == reference[i]) {
+                        continue;
+                    }
+
+                    // Hit in one kernel and a miss in the other.
+                    if(distances[i] == math::infinity || reference[i] == math::infinity) {
+                        mismatches += 1;
+                    } else {
+                        max_difference = math::max(max_difference, math::abs(distances[i] - reference[i]));
+                    }
+                }
+
+                f64 const mrays = static_cast<f64>(rays.size()) / best_time / 1000000.0;
+                cout.write(format("  {}: {} Mrays/s, {} hit mismatches, max distance difference {}\n"_sv, kernel.name, format_fixed(mrays, 3), mismatches,
+                                  format_fixed(max_difference, 6)));
+            }
+        }
+
+        select_triangle_kernel(default_kernel);
+        return 0;
+    }
+} // namespace raytracing
@@ -0,0 +1,57 @@
+#include <anton/console.hpp>
+#include <anton/format.hpp>
+#include <benchmarks.hpp>
+#include <kd_tree.hpp>
+
+namespace raytracing {
+    // run_triangle_storage_benchmark
+    // Compares the memory used per triangle by the indexed scene and by KD_Tree with
+    // full precision triangle packets and with quantized vertices, and measures the
+    // single-threaded closest-hit throughput of both trees.
+    //
+    // Arguments:
+    // [number of triangles of the synthetic mesh] [number of rays]
+    //
+    int run_triangle_storage_benchmark(Slice<String_View const> const arguments) {
+        i64 const triangle_count = (arguments.size() > 0 ? str_to_i64(arguments[0]) : 1000000);
+        i64 const ray_count = (arguments.size() > 1 ? str_to_i64(arguments[1]) : 1000000);
+        Console_Output cout;
+        Scene const scene = generate_tessellated_mesh(triangle_count);
+        Array<Ray> const rays = generate_rays(calculate_scene_bounds(scene), ray_count, 4920184);
+        f64 const triangles = static_cast<f64>(scene.triangles.size());
+        i64 const deindexed_bytes = scene.triangles.size() * static_cast<i64>(sizeof(Triangle));
+        i64 const indexed_bytes = scene.vertices.size() * static_cast<i64>(sizeof(Vec3)) + scene.triangles.size() * static_cast<i64>(sizeof(Indexed_Triangle));
+        cout.write(format("triangle_storage: {} triangles, {} vertices, {} rays\n"_sv, scene.triangles.size(), scene.vertices.size(), rays.size()));
+        cout.write(format("  scene: de-indexed {} B/triangle, indexed {} B/triangle\n"_sv, format_fixed(deindexed_bytes / triangles, 1),
+                          format_fixed(indexed_bytes / triangles, 1)));
+
+        i64 hits[2] = {};
+        for(i64 i = 0; i < 2; ++i) {
+            bool const compress = (i == 1);
+            KD_Tree tree;
+            tree.build(scene, KD_Tree::Build_Options{.max_primitives = 16, .empty_bonus = 0.2f, .compress_triangles = compress});
+            i64 const repetitions = 3;
+            f64 best_time = math::infinity;
+            for(i64 repetition = 0; repetition < repetitions; ++repetition) {
+                hits[i] = 0;
+                Benchmark_Clock::time_point const start = Benchmark_Clock::now();
+                for(Ray const& ray: rays) {
+                    Optional<Surface_Interaction> const result = tree.intersect(scene, ray);
+                    hits[i] += result.holds_value();
+                }
+                best_time = math::min(best_time, seconds_since(start));
+            }
+
+            f64 const mrays = static_cast<f64>(rays.size()) / best_time / 1000000.0;
+            cout.write(format("  {}: tree {} B/triangle, {} Mrays/s, {} hits\n"_sv, compress ? "quantized"_sv : "packets"_sv,
+                              format_fixed(tree.size_bytes() / triangles, 1), format_fixed(mrays, 3), hits[i]));
+        }
+
+        // Quantization moves the vertices slightly, hence rays grazing the silhouette may
+        // hit or miss differently. A watertight mesh must not lose more than a few hits.
+        i64 const difference = (hits[0] > hits[1] ? hits[0] - hits[1] : hits[1] - hits[0]);
+        bool const matches = (difference * 1000 <= hits[0]);
+        cout.write(format("  hits {}\n"_sv, matches ? "match"_sv : "DIFFER"_sv));
+        return matches ? 0 : -1;
+    }
+} // namespace raytracing
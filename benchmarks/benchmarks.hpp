@@ -0,0 +1,88 @@
+#pragma once
+
+#include <anton/array.hpp>
+#include <anton/expected.hpp>
+#include <anton/slice.hpp>
+#include <anton/string.hpp>
+#include <build_config.hpp>
+#include <scene.hpp>
+
+#include <chrono>
+
+namespace raytracing {
+    using Benchmark_Clock = std::chrono::steady_clock;
+
+    // seconds_since
+    //
+    // Returns:
+    // Seconds elapsed since start.
+    //
+    [[nodiscard]] f64 seconds_since(Benchmark_Clock::time_point start);
+
+    // format_fixed
+    // Formats value with a fixed number of decimal places.
+    //
+    [[nodiscard]] String format_fixed(f64 value, i64 decimals);
+
+    // root_mean_square_error
+    // Error of the pixels of an image against the pixels of a reference image of the same size.
+    //
+    [[nodiscard]] f64 root_mean_square_error(Slice<Vec3 const> pixels, Slice<Vec3 const> reference);
+
+    // load_obj_scene
+    // Imports all meshes from the OBJ file at path into the triangles of a scene.
+    // All triangles use a single diffuse material.
+    //
+    [[nodiscard]] Expected<Scene, String> load_obj_scene(String_View path);
+
+    // write_obj_file
+    // Writes the vertices and the triangles of the scene as a single indexed OBJ mesh.
+    //
+    // Returns:
+    // false if the file could not be opened.
+    //
+    [[nodiscard]] bool write_obj_file(String_View path, Scene const& scene);
+
+    // generate_tessellated_mesh
+    // Generates a closed, bumpy UV sphere made of approximately triangle_count triangles.
+    //
+    [[nodiscard]] Scene generate_tessellated_mesh(i64 triangle_count);
+
+    // add_material_spheres
+    // Adds a diffuse ground, a glass sphere and a metallic sphere around the origin
+    // of the scene, so that renders exercise every kind of material.
+    //
+    void add_material_spheres(Scene& scene);
+
+    // generate_rays
+    // Generates rays originating at random points on the sphere enclosing bounds
+    // pointing towards random points inside bounds.
+    //
+    [[nodiscard]] Array<Ray> generate_rays(Extent3 const& bounds, i64 count, i64 seed);
+
+    // get_peak_memory_bytes
+    //
+    // Returns:
+    // The largest resident memory of the process so far or 0 if it is not available.
+    //
+    [[nodiscard]] i64 get_peak_memory_bytes();
+
+    // Benchmarks. Each one receives the command line arguments following its name.
+    int run_traversal_benchmark(Slice<String_View const> arguments);
+    int run_acceleration_benchmark(Slice<String_View const> arguments);
+    int run_kd_tree_build_benchmark(Slice<String_View const> arguments);
+    int run_mesh_loading_benchmark(Slice<String_View const> arguments);
+    int run_triangle_kernels_benchmark(Slice<String_View const> arguments);
+    int run_packets_benchmark(Slice<String_View const> arguments);
+    int run_integrators_benchmark(Slice<String_View const> arguments);
+    int run_adaptive_benchmark(Slice<String_View const> arguments);
+    int run_random_benchmark(Slice<String_View const> arguments);
+    int run_samplers_benchmark(Slice<String_View const> arguments);
+    int run_scene_cache_benchmark(Slice<String_View const> arguments);
+    int run_image_output_benchmark(Slice<String_View const> arguments);
+    int run_triangle_storage_benchmark(Slice<String_View const> arguments);
+    int run_instancing_benchmark(Slice<String_View const> arguments);
+    int run_next_event_benchmark(Slice<String_View const> arguments);
+    int run_suite_benchmark(Slice<String_View const> arguments);
+    int run_compare_benchmark(Slice<String_View const> arguments);
+} // namespace raytracing
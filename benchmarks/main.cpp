@@ -0,0 +1,220 @@
+#include <anton/array.hpp>
+#include <anton/console.hpp>
+#include <anton/filesystem.hpp>
+#include <anton/format.hpp>
+#include <anton/math/math.hpp>
+#include <benchmarks.hpp>
+#include <materials.hpp>
+#include <obj_loader.hpp>
+#include <random_engine.hpp>
+
+#include <stdio.h>
+
+#if defined(_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+    // Windows.h must be included before psapi.h.
+    #include <psapi.h>
+#else
+    #include <sys/resource.h>
+#endif
+
+namespace raytracing {
+    f64 seconds_since(Benchmark_Clock::time_point const start) {
+        std::chrono::duration<f64> const duration = Benchmark_Clock::now() - start;
+        return duration.count();
+    }
+
+    String format_fixed(f64 const value, i64 const decimals) {
+        i64 scale = 1;
+        for(i64 i = 0; i < decimals; ++i) {
+            scale *= 10;
+        }
+
+        bool const negative = value < 0.0;
+        i64 const scaled = static_cast<i64>((negative ? -value : value) * scale + 0.5);
+        String_View const sign = (negative ? "-"_sv : ""_sv);
+        if(decimals == 0) {
+            return format("{}{}"_sv, sign, scaled);
+        }
+
+        // Offset the fraction by scale to keep its leading zeros and skip the leading 1.
+        String const fraction = format("{}"_sv, scale + scaled % scale);
+        return format("{}{}.{}"_sv, sign, scaled / scale, String_View{fraction.bytes_begin() + 1, fraction.bytes_end()});
+    }
+
+    f64 root_mean_square_error(Slice<Vec3 const> const pixels, Slice<Vec3 const> const reference) {
+        f64 sum = 0.0;
+        for(i64 i = 0; i < pixels.size(); ++i) {
+            Vec3 const difference = pixels[i] - reference[i];
+            sum += math::dot(difference, difference) / 3.0f;
+        }
+        return math::sqrt(sum / pixels.size());
+    }
+
+    Expected<Scene, String> load_obj_scene(String_View const path) {
+        Scene scene;
+        Handle<Material> const material = scene.materials.create_material(Material{Vec3{0.4f, 0.4f, 0.4f}});
+        Expected<i64, String> load_result = load_obj_mesh(path, material, scene, {});
+        if(!load_result) {
+            return {expected_error, ANTON_MOV(load_result.error())};
+        }
+        return {expected_value, ANTON_MOV(scene)};
+    }
+
+    bool write_obj_file(String_View const path, Scene const& scene) {
+        fs::Output_File_Stream stream(String{path});
+        if(!stream) {
+            return false;
+        }
+
+        stream.write("o Mesh\n"_sv);
+        char buffer[128];
+        for(Vec3 const v: scene.vertices) {
+            int const length = snprintf(buffer, sizeof(buffer), "v %.6f %.6f %.6f\n", v.x, v.y, v.z);
+            stream.write(String_View{buffer, buffer + length});
+        }
+
+        for(Indexed_Triangle const& triangle: scene.triangles) {
+            int const length = snprintf(buffer, sizeof(buffer), "f %u %u %u\n", triangle.v1 + 1, triangle.v2 + 1, triangle.v3 + 1);
+            stream.write(String_View{buffer, buffer + length});
+        }
+        return true;
+    }
+
+    Scene generate_tessellated_mesh(i64 const triangle_count) {
+        // A UV sphere with 2 * rings segments has 4 * rings^2 triangles.
+        i64 const rings = math::max((i64)math::sqrt(static_cast<f32>(triangle_count) / 4.0f), (i64)2);
+        i64 const segments = 2 * rings;
+        auto vertex = [rings, segments](i64 const ring, i64 const segment) {
+            f32 const theta = math::pi * static_cast<f32>(ring) / rings;
+            f32 const phi = 2.0f * math::pi * static_cast<f32>(segment) / segments;
+            f32 const radius = 1.0f + 0.1f * math::sin(13.0f * theta) * math::sin(17.0f * phi);
+            return Vec3{radius * math::sin(theta) * math::cos(phi), radius * math::cos(theta), radius * math::sin(theta) * math::sin(phi)};
+        };
+
+        // The vertices are shared by the neighbouring triangles. The seam reuses the first
+        // segment of every ring.
+        Scene scene;
+        Handle<Material> const material = scene.materials.create_material(Material{Vec3{0.4f, 0.4f, 0.4f}});
+        scene.vertices.ensure_capacity((rings + 1) * segments);
+        scene.triangles.ensure_capacity(2 * rings * segments);
+        for(i64 ring = 0; ring <= rings; ++ring) {
+            for(i64 segment = 0; segment < segments; ++segment) {
+                (void)add_vertex(scene, vertex(ring, segment));
+            }
+        }
+
+        auto index = [segments](i64 const ring, i64 const segment) {
+            return static_cast<u32>(ring * segments + segment % segments);
+        };
+
+        for(i64 ring = 0; ring < rings; ++ring) {
+            for(i64 segment = 0; segment < segments; ++segment) {
+                u32 const v00 = index(ring, segment);
+                u32 const v01 = index(ring, segment + 1);
+                u32 const v10 = index(ring + 1, segment);
+                u32 const v11 = index(ring + 1, segment + 1);
+                add_triangle(scene, v00, v01, v11, material);
+                add_triangle(scene, v00, v11, v10, material);
+            }
+        }
+        return scene;
+    }
+
+    void add_material_spheres(Scene& scene) {
+        Handle<Material> const ground = scene.materials.create_material(Material{Vec3{0.8f, 0.8f, 0.0f}});
+        Handle<Material> const glass = scene.materials.create_material(Material{Vec3{1.0f, 1.0f, 1.0f}, false, 0.0f, true, 1.4f});
+        Handle<Material> const metal = scene.materials.create_material(Material{Vec3{0.8f, 0.0f, 0.0f}, true, 0.2f});
+        scene.spheres.push_back(Sphere{Vec3{0.0f, -201.0f, -3.0f}, 200.0f, ground});
+        scene.spheres.push_back(Sphere{Vec3{-1.5f, -0.5f, 1.0f}, 0.5f, glass});
+        scene.spheres.push_back(Sphere{Vec3{1.5f, -0.5f, 1.0f}, 0.5f, metal});
+    }
+
+    Array<Ray> generate_rays(Extent3 const& bounds, i64 const count, i64 const seed) {
+        Random_Engine random_engine = create_random_engine(seed);
+        Vec3 const center = 0.5f * (bounds.min + bounds.max);
+        f32 const radius = 0.5f * math::length(bounds.max - bounds.min);
+        Array<Ray> rays{reserve, count};
+        for(i64 i = 0; i < count; ++i) {
+            Vec3 const origin = center + radius * random_unit_vec3(random_engine);
+            Vec3 const target{random_f32(random_engine, bounds.min.x, bounds.max.x), random_f32(random_engine, bounds.min.y, bounds.max.y),
+                              random_f32(random_engine, bounds.min.z, bounds.max.z)};
+            rays.push_back(Ray{origin, math::normalize(target - origin)});
+        }
+        return rays;
+    }
+
+    i64 get_peak_memory_bytes() {
+#if defined(_WIN32)
+        PROCESS_MEMORY_COUNTERS counters;
+        if(!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+            return 0;
+        }
+        return static_cast<i64>(counters.PeakWorkingSetSize);
+#else
+        rusage usage;
+        if(getrusage(RUSAGE_SELF, &usage) != 0) {
+            return 0;
+        }
+    #if defined(__APPLE__)
+        return static_cast<i64>(usage.ru_maxrss);
+    #else
+        // Linux reports kibibytes.
+        return static_cast<i64>(usage.ru_maxrss) * 1024;
+    #endif
+#endif
+    }
+
+    struct Benchmark {
+        String_View name;
+        int (*run)(Slice<String_View const> arguments);
+    };
+
+    static int entry(Slice<String_View const> const arguments) {
+        Benchmark const benchmarks[] = {
+            {"traversal"_sv, run_traversal_benchmark},
+            {"acceleration"_sv, run_acceleration_benchmark},
+            {"kd_tree_build"_sv, run_kd_tree_build_benchmark},
+            {"mesh_loading"_sv, run_mesh_loading_benchmark},
+            {"triangle_kernels"_sv, run_triangle_kernels_benchmark},
+            {"packets"_sv, run_packets_benchmark},
+            {"integrators"_sv, run_integrators_benchmark},
+            {"adaptive"_sv, run_adaptive_benchmark},
+            {"random"_sv, run_random_benchmark},
+            {"samplers"_sv, run_samplers_benchmark},
+            {"scene_cache"_sv, run_scene_cache_benchmark},
+            {"image_output"_sv, run_image_output_benchmark},
+            {"triangle_storage"_sv, run_triangle_storage_benchmark},
+            {"instancing"_sv, run_instancing_benchmark},
+            {"next_event"_sv, run_next_event_benchmark},
+            {"suite"_sv, run_suite_benchmark},
+            {"compare"_sv, run_compare_benchmark},
+        };
+
+        Console_Output cout;
+        if(arguments.size() > 0) {
+            for(Benchmark const& benchmark: benchmarks) {
+                if(benchmark.name == arguments[0]) {
+                    return benchmark.run(Slice<String_View const>{arguments.data() + 1, arguments.size() - 1});
+                }
+            }
+        }
+
+        cout.write("usage: raytracing_benchmarks <benchmark> [arguments...]\nbenchmarks:\n"_sv);
+        for(Benchmark const& benchmark: benchmarks) {
+            cout.write(format("  {}\n"_sv, benchmark.name));
+        }
+        return -1;
+    }
+} // namespace raytracing
+
+int main(int argc, char** argv) {
+    using namespace raytracing;
+    Array<String_View> arguments;
+    for(int i = 1; i < argc; ++i) {
+        arguments.push_back(String_View{argv[i]});
+    }
+    return entry(arguments);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <anton/optional.hpp>
+#include <anton/slice.hpp>
+#include <build_config.hpp>
+#include <intersections.hpp>
+#include <scene.hpp>
+
+namespace raytracing {
+    enum struct Acceleration_Structure_Kind {
+        kd_tree,
+        bvh,
+    };
+
+    // Acceleration_Structure
+    // Common interface of the spatial indices over the primitives of a scene.
+    // The queries add the nodes they visit and the primitives they test to thread_traversal_cost.
+    //
+    struct Acceleration_Structure {
+        virtual ~Acceleration_Structure() = default;
+
+        // intersect
+        // Finds the closest intersection of the ray with the primitives of the scene
+        // the structure has been built for. Safe to call from multiple threads.
+        //
+        [[nodiscard]] virtual Optional<Surface_Interaction> intersect(Scene const& scene, Ray ray) const = 0;
+
+        // occluded
+        // Checks whether any primitive intersects the ray closer than max_distance. Returns on
+        // the first hit found without looking for the closest one or computing its surface,
+        // hence it is cheaper than intersect. Used for the shadow rays. Safe to call from multiple threads.
+        //
+        [[nodiscard]] virtual bool occluded(Scene const& scene, Ray ray, f32 max_distance) const = 0;
+
+        // intersect_packet
+        // Finds the closest intersections of a group of coherent rays, e.g. camera rays
+        // through the same pixel. The default implementation intersects the rays one by one.
+        //
+        // Parameters:
+        //   scene - the scene the structure has been built for.
+        //    rays - the rays to intersect.
+        // results - receives the closest intersection of each ray. Must be the same size as rays.
+        //
+        virtual void intersect_packet(Scene const& scene, Slice<Ray const> const rays, Slice<Optional<Surface_Interaction>> const results) const {
+            for(i64 i = 0; i < rays.size(); ++i) {
+                results[i] = intersect(scene, rays[i]);
+            }
+        }
+
+        // size_bytes
+        //
+        // Returns:
+        // Memory retained by the structure after the build in bytes.
+        //
+        [[nodiscard]] virtual i64 size_bytes() const = 0;
+    };
+} // namespace raytracing
@@ -2,13 +2,14 @@
 
 #include <anton/math/mat3.hpp>
 #include <anton/math/primitives.hpp>
+#include <anton/math/vec2.hpp>
 #include <anton/math/vec3.hpp>
 #include <anton/types.hpp>
 
 namespace anton {}
 
 namespace raytracing {
-    // using Vec2 = anton::math::Vec2;
+    using Vec2 = anton::math::Vec2;
     using Vec3 = anton::math::Vec3;
     // using Vec4 = anton::math::Vec4;
     // using Mat2 = anton::math::Mat2;
@@ -0,0 +1,361 @@
+#include <bvh.hpp>
+
+#include <anton/algorithm.hpp>
+#include <anton/algorithm/sort.hpp>
+#include <anton/assert.hpp>
+#include <anton/math/math.hpp>
+#include <counters.hpp>
+
+namespace raytracing {
+    // The largest number of primitives a leaf can reference.
+    static constexpr i64 max_leaf_primitives = 65535;
+    // The largest supported number of bins.
+    static constexpr i64 max_bins = 64;
+
+    [[nodiscard]] static Extent3 create_empty_extent() {
+        return {Vec3{math::infinity}, Vec3{-math::infinity}};
+    }
+
+    [[nodiscard]] static f32 calculate_surface_area(Extent3 const& extent) {
+        Vec3 const diagonal = extent.max - extent.min;
+        return 2.0f * (diagonal.x * diagonal.y + diagonal.x * diagonal.z + diagonal.y * diagonal.z);
+    }
+
+    // get_median_split_depth
+    //
+    // Returns:
+    // The number of levels of splits in halves needed to reduce primitives
+    // to leaves of at most max_leaf_primitives primitives.
+    //
+    [[nodiscard]] static i32 get_median_split_depth(i64 const primitives) {
+        i32 depth = 0;
+        for(i64 count = primitives; count > max_leaf_primitives; count = (count + 1) / 2) {
+            depth += 1;
+        }
+        return depth;
+    }
+
+    struct Bin {
+        Extent3 bounds;
+        i64 primitives;
+    };
+
+    void BVH::construct_node(Construct_Parameters const& p) {
+        i64 const node_index = nodes.size();
+        nodes.push_back(Node{});
+        i64 const primitives = p.end - p.begin;
+        Extent3 bounds = create_empty_extent();
+        Extent3 centroid_bounds = create_empty_extent();
+        for(i64 i = p.begin; i < p.end; ++i) {
+            Build_Primitive const& primitive = p.primitives[primitive_indices[i]];
+            bounds = math::outer_extent(bounds, primitive.bounds);
+            centroid_bounds.min = math::min(centroid_bounds.min, primitive.centroid);
+            centroid_bounds.max = math::max(centroid_bounds.max, primitive.centroid);
+        }
+
+        nodes[node_index].bounds = bounds;
+        if(primitives == 1 || p.depth == 0) {
+            ANTON_ASSERT(primitives <= max_leaf_primitives, "too many primitives in a BVH leaf");
+            nodes[node_index].offset = p.begin;
+            nodes[node_index].primitives = primitives;
+            return;
+        }
+
+        i64 middle = p.begin;
+        i32 split_axis = 0;
+        if(p.depth <= get_median_split_depth(primitives)) {
+            // The remaining depth only suffices to split the primitives in halves along the longest
+            // axis of the centroids. A split by the SAH could leave more primitives at the depth limit
+            // than a leaf can reference. The root starts deep enough for any number of primitives
+            // and every half needs one level less, hence the leaves at the depth limit always fit.
+            Vec3 const extent = centroid_bounds.max - centroid_bounds.min;
+            split_axis = (extent.x >= extent.y ? (extent.x >= extent.z ? 0 : 2) : (extent.y >= extent.z ? 1 : 2));
+            Slice<Build_Primitive const> const build_primitives = p.primitives;
+            quick_sort(primitive_indices.data() + p.begin, primitive_indices.data() + p.end, [build_primitives, split_axis](i64 const lhs, i64 const rhs) {
+                return build_primitives[lhs].centroid[split_axis] < build_primitives[rhs].centroid[split_axis];
+            });
+            middle = p.begin + primitives / 2;
+        } else {
+            // Find the cheapest split between the bins of all axes.
+            f32 best_cost = math::infinity;
+            i32 best_axis = -1;
+            i64 best_bin = -1;
+            f32 const inv_area = 1.0f / calculate_surface_area(bounds);
+            for(i32 axis = 0; axis < 3; ++axis) {
+                f32 const centroid_extent = centroid_bounds.max[axis] - centroid_bounds.min[axis];
+                if(centroid_extent <= 0.0f) {
+                    continue;
+                }
+
+                Bin bins[max_bins];
+                for(i64 i = 0; i < p.bins; ++i) {
+                    bins[i] = Bin{create_empty_extent(), 0};
+                }
+
+                f32 const scale = p.bins / centroid_extent;
+                for(i64 i = p.begin; i < p.end; ++i) {
+                    Build_Primitive const& primitive = p.primitives[primitive_indices[i]];
+                    i64 const bin = math::min(static_cast<i64>((primitive.centroid[axis] - centroid_bounds.min[axis]) * scale), p.bins - 1);
+                    bins[bin].bounds = math::outer_extent(bins[bin].bounds, primitive.bounds);
+                    bins[bin].primitives += 1;
+                }
+
+                // Sweep from the right to compute the areas and counts above every split.
+                f32 above_area[max_bins];
+                i64 above_primitives[max_bins];
+                Extent3 above_bounds = create_empty_extent();
+                i64 above = 0;
+                for(i64 i = p.bins - 1; i > 0; --i) {
+                    above_bounds = math::outer_extent(above_bounds, bins[i].bounds);
+                    above += bins[i].primitives;
+                    above_area[i] = (above > 0 ? calculate_surface_area(above_bounds) : 0.0f);
+                    above_primitives[i] = above;
+                }
+
+                // Sweep from the left evaluating the split after every bin.
+                Extent3 below_bounds = create_empty_extent();
+                i64 below = 0;
+                for(i64 i = 0; i < p.bins - 1; ++i) {
+                    below_bounds = math::outer_extent(below_bounds, bins[i].bounds);
+                    below += bins[i].primitives;
+                    if(below == 0 || above_primitives[i + 1] == 0) {
+                        continue;
+                    }
+
+                    f32 const below_area = calculate_surface_area(below_bounds);
+                    f32 const cost = p.traverse_cost + p.intersect_cost * (below_area * below + above_area[i + 1] * above_primitives[i + 1]) * inv_area;
+                    if(cost < best_cost) {
+                        best_cost = cost;
+                        best_axis = axis;
+                        best_bin = i;
+                    }
+                }
+            }
+
+            f32 const leaf_cost = p.intersect_cost * primitives;
+            if(primitives <= p.max_primitives && (best_axis == -1 || leaf_cost <= best_cost)) {
+                nodes[node_index].offset = p.begin;
+                nodes[node_index].primitives = primitives;
+                return;
+            }
+
+            if(best_axis != -1) {
+                // Partition the primitives so that those in the bins below the split come first.
+                f32 const scale = p.bins / (centroid_bounds.max[best_axis] - centroid_bounds.min[best_axis]);
+                i64 last = p.end;
+                while(middle < last) {
+                    Build_Primitive const& primitive = p.primitives[primitive_indices[middle]];
+                    i64 const bin = math::min(static_cast<i64>((primitive.centroid[best_axis] - centroid_bounds.min[best_axis]) * scale), p.bins - 1);
+                    if(bin <= best_bin) {
+                        middle += 1;
+                    } else {
+                        last -= 1;
+                        i64 const index = primitive_indices[middle];
+                        primitive_indices[middle] = primitive_indices[last];
+                        primitive_indices[last] = index;
+                    }
+                }
+            } else {
+                // All centroids coincide and there are too many primitives for a single leaf.
+                // Split the primitives in half.
+                middle = p.begin + primitives / 2;
+            }
+
+            split_axis = (best_axis != -1 ? best_axis : 0);
+        }
+
+        Construct_Parameters p0 = p;
+        p0.end = middle;
+        p0.depth -= 1;
+        construct_node(p0);
+        nodes[node_index].offset = nodes.size();
+        nodes[node_index].primitives = 0;
+        nodes[node_index].axis = split_axis;
+        Construct_Parameters p1 = p;
+        p1.begin = middle;
+        p1.depth -= 1;
+        construct_node(p1);
+    }
+
+    void BVH::build(Scene const& scene, Build_Options const& options) {
+        RT_SCOPED_TIMER(build);
+        ANTON_ASSERT(options.bins > 1 && options.bins <= max_bins, "the number of bins must be in range [2, 64]");
+        ANTON_ASSERT(options.max_primitives <= max_leaf_primitives, "max_primitives must not exceed 65535");
+        triangle_count = scene.triangles.size();
+        i64 const primitives = triangle_count + scene.spheres.size();
+        triangles.clear();
+        triangles.ensure_capacity(triangle_count);
+        Array<Build_Primitive> build_primitives{reserve, primitives};
+        for(i64 i = 0; i < triangle_count; ++i) {
+            Triangle const triangle = get_triangle(scene, i);
+            triangles.push_back(precompute_triangle(triangle));
+            Extent3 const bounds{math::min(math::min(triangle.v1, triangle.v2), triangle.v3), math::max(math::max(triangle.v1, triangle.v2), triangle.v3)};
+            build_primitives.push_back(Build_Primitive{bounds, 0.5f * (bounds.min + bounds.max)});
+        }
+
+        for(Sphere const& sphere: scene.spheres) {
+            Extent3 const bounds{sphere.position - Vec3{sphere.radius}, sphere.position + Vec3{sphere.radius}};
+            build_primitives.push_back(Build_Primitive{bounds, sphere.position});
+        }
+
+        nodes.clear();
+        primitive_indices.clear();
+        if(primitives == 0) {
+            return;
+        }
+
+        primitive_indices.ensure_capacity(primitives);
+        primitive_indices.force_size(primitives);
+        fill_with_consecutive(primitive_indices.begin(), primitive_indices.end(), 0);
+        // A tree over n primitives with at least 1 primitive in every leaf has at most 2n - 1 nodes.
+        nodes.ensure_capacity(2 * primitives - 1);
+        Construct_Parameters parameters;
+        parameters.primitives = build_primitives;
+        parameters.begin = 0;
+        parameters.end = primitives;
+        parameters.intersect_cost = options.intersect_cost;
+        parameters.traverse_cost = options.traverse_cost;
+        parameters.max_primitives = options.max_primitives;
+        parameters.bins = options.bins;
+        parameters.depth = max_supported_depth - 1;
+        construct_node(parameters);
+    }
+
+    // intersect_bounds
+    // Slab test of the ray against extent limited to the parametric range [0, max_distance].
+    //
+    [[nodiscard]] static bool intersect_bounds(Extent3 const& extent, Vec3 const ray_origin, Vec3 const inv_ray_direction, f32 const max_distance) {
+        f32 tmin = 0.0f;
+        f32 tmax = max_distance;
+        for(i32 i = 0; i < 3; ++i) {
+            f32 const t1 = (extent.min[i] - ray_origin[i]) * inv_ray_direction[i];
+            f32 const t2 = (extent.max[i] - ray_origin[i]) * inv_ray_direction[i];
+            tmin = math::max(tmin, math::min(t1, t2));
+            tmax = math::min(tmax, math::max(t1, t2));
+        }
+        return tmin <= tmax;
+    }
+
+    Optional<Surface_Interaction> BVH::intersect(Scene const& scene, Ray const ray) const {
+        if(nodes.size() == 0) {
+            return null_optional;
+        }
+
+        Vec3 const inv_ray_direction = Vec3{1.0f} / ray.direction;
+        bool hit = false;
+        Surface_Interaction result;
+        Traversal_Cost cost{0, 0};
+        // The stack holds at most one node per level of the tree.
+        i64 node_stack[max_supported_depth];
+        i64 stack_size = 0;
+        i64 node_index = 0;
+        while(true) {
+            Node const& node = nodes[node_index];
+            cost.nodes += 1;
+            if(intersect_bounds(node.bounds, ray.origin, inv_ray_direction, result.distance)) {
+                if(node.primitives == 0) {
+                    // Visit the child closer to the ray origin first.
+                    if(ray.direction[node.axis] < 0.0f) {
+                        node_stack[stack_size++] = node_index + 1;
+                        node_index = node.offset;
+                    } else {
+                        node_stack[stack_size++] = node.offset;
+                        node_index = node_index + 1;
+                    }
+                    continue;
+                }
+
+                cost.primitives += node.primitives;
+                i64 const* const indices = primitive_indices.data() + node.offset;
+                for(i64 i = 0; i < node.primitives; ++i) {
+                    i64 const index = indices[i];
+                    Optional<Surface_Interaction> intersection_result = null_optional;
+                    if(index < triangle_count) {
+                        intersection_result = intersect_triangle(ray, triangles[index]);
+                    } else {
+                        intersection_result = intersect_sphere(ray, scene.spheres[index - triangle_count]);
+                    }
+
+                    if(intersection_result && intersection_result->distance < result.distance) {
+                        result = intersection_result.value();
+                        hit = true;
+                    }
+                }
+            }
+
+            if(stack_size == 0) {
+                break;
+            }
+
+            stack_size -= 1;
+            node_index = node_stack[stack_size];
+        }
+
+        thread_traversal_cost.nodes += cost.nodes;
+        thread_traversal_cost.primitives += cost.primitives;
+        if(hit) {
+            return result;
+        } else {
+            return null_optional;
+        }
+    }
+
+    bool BVH::occluded(Scene const& scene, Ray const ray, f32 const max_distance) const {
+        if(nodes.size() == 0) {
+            return false;
+        }
+
+        Vec3 const inv_ray_direction = Vec3{1.0f} / ray.direction;
+        Traversal_Cost cost{0, 0};
+        i64 node_stack[max_supported_depth];
+        i64 stack_size = 0;
+        i64 node_index = 0;
+        while(true) {
+            Node const& node = nodes[node_index];
+            cost.nodes += 1;
+            if(intersect_bounds(node.bounds, ray.origin, inv_ray_direction, max_distance)) {
+                if(node.primitives == 0) {
+                    if(ray.direction[node.axis] < 0.0f) {
+                        node_stack[stack_size++] = node_index + 1;
+                        node_index = node.offset;
+                    } else {
+                        node_stack[stack_size++] = node.offset;
+                        node_index = node_index + 1;
+                    }
+                    continue;
+                }
+
+                cost.primitives += node.primitives;
+                i64 const* const indices = primitive_indices.data() + node.offset;
+                for(i64 i = 0; i < node.primitives; ++i) {
+                    i64 const index = indices[i];
+                    Optional<f32> distance = null_optional;
+                    if(index < triangle_count) {
+                        distance = intersect_triangle_distance(ray, triangles[index]);
+                    } else {
+                        distance = intersect_sphere_distance(ray, scene.spheres[index - triangle_count]);
+                    }
+
+                    if(distance && distance.value() < max_distance) {
+                        thread_traversal_cost.nodes += cost.nodes;
+                        thread_traversal_cost.primitives += cost.primitives;
+                        return true;
+                    }
+                }
+            }
+
+            if(stack_size == 0) {
+                thread_traversal_cost.nodes += cost.nodes;
+                thread_traversal_cost.primitives += cost.primitives;
+                return false;
+            }
+
+            stack_size -= 1;
+            node_index = node_stack[stack_size];
+        }
+    }
+
+    i64 BVH::size_bytes() const {
+        return nodes.size() * sizeof(Node) + primitive_indices.size() * sizeof(i64) + triangles.size() * sizeof(Triangle_Data);
+    }
+} // namespace raytracing
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <acceleration_structure.hpp>
+#include <anton/array.hpp>
+#include <anton/optional.hpp>
+#include <build_config.hpp>
+#include <intersections.hpp>
+#include <scene.hpp>
+
+namespace raytracing {
+    // BVH
+    // Bounding volume hierarchy built with the binned surface area heuristic.
+    // The nodes are stored in depth-first order, i.e. the first child of
+    // a node immediately follows it in the nodes array.
+    //
+    struct BVH: Acceleration_Structure {
+    private:
+        struct Node {
+            Extent3 bounds;
+            // Index of the first primitive in primitive_indices if the node is a leaf,
+            // index of the second child otherwise.
+            u32 offset;
+            // Number of primitives in a leaf. 0 if the node is an interior node.
+            u16 primitives;
+            // Axis along which the children of an interior node have been split.
+            u16 axis;
+        };
+
+        Array<Node> nodes;
+        // Indices of the primitives referenced by the leaves. The primitives are
+        // indexed with the triangles of the scene first followed by the spheres.
+        Array<i64> primitive_indices;
+        // Intersection data of the triangles of the scene indexed by primitive index.
+        // The leaves read the triangles from here instead of the scene.
+        Array<Triangle_Data> triangles;
+        i64 triangle_count = 0;
+
+        struct Build_Primitive {
+            Extent3 bounds;
+            Vec3 centroid;
+        };
+
+        struct Construct_Parameters {
+            // Bounds and centroids of all primitives in the scene.
+            Slice<Build_Primitive const> primitives;
+            // Range of primitive_indices referencing the primitives of the node.
+            i64 begin = 0;
+            i64 end = 0;
+            i64 intersect_cost = 0;
+            i64 traverse_cost = 0;
+            // Max primitives in a leaf.
+            i64 max_primitives = 0;
+            i64 bins = 0;
+            i32 depth = 0;
+        };
+
+        void construct_node(Construct_Parameters const& parameters);
+
+    public:
+        // The maximum depth of a tree. Bounds the size of the traversal stack.
+        static constexpr i64 max_supported_depth = 64;
+
+        struct Build_Options {
+            // Maximum number of primitives in a leaf.
+            i64 max_primitives = 8;
+            // Number of bins the centroid bounds are split into along each axis.
+            i64 bins = 16;
+            // The cost to intersect a primitive.
+            i64 intersect_cost = 4;
+            // The cost to traverse the interior node.
+            i64 traverse_cost = 1;
+        };
+
+        void build(Scene const& scene, Build_Options const& options);
+
+        [[nodiscard]] Optional<Surface_Interaction> intersect(Scene const& scene, Ray ray) const override;
+        [[nodiscard]] bool occluded(Scene const& scene, Ray ray, f32 max_distance) const override;
+        [[nodiscard]] i64 size_bytes() const override;
+    };
+} // namespace raytracing
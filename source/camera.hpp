@@ -15,6 +15,11 @@ namespace raytracing {
         i64 image_width;
         // Height of the generated image in pixels.
         i64 image_height;
+        // Diameter of the lens. A camera with no aperture is a pinhole camera
+        // with everything in focus.
+        f32 aperture = 0.0f;
+        // Distance along the view direction of the plane in focus.
+        f32 focus_distance = 1.0f;
 
         Camera(Vec3 position, f32 vfov, f32 aspect_ratio, i64 image_height);
     };
@@ -0,0 +1,148 @@
+#include <counters.hpp>
+
+#include <anton/console.hpp>
+#include <anton/filesystem.hpp>
+#include <anton/format.hpp>
+#include <anton/string.hpp>
+
+#include <mutex>
+
+namespace raytracing {
+#if RT_COUNTERS
+    thread_local Counters thread_counters;
+#endif
+    thread_local Traversal_Cost thread_traversal_cost;
+
+    // Counters merged from the threads. Protected by merged_mutex.
+    static Counters merged_counters;
+    static std::mutex merged_mutex;
+
+    static void add_counters(Counters& destination, Counters const& source) {
+        for(i64 i = 0; i < counter_count; ++i) {
+            destination.counters[i] += source.counters[i];
+        }
+
+        for(i64 i = 0; i < max_counted_bounces; ++i) {
+            destination.rays[i] += source.rays[i];
+        }
+
+        for(i64 i = 0; i < timer_count; ++i) {
+            destination.timers[i] += source.timers[i];
+        }
+    }
+
+    void merge_thread_counters() {
+#if RT_COUNTERS
+        std::lock_guard<std::mutex> lock{merged_mutex};
+        add_counters(merged_counters, thread_counters);
+        thread_counters = Counters{};
+#endif
+    }
+
+    Counters get_counters() {
+        Counters counters{};
+        {
+            std::lock_guard<std::mutex> lock{merged_mutex};
+            counters = merged_counters;
+        }
+#if RT_COUNTERS
+        add_counters(counters, thread_counters);
+#endif
+        return counters;
+    }
+
+    void reset_counters() {
+        std::lock_guard<std::mutex> lock{merged_mutex};
+        merged_counters = Counters{};
+#if RT_COUNTERS
+        thread_counters = Counters{};
+#endif
+    }
+
+#if RT_COUNTERS
+    Scoped_Timer::Scoped_Timer(Timer const timer): start(std::chrono::steady_clock::now()), timer(timer) {}
+
+    Scoped_Timer::~Scoped_Timer() {
+        auto const duration = std::chrono::steady_clock::now() - start;
+        thread_counters.timers[static_cast<i64>(timer)] += std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+    }
+#endif
+
+    // Names of the counters in the order of Counter.
+    static String_View const counter_names[counter_count] = {
+        "intersection_hits"_sv, "kd_tree_nodes"_sv, "kd_tree_primitives"_sv, "scatter_lambertian"_sv, "scatter_metallic"_sv, "scatter_transmissive"_sv,
+    };
+
+    // Names of the timers in the order of Timer.
+    static String_View const timer_names[timer_count] = {"import"_sv, "build"_sv, "render"_sv, "write"_sv};
+
+    [[nodiscard]] static i64 get_total_rays(Counters const& counters) {
+        i64 rays = 0;
+        for(i64 const r: counters.rays) {
+            rays += r;
+        }
+        return rays;
+    }
+
+    // format_ratio
+    // Formats numerator / denominator with one decimal place.
+    //
+    [[nodiscard]] static String format_ratio(i64 const numerator, i64 const denominator) {
+        if(denominator == 0) {
+            return String{"-"_sv};
+        }
+
+        i64 const tenths = (10 * numerator + denominator / 2) / denominator;
+        return format("{}.{}"_sv, tenths / 10, tenths % 10);
+    }
+
+    void print_counters(Counters const& counters) {
+        Console_Output cout;
+        i64 const rays = get_total_rays(counters);
+        cout.write("counters:\n"_sv);
+        for(i64 bounce = 0; bounce < max_counted_bounces; ++bounce) {
+            if(counters.rays[bounce] > 0) {
+                cout.write(format("  rays at bounce {}: {}\n"_sv, bounce, counters.rays[bounce]));
+            }
+        }
+
+        i64 const hits = counters.counters[static_cast<i64>(Counter::intersection_hits)];
+        i64 const nodes = counters.counters[static_cast<i64>(Counter::kd_tree_nodes)];
+        i64 const primitives = counters.counters[static_cast<i64>(Counter::kd_tree_primitives)];
+        cout.write(format("  rays: {}, hits: {} ({}%)\n"_sv, rays, hits, format_ratio(100 * hits, rays)));
+        cout.write(format("  kd-tree nodes visited: {} ({} per ray)\n"_sv, nodes, format_ratio(nodes, rays)));
+        cout.write(format("  kd-tree primitives tested: {} ({} per ray)\n"_sv, primitives, format_ratio(primitives, rays)));
+        for(i64 i = static_cast<i64>(Counter::scatter_lambertian); i < counter_count; ++i) {
+            cout.write(format("  {}: {}\n"_sv, counter_names[i], counters.counters[i]));
+        }
+
+        for(i64 i = 0; i < timer_count; ++i) {
+            cout.write(format("  {} time: {} ms\n"_sv, timer_names[i], counters.timers[i] / 1000000));
+        }
+    }
+
+    bool write_counters_json(String_View const path, Counters const& counters) {
+        fs::Output_File_Stream stream(String{path});
+        if(!stream) {
+            return false;
+        }
+
+        // The braces of the objects are written separately since they delimit the replacement fields of format.
+        stream.write("{\n  \"rays\": ["_sv);
+        for(i64 bounce = 0; bounce < max_counted_bounces; ++bounce) {
+            stream.write(format(bounce > 0 ? ", {}"_sv : "{}"_sv, counters.rays[bounce]));
+        }
+        stream.write("],\n"_sv);
+
+        for(i64 i = 0; i < counter_count; ++i) {
+            stream.write(format("  \"{}\": {},\n"_sv, counter_names[i], counters.counters[i]));
+        }
+
+        stream.write("  \"timers_ns\": {"_sv);
+        for(i64 i = 0; i < timer_count; ++i) {
+            stream.write(format(i > 0 ? ", \"{}\": {}"_sv : "\"{}\": {}"_sv, timer_names[i], counters.timers[i]));
+        }
+        stream.write("}\n}\n"_sv);
+        return true;
+    }
+} // namespace raytracing
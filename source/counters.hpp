@@ -0,0 +1,131 @@
+#pragma once
+
+#include <anton/string_view.hpp>
+#include <build_config.hpp>
+
+#include <chrono>
+
+// RT_COUNTERS enables the performance counters. It is set by the RT_COUNTERS option of
+// the build and is off by default, in which case the RT_COUNT macros expand to nothing
+// and the renderer contains no trace of the counters.
+#ifndef RT_COUNTERS
+    #define RT_COUNTERS 0
+#endif
+
+namespace raytracing {
+    enum struct Counter : i64 {
+        // Closest-hit rays cast by the renderer that hit a surface.
+        intersection_hits,
+        // Nodes of a KD_Tree visited by the traversal. A node visited by a packet of rays is counted once.
+        kd_tree_nodes,
+        // Primitives referenced by the visited leaves of a KD_Tree, counted once per ray.
+        kd_tree_primitives,
+        scatter_lambertian,
+        scatter_metallic,
+        scatter_transmissive,
+    };
+
+    constexpr i64 counter_count = 6;
+
+    enum struct Timer : i64 {
+        import,
+        build,
+        render,
+        write,
+    };
+
+    constexpr i64 timer_count = 4;
+
+    // Rays cast at greater depths are counted with the deepest bounce.
+    constexpr i64 max_counted_bounces = 16;
+
+    struct Counters {
+        i64 counters[counter_count];
+        // Closest-hit rays cast by the renderer at every depth of the paths.
+        i64 rays[max_counted_bounces];
+        // Time accumulated by the scoped timers in nanoseconds. Timers running on
+        // several threads at once add up the time of every thread.
+        i64 timers[timer_count];
+    };
+
+#if RT_COUNTERS
+    // The counters of the calling thread. They are zero-initialized and trivial,
+    // hence incrementing them costs no more than incrementing a global.
+    extern thread_local Counters thread_counters;
+#endif
+
+    // Traversal_Cost
+    // Work done by the traversals of the acceleration structures. Unlike the counters, it is always
+    // counted, so that the renderer can attribute the cost of the traversals to the pixels.
+    // The traversals count into local variables and add them once per ray.
+    //
+    struct Traversal_Cost {
+        // Nodes visited. A node visited by a packet of rays is counted once.
+        i64 nodes;
+        // Primitives referenced by the visited leaves, counted once per ray.
+        i64 primitives;
+    };
+
+    // The cost of the traversals of the calling thread. Never reset, readers take differences.
+    extern thread_local Traversal_Cost thread_traversal_cost;
+
+    // merge_thread_counters
+    // Adds the counters of the calling thread to the totals and resets them.
+    // Every thread that counts must call it before it exits. The workers of
+    // execute_tasks call it at the end of every call.
+    //
+    void merge_thread_counters();
+
+    // get_counters
+    //
+    // Returns:
+    // The merged counters of all threads and the counters of the calling thread.
+    //
+    [[nodiscard]] Counters get_counters();
+
+    // reset_counters
+    // Resets the merged counters and the counters of the calling thread.
+    //
+    void reset_counters();
+
+    // print_counters
+    // Writes a summary table of the counters to the console.
+    //
+    void print_counters(Counters const& counters);
+
+    // write_counters_json
+    //
+    // Returns:
+    // false if the file could not be opened.
+    //
+    [[nodiscard]] bool write_counters_json(String_View path, Counters const& counters);
+
+#if RT_COUNTERS
+    // Scoped_Timer
+    // Adds the time between its construction and destruction to a timer of the calling thread.
+    //
+    struct Scoped_Timer {
+    private:
+        std::chrono::steady_clock::time_point start;
+        Timer timer;
+
+    public:
+        explicit Scoped_Timer(Timer timer);
+        Scoped_Timer(Scoped_Timer const&) = delete;
+        Scoped_Timer& operator=(Scoped_Timer const&) = delete;
+        ~Scoped_Timer();
+    };
+#endif
+} // namespace raytracing
+
+#if RT_COUNTERS
+    #define RT_COUNT(counter, value) (::raytracing::thread_counters.counters[static_cast<::raytracing::i64>(::raytracing::Counter::counter)] += (value))
+    #define RT_COUNT_RAYS(bounce, value)                                                                                                        \
+        (::raytracing::thread_counters.rays[(bounce) < ::raytracing::max_counted_bounces ? (bounce) : ::raytracing::max_counted_bounces - 1] += \
+         (value))
+    #define RT_SCOPED_TIMER(timer) ::raytracing::Scoped_Timer const rt_scoped_timer_##timer{::raytracing::Timer::timer}
+#else
+    #define RT_COUNT(counter, value) ((void)0)
+    #define RT_COUNT_RAYS(bounce, value) ((void)0)
+    #define RT_SCOPED_TIMER(timer) ((void)0)
+#endif
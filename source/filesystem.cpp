@@ -1,7 +1,23 @@
 #include <filesystem.hpp>
 
+#include <anton/assert.hpp>
 #include <anton/filesystem.hpp>
 #include <anton/format.hpp>
+#include <anton/math/math.hpp>
+#include <counters.hpp>
+
+#include <cstring>
+
+#if defined(_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
 
 namespace raytracing {
     Expected<Array<u8>, String> read_file(String_View const path) {
@@ -20,15 +36,202 @@ namespace raytracing {
         return {expected_value, ANTON_MOV(result)};
     }
 
-    void write_ppm_file(Output_Stream& stream, Slice<Vec3 const> const pixels, i64 const width, i64 const height) {
-        String header = format("P3\n{} {}\n255\n"_sv, width, height);
-        stream.write(header);
-        for(Vec3 const pixel: pixels) {
-            i64 const r = static_cast<i64>(255.999f * pixel.r);
-            i64 const g = static_cast<i64>(255.999f * pixel.g);
-            i64 const b = static_cast<i64>(255.999f * pixel.b);
-            String value = format("{} {} {}\n"_sv, r, g, b);
-            stream.write(value);
+    Mapped_File::~Mapped_File() {
+        close();
+    }
+
+#if defined(_WIN32)
+    i64 get_file_size(String_View const path) {
+        String const path_str{path};
+        WIN32_FILE_ATTRIBUTE_DATA attributes;
+        if(!GetFileAttributesExA(path_str.data(), GetFileExInfoStandard, &attributes)) {
+            return -1;
+        }
+        return (static_cast<i64>(attributes.nFileSizeHigh) << 32) | static_cast<i64>(attributes.nFileSizeLow);
+    }
+
+    bool Mapped_File::open(String_View const path) {
+        close();
+        String const path_str{path};
+        HANDLE const file = CreateFileA(path_str.data(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if(file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+
+        LARGE_INTEGER file_size;
+        if(!GetFileSizeEx(file, &file_size)) {
+            CloseHandle(file);
+            return false;
+        }
+
+        // Mapping an empty file fails, but an empty file is valid.
+        if(file_size.QuadPart == 0) {
+            CloseHandle(file);
+            return true;
+        }
+
+        // The view keeps the mapping and the file open, hence the handles may be closed right away.
+        HANDLE const file_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+        if(file_mapping == nullptr) {
+            return false;
+        }
+
+        void* const view = MapViewOfFile(file_mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(file_mapping);
+        if(view == nullptr) {
+            return false;
+        }
+
+        mapping = static_cast<u8 const*>(view);
+        size = file_size.QuadPart;
+        return true;
+    }
+
+    void Mapped_File::close() {
+        if(mapping != nullptr) {
+            UnmapViewOfFile(mapping);
+        }
+        mapping = nullptr;
+        size = 0;
+    }
+#else
+    i64 get_file_size(String_View const path) {
+        String const path_str{path};
+        struct stat file_stat;
+        if(stat(path_str.data(), &file_stat) == -1) {
+            return -1;
+        }
+        return file_stat.st_size;
+    }
+
+    bool Mapped_File::open(String_View const path) {
+        close();
+        String const path_str{path};
+        int const file = ::open(path_str.data(), O_RDONLY);
+        if(file == -1) {
+            return false;
+        }
+
+        struct stat file_stat;
+        if(fstat(file, &file_stat) == -1) {
+            ::close(file);
+            return false;
+        }
+
+        // Mapping an empty file fails, but an empty file is valid.
+        if(file_stat.st_size == 0) {
+            ::close(file);
+            return true;
         }
+
+        // The mapping keeps the file open, hence the descriptor may be closed right away.
+        void* const view = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+        ::close(file);
+        if(view == MAP_FAILED) {
+            return false;
+        }
+
+        // The file is read front to back in a few large chunks. Ask for aggressive read-ahead.
+        madvise(view, file_stat.st_size, MADV_SEQUENTIAL);
+        mapping = static_cast<u8 const*>(view);
+        size = file_stat.st_size;
+        return true;
+    }
+
+    void Mapped_File::close() {
+        if(mapping != nullptr) {
+            munmap(const_cast<u8*>(mapping), size);
+        }
+        mapping = nullptr;
+        size = 0;
+    }
+#endif
+
+    Slice<u8 const> Mapped_File::data() const {
+        return Slice<u8 const>{mapping, size};
+    }
+
+    String format_image_header(Image_Format const image_format, i64 const width, i64 const height) {
+        switch(image_format) {
+            case Image_Format::ppm:
+                return format("P6\n{} {}\n255\n"_sv, width, height);
+            case Image_Format::pfm:
+                // The sign of the scale selects the byte order of the floats.
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+                return format("PF\n{} {}\n-1.0\n"_sv, width, height);
+#else
+                return format("PF\n{} {}\n1.0\n"_sv, width, height);
+#endif
+        }
+        return String{};
+    }
+
+    i64 get_image_pixel_size(Image_Format const image_format) {
+        switch(image_format) {
+            case Image_Format::ppm:
+                return 3;
+            case Image_Format::pfm:
+                return 3 * sizeof(f32);
+        }
+        return 0;
+    }
+
+    i64 get_image_row_offset(Image_Format const image_format, i64 const width, i64 const height, i64 const y) {
+        i64 const row_size = width * get_image_pixel_size(image_format);
+        switch(image_format) {
+            case Image_Format::ppm:
+                return y * row_size;
+            case Image_Format::pfm:
+                return (height - 1 - y) * row_size;
+        }
+        return 0;
+    }
+
+    void encode_image_pixels(Image_Format const image_format, Slice<Vec3 const> const pixels, Slice<u8> const encoded) {
+        ANTON_ASSERT(encoded.size() == pixels.size() * get_image_pixel_size(image_format), "encoded size does not match the number of pixels");
+        switch(image_format) {
+            case Image_Format::ppm: {
+                u8* output = encoded.data();
+                for(Vec3 const pixel: pixels) {
+                    output[0] = static_cast<u8>(255.999f * math::clamp(pixel.x, 0.0f, 1.0f));
+                    output[1] = static_cast<u8>(255.999f * math::clamp(pixel.y, 0.0f, 1.0f));
+                    output[2] = static_cast<u8>(255.999f * math::clamp(pixel.z, 0.0f, 1.0f));
+                    output += 3;
+                }
+            } break;
+
+            case Image_Format::pfm: {
+                f32 linear[3];
+                u8* output = encoded.data();
+                for(Vec3 const pixel: pixels) {
+                    linear[0] = pixel.x * pixel.x;
+                    linear[1] = pixel.y * pixel.y;
+                    linear[2] = pixel.z * pixel.z;
+                    memcpy(output, linear, sizeof(linear));
+                    output += sizeof(linear);
+                }
+            } break;
+        }
+    }
+
+    void write_image_file(Output_Stream& stream, Image_Format const image_format, Slice<Vec3 const> const pixels, i64 const width, i64 const height) {
+        RT_SCOPED_TIMER(write);
+        stream.write(format_image_header(image_format, width, height));
+        i64 const row_size = width * get_image_pixel_size(image_format);
+        Array<u8> encoded{height * row_size};
+        for(i64 y = 0; y < height; ++y) {
+            Slice<Vec3 const> const row{pixels.data() + y * width, width};
+            encode_image_pixels(image_format, row, Slice<u8>{encoded.data() + get_image_row_offset(image_format, width, height, y), row_size});
+        }
+        stream.write(encoded);
+    }
+
+    void write_ppm_file(Output_Stream& stream, Slice<Vec3 const> const pixels, i64 const width, i64 const height) {
+        write_image_file(stream, Image_Format::ppm, pixels, width, height);
+    }
+
+    void write_pfm_file(Output_Stream& stream, Slice<Vec3 const> const pixels, i64 const width, i64 const height) {
+        write_image_file(stream, Image_Format::pfm, pixels, width, height);
     }
 } // namespace raytracing
@@ -3,11 +3,102 @@
 #include <anton/array.hpp>
 #include <anton/expected.hpp>
 #include <anton/math/vec3.hpp>
+#include <anton/slice.hpp>
 #include <anton/stream.hpp>
 #include <anton/string.hpp>
 #include <build_config.hpp>
 
 namespace raytracing {
     Expected<Array<u8>, String> read_file(String_View path);
+
+    // get_file_size
+    //
+    // Returns:
+    // The size of the file at path in bytes or -1 if it does not exist.
+    //
+    [[nodiscard]] i64 get_file_size(String_View path);
+
+    // Mapped_File
+    // Read-only memory mapping of a whole file. The contents are paged in by the OS on first
+    // access instead of being copied into a buffer, hence they may be read from multiple threads
+    // without occupying any heap memory.
+    //
+    struct Mapped_File {
+    private:
+        u8 const* mapping = nullptr;
+        i64 size = 0;
+
+    public:
+        Mapped_File() = default;
+        Mapped_File(Mapped_File const&) = delete;
+        Mapped_File& operator=(Mapped_File const&) = delete;
+        ~Mapped_File();
+
+        // open
+        // Maps the file at path. Closes the previously mapped file.
+        //
+        // Returns:
+        // false if the file could not be opened or mapped.
+        //
+        [[nodiscard]] bool open(String_View path);
+
+        // close
+        // Unmaps the file. The slice returned by data() becomes invalid.
+        //
+        void close();
+
+        // data
+        //
+        // Returns:
+        // The contents of the file. Empty if no file is mapped.
+        //
+        [[nodiscard]] Slice<u8 const> data() const;
+    };
+
+    enum struct Image_Format {
+        // Binary 8-bit RGB portable pixmap (P6).
+        ppm,
+        // 32-bit floating point RGB portable float map. Stores linear values with the rows
+        // ordered from the bottom to the top of the image.
+        pfm,
+    };
+
+    // format_image_header
+    //
+    // Returns:
+    // The header preceding the pixels in a file of the format.
+    //
+    [[nodiscard]] String format_image_header(Image_Format image_format, i64 width, i64 height);
+
+    // get_image_pixel_size
+    //
+    // Returns:
+    // Size of an encoded pixel in bytes.
+    //
+    [[nodiscard]] i64 get_image_pixel_size(Image_Format image_format);
+
+    // get_image_row_offset
+    //
+    // Returns:
+    // Offset of the encoded row y from the end of the header in bytes.
+    //
+    [[nodiscard]] i64 get_image_row_offset(Image_Format image_format, i64 width, i64 height, i64 y);
+
+    // encode_image_pixels
+    // Converts the pixels to the encoding of the format. The pixels are expected in the
+    // gamma 2 encoding returned by render_scene. PPM clamps them to [0, 1], PFM squares them
+    // to store the linear values.
+    //
+    // Parameters:
+    //  pixels - the pixels to encode.
+    // encoded - receives the encoded pixels. Must be get_image_pixel_size(image_format) * pixels.size() bytes.
+    //
+    void encode_image_pixels(Image_Format image_format, Slice<Vec3 const> pixels, Slice<u8> encoded);
+
+    // write_image_file
+    // Encodes the whole image in a single buffer and writes it to the stream.
+    //
+    void write_image_file(Output_Stream& stream, Image_Format image_format, Slice<Vec3 const> pixels, i64 width, i64 height);
     void write_ppm_file(Output_Stream& stream, Slice<Vec3 const> pixels, i64 width, i64 height);
+    void write_pfm_file(Output_Stream& stream, Slice<Vec3 const> pixels, i64 width, i64 height);
 } // namespace raytracing
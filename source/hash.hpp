@@ -0,0 +1,21 @@
+#pragma once
+
+#include <build_config.hpp>
+
+namespace raytracing {
+    constexpr u64 hash_seed = 14695981039346656037ULL;
+
+    // hash_bytes
+    // 64-bit FNV-1a hash of size bytes starting at data. To hash data that is
+    // not contiguous, pass the hash of the preceding data as the seed.
+    //
+    [[nodiscard]] inline u64 hash_bytes(void const* const data, i64 const size, u64 const seed = hash_seed) {
+        u8 const* const bytes = static_cast<u8 const*>(data);
+        u64 hash = seed;
+        for(i64 i = 0; i < size; ++i) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+} // namespace raytracing
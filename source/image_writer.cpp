@@ -0,0 +1,127 @@
+#include <image_writer.hpp>
+
+#include <anton/string.hpp>
+#include <counters.hpp>
+
+namespace raytracing {
+    Image_File_Writer::~Image_File_Writer() {
+        finish();
+    }
+
+    bool Image_File_Writer::open(String_View const path, Image_Format const image_format, i64 const image_width, i64 const image_height) {
+        if(!stream.open(String{path})) {
+            return false;
+        }
+
+        file_path = String{path};
+        format = image_format;
+        width = image_width;
+        height = image_height;
+        String const header = format_image_header(format, width, height);
+        header_size = header.size_bytes();
+        stream.write(header);
+        pixels = Array<Vec3>(width * height);
+        row_pixels = Array<i64>(height, 0);
+        written_rows = 0;
+        write_failed = false;
+        finishing = false;
+        thread = std::thread([this]() { write_rows(); });
+        return true;
+    }
+
+    void Image_File_Writer::write_tile(Slice<Vec3 const> const image, Tile const tile) {
+        // The tiles do not overlap, hence the copies need no synchronisation.
+        // Publishing the rows under the mutex makes the copies visible to the background thread.
+        i64 const tile_width = tile.x_end - tile.x_begin;
+        for(i64 y = tile.y_begin; y < tile.y_end; ++y) {
+            Vec3 const* const source = image.data() + y * width + tile.x_begin;
+            Vec3* const destination = pixels.data() + y * width + tile.x_begin;
+            for(i64 x = 0; x < tile_width; ++x) {
+                destination[x] = source[x];
+            }
+        }
+
+        bool rows_completed = false;
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            for(i64 y = tile.y_begin; y < tile.y_end; ++y) {
+                row_pixels[y] += tile_width;
+                if(row_pixels[y] == width) {
+                    pending_rows.push_back(y);
+                    rows_completed = true;
+                }
+            }
+        }
+
+        if(rows_completed) {
+            condition.notify_one();
+        }
+    }
+
+    void Image_File_Writer::write_rows() {
+        i64 const row_size = width * get_image_pixel_size(format);
+        Array<u8> encoded(row_size);
+        Array<i64> rows;
+        while(true) {
+            bool done = false;
+            {
+                std::unique_lock<std::mutex> lock{mutex};
+                condition.wait(lock, [this]() { return finishing || pending_rows.size() > 0; });
+                // Swap the queues to release the mutex before doing any I/O.
+                Array<i64> received = ANTON_MOV(pending_rows);
+                pending_rows = ANTON_MOV(rows);
+                rows = ANTON_MOV(received);
+                done = finishing;
+            }
+
+            {
+                // The rows are written while the image is being rendered, hence the timer
+                // measures the work of this thread and not the time the render waits for it.
+                RT_SCOPED_TIMER(write);
+                for(i64 const y: rows) {
+                    if(write_failed) {
+                        break;
+                    }
+
+                    encode_image_pixels(format, Slice<Vec3 const>{pixels.data() + y * width, width}, encoded);
+                    i64 const offset = header_size + get_image_row_offset(format, width, height, y);
+                    stream.seek(Seek_Dir::beg, offset);
+                    stream.write(encoded);
+                    // The writes do not report errors. A failed write leaves the stream
+                    // in a failed state or short of the end of the row.
+                    if(!stream || stream.tell() != offset + row_size) {
+                        write_failed = true;
+                        break;
+                    }
+                    written_rows += 1;
+                }
+            }
+            rows.clear();
+
+            if(done) {
+                merge_thread_counters();
+                return;
+            }
+        }
+    }
+
+    bool Image_File_Writer::finish() {
+        if(!thread.joinable()) {
+            return !write_failed && written_rows == height;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            finishing = true;
+        }
+        condition.notify_one();
+        thread.join();
+        stream.close();
+        // The buffered writes may only fail when the file is closed, which leaves the file shorter than the image.
+        i64 const file_size = header_size + width * height * get_image_pixel_size(format);
+        if(!write_failed && written_rows == height && get_file_size(file_path) != file_size) {
+            write_failed = true;
+        }
+        return !write_failed && written_rows == height;
+    }
+} // namespace raytracing
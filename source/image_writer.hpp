@@ -0,0 +1,76 @@
+#pragma once
+
+#include <anton/array.hpp>
+#include <anton/filesystem.hpp>
+#include <anton/slice.hpp>
+#include <anton/string.hpp>
+#include <anton/string_view.hpp>
+#include <build_config.hpp>
+#include <filesystem.hpp>
+#include <renderer.hpp>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace raytracing {
+    // Image_File_Writer
+    // Streams the tiles of an image to a file while the image is being rendered. The render
+    // threads only copy the finished tiles. A background thread encodes and writes every row
+    // of the image as soon as all tiles covering the row have been received, hence writing
+    // the file overlaps with rendering. The background thread is woken only for complete rows.
+    //
+    struct Image_File_Writer: Tile_Output {
+    private:
+        fs::Output_File_Stream stream;
+        String file_path;
+        Image_Format format = Image_Format::ppm;
+        i64 width = 0;
+        i64 height = 0;
+        i64 header_size = 0;
+        // Copies of the pixels of the received tiles.
+        Array<Vec3> pixels;
+        // Number of pixels of each row received so far. Protected by mutex.
+        Array<i64> row_pixels;
+        // Rows received completely, but not yet written. Protected by mutex.
+        Array<i64> pending_rows;
+        bool finishing = false;
+        // Rows written successfully. Accessed by the background thread only until it is joined.
+        i64 written_rows = 0;
+        // Whether a write has failed. The rows received after the failure are not written.
+        // Accessed by the background thread only until it is joined.
+        bool write_failed = false;
+        std::mutex mutex;
+        std::condition_variable condition;
+        std::thread thread;
+
+        // write_rows
+        // Body of the background thread.
+        //
+        void write_rows();
+
+    public:
+        Image_File_Writer() = default;
+        Image_File_Writer(Image_File_Writer const&) = delete;
+        Image_File_Writer& operator=(Image_File_Writer const&) = delete;
+        ~Image_File_Writer() override;
+
+        // open
+        // Creates the file, writes the header and starts the background thread.
+        //
+        // Returns:
+        // false if the file could not be opened.
+        //
+        [[nodiscard]] bool open(String_View path, Image_Format format, i64 width, i64 height);
+
+        void write_tile(Slice<Vec3 const> pixels, Tile tile) override;
+
+        // finish
+        // Waits until the background thread has written all received rows and closes the file.
+        //
+        // Returns:
+        // true if every row of the image has been written and no write has failed.
+        //
+        bool finish();
+    };
+} // namespace raytracing
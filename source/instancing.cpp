@@ -0,0 +1,227 @@
+#include <instancing.hpp>
+
+#include <anton/algorithm/sort.hpp>
+#include <anton/assert.hpp>
+#include <anton/math/math.hpp>
+#include <counters.hpp>
+
+namespace raytracing {
+    // The largest number of instances a leaf can reference.
+    static constexpr i64 max_leaf_instances = 65535;
+
+    [[nodiscard]] static Extent3 create_empty_extent() {
+        return {Vec3{math::infinity}, Vec3{-math::infinity}};
+    }
+
+    void Instance_BVH::construct_node(Slice<Build_Instance> const build_instances, Slice<Instance const> const source_instances, i64 const max_instances,
+                                      i32 const depth) {
+        i64 const node_index = nodes.size();
+        nodes.push_back(Node{});
+        Extent3 bounds = create_empty_extent();
+        Extent3 centroid_bounds = create_empty_extent();
+        for(Build_Instance const& instance: build_instances) {
+            bounds = math::outer_extent(bounds, instance.bounds);
+            centroid_bounds.min = math::min(centroid_bounds.min, instance.centroid);
+            centroid_bounds.max = math::max(centroid_bounds.max, instance.centroid);
+        }
+
+        nodes[node_index].bounds = bounds;
+        if(build_instances.size() <= max_instances || depth == 0) {
+            ANTON_ASSERT(build_instances.size() <= max_leaf_instances, "too many instances in an Instance_BVH leaf");
+            nodes[node_index].offset = instances.size();
+            nodes[node_index].instances = build_instances.size();
+            for(Build_Instance const& instance: build_instances) {
+                Instance const& source = source_instances[instance.index];
+                instances.push_back(Instance_Data{invert(source.object_to_world), source.mesh});
+            }
+            return;
+        }
+
+        // The instances are few compared to the primitives of the meshes, hence
+        // a median split along the largest extent of the centroids is sufficient.
+        Vec3 const centroid_extent = centroid_bounds.max - centroid_bounds.min;
+        i32 axis = 2;
+        if(centroid_extent.x > centroid_extent.y && centroid_extent.x > centroid_extent.z) {
+            axis = 0;
+        } else if(centroid_extent.y > centroid_extent.z) {
+            axis = 1;
+        }
+
+        quick_sort(build_instances.data(), build_instances.data() + build_instances.size(), [axis](Build_Instance const& lhs, Build_Instance const& rhs) {
+            // Sort by the index second, so that the tree does not depend on the sort.
+            return lhs.centroid[axis] < rhs.centroid[axis] || (lhs.centroid[axis] == rhs.centroid[axis] && lhs.index < rhs.index);
+        });
+
+        i64 const middle = build_instances.size() / 2;
+        construct_node(Slice<Build_Instance>{build_instances.data(), middle}, source_instances, max_instances, depth - 1);
+        nodes[node_index].offset = nodes.size();
+        nodes[node_index].instances = 0;
+        nodes[node_index].axis = axis;
+        construct_node(Slice<Build_Instance>{build_instances.data() + middle, build_instances.size() - middle}, source_instances, max_instances,
+                       depth - 1);
+    }
+
+    void Instance_BVH::build(Slice<Mesh const> const _meshes, Slice<Instance const> const _instances, Build_Options const& options) {
+        RT_SCOPED_TIMER(build);
+        ANTON_ASSERT(options.max_instances > 0 && options.max_instances <= max_leaf_instances, "max_instances must be in range [1, 65535]");
+        meshes.clear();
+        Array<Extent3> mesh_bounds{reserve, _meshes.size()};
+        for(Mesh const& mesh: _meshes) {
+            meshes.push_back(mesh);
+            mesh_bounds.push_back(calculate_scene_bounds(*mesh.scene));
+        }
+
+        Array<Build_Instance> build_instances{reserve, _instances.size()};
+        for(i64 i = 0; i < _instances.size(); ++i) {
+            Instance const& instance = _instances[i];
+            ANTON_ASSERT(instance.mesh >= 0 && instance.mesh < meshes.size(), "instance references a mesh that does not exist");
+            Extent3 const& bounds = mesh_bounds[instance.mesh];
+            if(bounds.min.x > bounds.max.x) {
+                continue;
+            }
+
+            Extent3 const world_bounds = transform_extent(instance.object_to_world, bounds);
+            build_instances.push_back(Build_Instance{world_bounds, 0.5f * (world_bounds.min + world_bounds.max), i});
+        }
+
+        nodes.clear();
+        instances.clear();
+        if(build_instances.size() == 0) {
+            return;
+        }
+
+        instances.ensure_capacity(build_instances.size());
+        construct_node(build_instances, _instances, options.max_instances, max_supported_depth - 1);
+    }
+
+    // intersect_bounds
+    // Slab test of the ray against extent limited to the parametric range [0, max_distance].
+    //
+    [[nodiscard]] static bool intersect_bounds(Extent3 const& extent, Vec3 const ray_origin, Vec3 const inv_ray_direction, f32 const max_distance) {
+        f32 tmin = 0.0f;
+        f32 tmax = max_distance;
+        for(i32 i = 0; i < 3; ++i) {
+            f32 const t1 = (extent.min[i] - ray_origin[i]) * inv_ray_direction[i];
+            f32 const t2 = (extent.max[i] - ray_origin[i]) * inv_ray_direction[i];
+            tmin = math::max(tmin, math::min(t1, t2));
+            tmax = math::min(tmax, math::max(t1, t2));
+        }
+        return tmin <= tmax;
+    }
+
+    Optional<Surface_Interaction> Instance_BVH::intersect(Scene const&, Ray const ray) const {
+        if(nodes.size() == 0) {
+            return null_optional;
+        }
+
+        Vec3 const inv_ray_direction = Vec3{1.0f} / ray.direction;
+        bool hit = false;
+        Surface_Interaction result;
+        // The bottom-level structures count their own cost.
+        i64 visited_nodes = 0;
+        // The stack holds at most one node per level of the tree.
+        i64 node_stack[max_supported_depth];
+        i64 stack_size = 0;
+        i64 node_index = 0;
+        while(true) {
+            Node const& node = nodes[node_index];
+            visited_nodes += 1;
+            if(intersect_bounds(node.bounds, ray.origin, inv_ray_direction, result.distance)) {
+                if(node.instances == 0) {
+                    // Visit the child closer to the ray origin first.
+                    if(ray.direction[node.axis] < 0.0f) {
+                        node_stack[stack_size++] = node_index + 1;
+                        node_index = node.offset;
+                    } else {
+                        node_stack[stack_size++] = node.offset;
+                        node_index = node_index + 1;
+                    }
+                    continue;
+                }
+
+                for(i64 i = node.offset; i < node.offset + node.instances; ++i) {
+                    Instance_Data const& instance = instances[i];
+                    // The bottom-level structures expect normalized directions. Scaling the direction
+                    // scales the distances, hence they are converted back to the world space.
+                    Vec3 const direction = transform_vector(instance.world_to_object, ray.direction);
+                    f32 const direction_length = math::length(direction);
+                    Ray const object_ray{transform_point(instance.world_to_object, ray.origin), direction / direction_length};
+                    Mesh const& mesh = meshes[instance.mesh];
+                    Optional<Surface_Interaction> const intersection_result = mesh.structure->intersect(*mesh.scene, object_ray);
+                    if(!intersection_result) {
+                        continue;
+                    }
+
+                    f32 const distance = intersection_result->distance / direction_length;
+                    if(distance < result.distance) {
+                        Vec3 const normal = math::normalize(transform_normal(instance.world_to_object, intersection_result->normal));
+                        result = Surface_Interaction{normal, distance, intersection_result->material};
+                        hit = true;
+                    }
+                }
+            }
+
+            if(stack_size == 0) {
+                break;
+            }
+
+            stack_size -= 1;
+            node_index = node_stack[stack_size];
+        }
+
+        thread_traversal_cost.nodes += visited_nodes;
+        if(hit) {
+            return result;
+        } else {
+            return null_optional;
+        }
+    }
+
+    bool Instance_BVH::occluded(Scene const&, Ray const ray, f32 const max_distance) const {
+        if(nodes.size() == 0) {
+            return false;
+        }
+
+        Vec3 const inv_ray_direction = Vec3{1.0f} / ray.direction;
+        i64 visited_nodes = 0;
+        i64 node_stack[max_supported_depth];
+        i64 stack_size = 0;
+        i64 node_index = 0;
+        while(true) {
+            Node const& node = nodes[node_index];
+            visited_nodes += 1;
+            if(intersect_bounds(node.bounds, ray.origin, inv_ray_direction, max_distance)) {
+                if(node.instances == 0) {
+                    node_stack[stack_size++] = node.offset;
+                    node_index = node_index + 1;
+                    continue;
+                }
+
+                for(i64 i = node.offset; i < node.offset + node.instances; ++i) {
+                    Instance_Data const& instance = instances[i];
+                    // The distances in the object space are scaled by the length of the transformed direction.
+                    Vec3 const direction = transform_vector(instance.world_to_object, ray.direction);
+                    f32 const direction_length = math::length(direction);
+                    Ray const object_ray{transform_point(instance.world_to_object, ray.origin), direction / direction_length};
+                    Mesh const& mesh = meshes[instance.mesh];
+                    if(mesh.structure->occluded(*mesh.scene, object_ray, max_distance * direction_length)) {
+                        thread_traversal_cost.nodes += visited_nodes;
+                        return true;
+                    }
+                }
+            }
+
+            if(stack_size == 0) {
+                thread_traversal_cost.nodes += visited_nodes;
+                return false;
+            }
+
+            stack_size -= 1;
+            node_index = node_stack[stack_size];
+        }
+    }
+
+    i64 Instance_BVH::size_bytes() const {
+        return nodes.size() * sizeof(Node) + instances.size() * sizeof(Instance_Data) + meshes.size() * sizeof(Mesh);
+    }
+} // namespace raytracing
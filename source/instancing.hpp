@@ -0,0 +1,104 @@
+#pragma once
+
+#include <acceleration_structure.hpp>
+#include <anton/array.hpp>
+#include <anton/optional.hpp>
+#include <anton/slice.hpp>
+#include <build_config.hpp>
+#include <intersections.hpp>
+#include <scene.hpp>
+#include <transform.hpp>
+
+namespace raytracing {
+    // Mesh
+    // Primitives in their object space together with the bottom-level acceleration structure
+    // built over them. A mesh is shared by all of its instances, hence both must outlive the
+    // structures built over the instances. The material handles of the primitives refer to
+    // the materials of the rendered scene.
+    //
+    struct Mesh {
+        Scene const* scene;
+        Acceleration_Structure const* structure;
+    };
+
+    // Instance
+    // Placement of a mesh in the world.
+    //
+    struct Instance {
+        // Index of the mesh in the meshes the Instance_BVH is built with.
+        i64 mesh;
+        Transform object_to_world;
+    };
+
+    // Instance_BVH
+    // Top-level bounding volume hierarchy over the world space bounds of instances of meshes.
+    // The rays are transformed into the object space of the instances and intersected with
+    // the bottom-level structures of their meshes, hence the memory grows with the number of
+    // distinct meshes and not with the number of instances. Primitives placed directly in the
+    // world are added as an instance of a mesh with the identity transform.
+    //
+    struct Instance_BVH: Acceleration_Structure {
+    private:
+        struct Node {
+            Extent3 bounds;
+            // Index of the first instance in instances if the node is a leaf,
+            // index of the second child otherwise.
+            u32 offset;
+            // Number of instances in a leaf. 0 if the node is an interior node.
+            u16 instances;
+            // Axis along which the children of an interior node have been split.
+            u16 axis;
+        };
+
+        struct Instance_Data {
+            // Transforms the rays into the object space. The normals are transformed back with its transpose.
+            Transform world_to_object;
+            i64 mesh;
+        };
+
+        Array<Node> nodes;
+        // The instances in the order of the leaves.
+        Array<Instance_Data> instances;
+        Array<Mesh> meshes;
+
+        struct Build_Instance {
+            Extent3 bounds;
+            Vec3 centroid;
+            i64 index;
+        };
+
+        void construct_node(Slice<Build_Instance> build_instances, Slice<Instance const> source_instances, i64 max_instances, i32 depth);
+
+    public:
+        // The maximum depth of a tree. Bounds the size of the traversal stack.
+        static constexpr i64 max_supported_depth = 64;
+
+        struct Build_Options {
+            // Maximum number of instances in a leaf.
+            i64 max_instances = 2;
+        };
+
+        // build
+        // Builds the hierarchy over the instances of the meshes. Instances of meshes
+        // without primitives are skipped.
+        //
+        void build(Slice<Mesh const> meshes, Slice<Instance const> instances, Build_Options const& options);
+
+        // intersect
+        // The scene is not accessed. The primitives are those of the meshes of the instances
+        // and the material handles of the hits are the ones of the primitives of the meshes.
+        //
+        [[nodiscard]] Optional<Surface_Interaction> intersect(Scene const& scene, Ray ray) const override;
+
+        // occluded
+        // The scene is not accessed.
+        //
+        [[nodiscard]] bool occluded(Scene const& scene, Ray ray, f32 max_distance) const override;
+
+        // size_bytes
+        // Memory of the top-level hierarchy and the instances. The bottom-level structures
+        // are shared and not included.
+        //
+        [[nodiscard]] i64 size_bytes() const override;
+    };
+} // namespace raytracing
@@ -1,7 +1,7 @@
 #include <intersections.hpp>
 
 namespace raytracing {
-    Optional<Surface_Interaction> intersect_sphere(Ray const ray, Sphere const sphere) {
+    Optional<f32> intersect_sphere_distance(Ray const ray, Sphere const sphere) {
         Vec3 const ray_origin = ray.origin - sphere.position;
         // a = dot(ray.direction, ray.direction) which is always 1
         f32 const b = 2.0f * dot(ray_origin, ray.direction);
@@ -19,50 +19,55 @@ namespace raytracing {
                 return null_optional;
             }
         }
-
-        Vec3 normal = ray.origin + ray.direction * distance - sphere.position;
-        return Surface_Interaction{normal, distance, sphere.material};
+        return distance;
     }
 
-    [[nodiscard]] static Optional<f32> intersect_plane(Ray const ray, Vec3 const plane_normal, f32 const plane_distance) {
-        f32 const angle_cos = dot(ray.direction, plane_normal);
-        f32 const coeff = (plane_distance - dot(ray.origin, plane_normal)) / angle_cos;
-        // TODO: Shift the distance >= 0.001f check here and remove it in the routines higher up.
-        if(math::abs(angle_cos) > math::epsilon && coeff >= 0.001f) {
-            return coeff;
-        } else {
+    Optional<Surface_Interaction> intersect_sphere(Ray const ray, Sphere const sphere) {
+        Optional<f32> const distance = intersect_sphere_distance(ray, sphere);
+        if(!distance) {
             return null_optional;
         }
+
+        Vec3 const normal = (ray.origin + ray.direction * distance.value() - sphere.position) / sphere.radius;
+        return Surface_Interaction{normal, distance.value(), sphere.material};
     }
 
-    [[nodiscard]] Optional<Surface_Interaction> intersect_triangle(Ray const ray, Triangle const triangle) {
-        Vec3 const u_vec = triangle.v1 - triangle.v2;
-        Vec3 const v_vec = triangle.v3 - triangle.v2;
-        Vec3 const plane_normal_unnormalized = math::cross(v_vec, u_vec);
-        Vec3 const plane_normal = math::normalize(plane_normal_unnormalized);
-        f32 const plane_distance = math::dot(triangle.v2, plane_normal);
-        Optional<f32> const distance = intersect_plane(ray, plane_normal, plane_distance);
-        if(!distance) {
+    Triangle_Data precompute_triangle(Triangle const triangle) {
+        Vec3 const edge1 = triangle.v2 - triangle.v1;
+        Vec3 const edge2 = triangle.v3 - triangle.v1;
+        // The normal faces the side from which the vertices appear in counterclockwise order.
+        Vec3 const normal = math::normalize(math::cross(edge1, edge2));
+        return Triangle_Data{triangle.v1, edge1, edge2, normal, triangle.material};
+    }
+
+    Optional<f32> intersect_triangle_distance(Ray const ray, Triangle_Data const& triangle) {
+        Vec3 const p = math::cross(ray.direction, triangle.edge2);
+        f32 const det = math::dot(triangle.edge1, p);
+        // The ray is parallel to the plane of the triangle or the triangle is degenerate.
+        // det scales with the area of the triangle and the length of the direction,
+        // hence comparing it against an absolute epsilon would reject small triangles.
+        if(det == 0.0f) {
             return null_optional;
         }
 
-        Vec3 const pr = distance.value() * ray.direction;
-        // dot(pr, cross(bc, bc))
-        // The cross product is the plane normal in CCW. PR points the opposite way.
-        // det is negative when ABC is CCW, positive when ABC is CW.
-        f32 const det = math::dot(pr, plane_normal_unnormalized);
-        Vec3 const pa = triangle.v1 - ray.origin;
-        Vec3 const pb = triangle.v2 - ray.origin;
-        Vec3 const pc = triangle.v3 - ray.origin;
-        // When ABC is CCW, u and v are positive for R in ABC, negative for R outside ABC.
-        // When ABC is CW, u and v are negative for R in ABC, positive for R outside ABC.
-        // We divide by -det to normalize them and ensure they are always positive when R is inside ABC.
-        f32 const u = math::dot(pr, math::cross(pa, pc)) / -det;
-        f32 const v = math::dot(pr, math::cross(pc, pb)) / -det;
-        if(u >= 0.0f & v >= 0.0f & u + v <= 1.0f) {
-            return Surface_Interaction{plane_normal, distance.value(), triangle.material};
+        f32 const inv_det = 1.0f / det;
+        Vec3 const t = ray.origin - triangle.v1;
+        f32 const u = math::dot(t, p) * inv_det;
+        Vec3 const q = math::cross(t, triangle.edge1);
+        f32 const v = math::dot(ray.direction, q) * inv_det;
+        f32 const distance = math::dot(triangle.edge2, q) * inv_det;
+        if(u >= 0.0f & v >= 0.0f & u + v <= 1.0f & distance >= 0.001f) {
+            return distance;
         } else {
             return null_optional;
         }
     }
+
+    Optional<Surface_Interaction> intersect_triangle(Ray const ray, Triangle_Data const& triangle) {
+        Optional<f32> const distance = intersect_triangle_distance(ray, triangle);
+        if(!distance) {
+            return null_optional;
+        }
+        return Surface_Interaction{triangle.normal, distance.value(), triangle.material};
+    }
 } // namespace raytracing
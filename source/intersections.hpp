@@ -12,6 +12,32 @@ namespace raytracing {
         Handle<Material> material;
     };
 
+    // Triangle_Data
+    // Triangle in the form used by the Moller-Trumbore intersection test with
+    // the edges and the normal computed ahead of time.
+    //
+    struct Triangle_Data {
+        Vec3 v1;
+        // v2 - v1
+        Vec3 edge1;
+        // v3 - v1
+        Vec3 edge2;
+        Vec3 normal;
+        Handle<Material> material;
+    };
+
+    [[nodiscard]] Triangle_Data precompute_triangle(Triangle triangle);
+
+    // intersect_sphere_distance
+    // intersect_triangle_distance
+    // Any-hit variants of intersect_sphere and intersect_triangle for occlusion queries.
+    //
+    // Returns:
+    // The distance to the intersection or null_optional if there is none.
+    //
+    [[nodiscard]] Optional<f32> intersect_sphere_distance(Ray ray, Sphere sphere);
+    [[nodiscard]] Optional<f32> intersect_triangle_distance(Ray ray, Triangle_Data const& triangle);
+
     [[nodiscard]] Optional<Surface_Interaction> intersect_sphere(Ray ray, Sphere sphere);
-    [[nodiscard]] Optional<Surface_Interaction> intersect_triangle(Ray ray, Triangle triangle);
+    [[nodiscard]] Optional<Surface_Interaction> intersect_triangle(Ray ray, Triangle_Data const& triangle);
 } // namespace raytracing
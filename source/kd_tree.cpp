@@ -2,37 +2,65 @@
 
 #include <anton/algorithm.hpp>
 #include <anton/algorithm/sort.hpp>
+#include <anton/assert.hpp>
+#include <counters.hpp>
+#include <hash.hpp>
+#include <scheduler.hpp>
+
+#include <thread>
+
+#if defined(__x86_64__) || defined(_M_X64)
+    // SSE2 is part of x86-64. Elsewhere intersect_packet intersects the rays one by one.
+    #define RT_KD_TREE_PACKET_TRAVERSAL 1
+    #include <emmintrin.h>
+#endif
 
 namespace raytracing {
-    void KD_Tree::Node::initialize_leaf(i64 _primitives, i64 _primitives_indices_offset) {
-        primitives = _primitives;
-        primitives_indices_offset = _primitives_indices_offset;
-        flags = 3;
+    void KD_Tree::Node::initialize_leaf(i64 _primitives, u32 _primitive_or_offset) {
+        ANTON_ASSERT(_primitives < (1 << 30), "number of primitives exceeds the range of the leaf");
+        primitive_index = _primitive_or_offset;
+        packed = (static_cast<u32>(_primitives) << 2) | 3;
     }
 
-    void KD_Tree::Node::initialize_interior(i32 _axis, f32 _split_position, i64 _second_child_index) {
-        flags = _axis;
-        second_child_index = _second_child_index;
+    void KD_Tree::Node::initialize_interior(i32 _axis, f32 _split_position, i64 _child_index) {
+        ANTON_ASSERT(_child_index < (1 << 30), "child index exceeds the range of the node");
         split_position = _split_position;
+        packed = (static_cast<u32>(_child_index) << 2) | static_cast<u32>(_axis);
     }
 
     bool KD_Tree::Node::is_leaf() const {
-        return flags == 3;
+        return (packed & 3) == 3;
     }
 
     i32 KD_Tree::Node::axis() const {
-        return flags;
+        return packed & 3;
+    }
+
+    u32 KD_Tree::Node::primitives() const {
+        return packed >> 2;
+    }
+
+    u32 KD_Tree::Node::child_index() const {
+        return packed >> 2;
+    }
+
+    KD_Tree::Node const& KD_Tree::get_node(u32 const index) const {
+        return node_blocks[index / node_block_size].nodes[index % node_block_size];
     }
 
-    [[nodiscard]] static i64 calculate_tree_max_depth(i64 const triangles) {
-        // 8 + 1.3 * log2(triangles)
-        return 8 + (13 * math::ilog2((u64)triangles)) / 10;
+    [[nodiscard]] static i64 calculate_tree_max_depth(i64 const primitives) {
+        // 8 + 1.3 * log2(primitives)
+        return 8 + (13 * math::ilog2((u64)primitives)) / 10;
     }
 
     [[nodiscard]] static Extent3 calculate_triangle_bounds(Triangle const& triangle) {
         return {min(min(triangle.v1, triangle.v2), triangle.v3), max(max(triangle.v1, triangle.v2), triangle.v3)};
     }
 
+    [[nodiscard]] static Extent3 calculate_sphere_bounds(Sphere const& sphere) {
+        return {sphere.position - Vec3{sphere.radius}, sphere.position + Vec3{sphere.radius}};
+    }
+
     [[nodiscard]] static f32 calculate_surface_area(Extent3 const& extent) {
         Vec3 const diagonal = extent.max - extent.min;
         return 2.0f * (diagonal.x * diagonal.y + diagonal.x * diagonal.z + diagonal.y * diagonal.z);
@@ -74,14 +102,21 @@ namespace raytracing {
         }
     };
 
-    void KD_Tree::construct_node(Construct_Parameters const& p) {
+    // Classification of the primitives against the split.
+    static constexpr u8 classification_below = 1;
+    static constexpr u8 classification_above = 2;
+
+    void KD_Tree::construct_node(Construct_Parameters const& p, Subtree& subtree) const {
+        Array<Build_Node>& nodes = subtree.nodes;
+        Array<u32>& primitive_indices = subtree.primitive_indices;
         i64 const node_index = nodes.size();
-        nodes.push_back(Node{});
+        nodes.push_back(Build_Node{primitive_indices.size(), p.primitives, 0.0f, -1});
         if(p.primitives <= p.max_primitives || p.depth == 0) {
-            i64 const offset = primitive_indices.size();
-            nodes[node_index].initialize_leaf(p.primitives, offset);
-            for(i64 const index: p.primitive_indices) {
-                primitive_indices.push_back(index);
+            // Every primitive has exactly one min edge on each axis.
+            for(Edge const& edge: p.edges[0]) {
+                if(edge.min) {
+                    primitive_indices.push_back(static_cast<u32>(edge.primitive_index));
+                }
             }
             return;
         }
@@ -92,20 +127,6 @@ namespace raytracing {
         i32 axis = find_maximum_extent_axis(p.bounds);
         Surface_Area_Heuristic const heuristic(p.bounds);
         for(i32 retries = 0; best_axis == -1 && retries < 3; retries += 1) {
-            // Compute edges for all bounding volumes in this node.
-            for(i64 i = 0; i < p.primitives; ++i) {
-                i64 const primitive_index = p.primitive_indices[i];
-                Extent3 const bounds = primitive_bv[primitive_index];
-                p.edges[axis][2 * i] = Edge{primitive_index, bounds.min[axis], true};
-                p.edges[axis][2 * i + 1] = Edge{primitive_index, bounds.max[axis], false};
-            }
-
-            quick_sort(p.edges[axis].data(), p.edges[axis].data() + 2 * p.primitives, [](Edge const& lhs, Edge const& rhs) {
-                // The edges are only equal when positions are equal and their types are equal.
-                // Otherwise sort by position with secondary sorting on min. min edges come first.
-                return lhs.position < rhs.position || (lhs.position < rhs.position && lhs.min > rhs.min);
-            });
-
             // Compute all splits for the current axis.
             i64 below = 0;
             i64 above = p.primitives;
@@ -142,83 +163,358 @@ namespace raytracing {
         }
 
         if(((best_cost > 4 * old_cost) && p.primitives < 16) || best_axis == -1 || bad_refines == 3) {
-            i64 const offset = primitive_indices.size();
-            nodes[node_index].initialize_leaf(p.primitives, offset);
-            for(i64 const index: p.primitive_indices) {
-                primitive_indices.push_back(index);
+            for(Edge const& edge: p.edges[0]) {
+                if(edge.min) {
+                    primitive_indices.push_back(static_cast<u32>(edge.primitive_index));
+                }
             }
             return;
         }
 
+        // Classify the primitives. Primitives that straddle the split belong to both children.
+        Slice<Edge> const split_edges = p.edges[best_axis];
+        for(Edge const& edge: split_edges) {
+            if(edge.min) {
+                p.classification[edge.primitive_index] = 0;
+            }
+        }
+
         i64 primitives_below = 0;
-        i64* const primitives_below_data = p.primitive_indices_reusable;
         for(i64 i = 0; i < best_offset; ++i) {
-            Edge const& edge = p.edges[best_axis][i];
+            Edge const& edge = split_edges[i];
             if(edge.min) {
-                primitives_below_data[primitives_below] = edge.primitive_index;
+                p.classification[edge.primitive_index] |= classification_below;
                 ++primitives_below;
             }
         }
 
         i64 primitives_above = 0;
-        i64* const primitives_above_data = p.primitive_indices_nonreusable;
         for(i64 i = best_offset + 1; i < 2 * p.primitives; ++i) {
-            Edge const& edge = p.edges[best_axis][i];
+            Edge const& edge = split_edges[i];
             if(!edge.min) {
-                primitives_above_data[primitives_above] = edge.primitive_index;
+                p.classification[edge.primitive_index] |= classification_above;
                 ++primitives_above;
             }
         }
 
-        f32 const split_position = p.edges[best_axis][best_offset].position;
-        // Construct the 'below' node.
+        // Partition the edges of all axes between the children. The partition is stable,
+        // therefore the edges of the children remain sorted. The edges of the 'below' child
+        // replace the edges of the node in place and the edges of the 'above' child are copied
+        // to the buffer of the depth of the node, which no other node needs while the 'above'
+        // subtree is being built.
+        f32 const split_position = split_edges[best_offset].position;
+        Array<Edge>& edges_above = p.above_edges[p.depth];
+        edges_above.ensure_capacity(6 * primitives_above);
+        edges_above.force_size(6 * primitives_above);
         Construct_Parameters p0 = p;
+        Construct_Parameters p1 = p;
+        for(i32 edges_axis = 0; edges_axis < 3; ++edges_axis) {
+            Slice<Edge> const node_edges = p.edges[edges_axis];
+            Edge* const above_begin = edges_above.data() + edges_axis * 2 * primitives_above;
+            Edge* below_end = node_edges.data();
+            Edge* above_end = above_begin;
+            for(Edge const edge: node_edges) {
+                u8 const classification = p.classification[edge.primitive_index];
+                if(classification & classification_below) {
+                    // below_end never passes the edge being read.
+                    *below_end = edge;
+                    ++below_end;
+                }
+
+                if(classification & classification_above) {
+                    *above_end = edge;
+                    ++above_end;
+                }
+            }
+            p0.edges[edges_axis] = Slice<Edge>{node_edges.data(), below_end};
+            p1.edges[edges_axis] = Slice<Edge>{above_begin, above_end};
+        }
+
         p0.bounds.max[best_axis] = split_position;
         p0.depth -= 1;
         p0.bad_refines = bad_refines;
         p0.primitives = primitives_below;
-        p0.primitive_indices = Slice{primitives_below_data, primitives_below_data + primitives_below};
-        p0.primitive_indices_nonreusable = primitives_above_data + primitives_above;
-        construct_node(p0);
-        // Initialize our current node as interior.
-        i64 const second_child_index = nodes.size();
-        nodes[node_index].initialize_interior(best_axis, split_position, second_child_index);
-        // Construct the 'above' node.
-        Construct_Parameters p1 = p;
         p1.bounds.min[best_axis] = split_position;
         p1.depth -= 1;
         p1.bad_refines = bad_refines;
         p1.primitives = primitives_above;
-        p1.primitive_indices = Slice{primitives_above_data, primitives_above_data + primitives_above};
-        p1.primitive_indices_nonreusable = primitives_above_data + primitives_above;
-        construct_node(p1);
+        if(p.parallel_depth > 0 && p.primitives >= p.parallel_cutoff) {
+            // Construct the 'above' node on a separate thread.
+            p0.parallel_depth -= 1;
+            p1.parallel_depth -= 1;
+            Subtree above_subtree;
+            std::thread above_thread([this, &p1, &above_subtree]() {
+                // Every interior node writes the classification and the buffers of its depth,
+                // therefore the thread needs its own.
+                Array<u8> classification{reserve, p1.classification.size()};
+                classification.force_size(p1.classification.size());
+                Array<Array<Edge>> above_edges(p1.depth + 1);
+                Construct_Parameters parameters = p1;
+                parameters.classification = classification;
+                parameters.above_edges = above_edges;
+                construct_node(parameters, above_subtree);
+            });
+            construct_node(p0, subtree);
+            above_thread.join();
+            // Stitch the subtrees in the same order the serial construction would produce them.
+            nodes[node_index] = Build_Node{nodes.size(), 0, split_position, best_axis};
+            append_subtree(subtree, above_subtree);
+        } else {
+            // Construct the 'below' node.
+            construct_node(p0, subtree);
+            // Initialize our current node as interior.
+            nodes[node_index] = Build_Node{nodes.size(), 0, split_position, best_axis};
+            // Construct the 'above' node.
+            construct_node(p1, subtree);
+        }
+    }
+
+    void KD_Tree::append_subtree(Subtree& subtree, Subtree const& appended_subtree) {
+        i64 const node_offset = subtree.nodes.size();
+        i64 const primitive_indices_offset = subtree.primitive_indices.size();
+        subtree.nodes.ensure_capacity(node_offset + appended_subtree.nodes.size());
+        for(Build_Node node: appended_subtree.nodes) {
+            if(node.axis == -1) {
+                node.offset += primitive_indices_offset;
+            } else {
+                node.offset += node_offset;
+            }
+            subtree.nodes.push_back(node);
+        }
+
+        subtree.primitive_indices.ensure_capacity(primitive_indices_offset + appended_subtree.primitive_indices.size());
+        for(u32 const index: appended_subtree.primitive_indices) {
+            subtree.primitive_indices.push_back(index);
+        }
+    }
+
+    void KD_Tree::layout_nodes(Subtree const& tree, Slice<Triangle_Data const> const triangles) {
+        node_blocks.clear();
+        primitive_indices.clear();
+        triangle_packets.clear();
+        // The padding between the treelets consists of empty leaves.
+        Node_Block empty_block;
+        for(Node& node: empty_block.nodes) {
+            node.initialize_leaf(0, 0);
+        }
+
+        auto node_at = [this](i64 const index) -> Node& {
+            return node_blocks[index / node_block_size].nodes[index % node_block_size];
+        };
+
+        auto lay_out_leaf = [this, &tree, triangles](Build_Node const& build_node, Node& node) {
+            u32 const* const indices = tree.primitive_indices.data() + build_node.offset;
+            i64 const primitives = build_node.primitives;
+            if(primitives <= 1) {
+                node.initialize_leaf(primitives, primitives == 1 ? indices[0] : 0);
+                return;
+            }
+
+            i64 const offset = primitive_indices.size();
+            ANTON_ASSERT(offset + leaf_header_size + primitives <= 0xFFFFFFFF, "primitive indices exceed the range of the leaf");
+            ANTON_ASSERT(triangle_packets.size() <= 0xFFFFFFFF, "triangle packets offset exceeds the range of the leaf");
+            node.initialize_leaf(primitives, static_cast<u32>(offset));
+            primitive_indices.push_back(0);
+            primitive_indices.push_back(static_cast<u32>(triangle_packets.size()));
+            // Stable partition of the leaf into triangles followed by spheres.
+            for(i64 i = 0; i < primitives; ++i) {
+                if(indices[i] < triangle_count) {
+                    primitive_indices.push_back(indices[i]);
+                }
+            }
+
+            i64 const leaf_triangles = primitive_indices.size() - offset - leaf_header_size;
+            for(i64 i = 0; i < primitives; ++i) {
+                if(indices[i] >= triangle_count) {
+                    primitive_indices.push_back(indices[i]);
+                }
+            }
+
+            primitive_indices[offset] = static_cast<u32>(leaf_triangles);
+            if(compressed) {
+                return;
+            }
+
+            for(i64 i = 0; i < leaf_triangles; i += triangle_packet_width) {
+                i64 const count = math::min(triangle_packet_width, leaf_triangles - i);
+                u32 const* const packet_indices = primitive_indices.data() + offset + leaf_header_size + i;
+                triangle_packets.push_back(make_triangle_packet(Slice<u32 const>{packet_indices, count}, triangles));
+            }
+        };
+
+        struct Pending_Treelet {
+            // The root or the pair of siblings the treelet starts with.
+            i64 build_indices[2];
+            i64 count;
+            // The node whose child index is set once the pair is laid out. -1 for the root.
+            i64 parent;
+        };
+
+        struct Treelet_Member {
+            i64 build_index;
+            // Position of the first child in the treelet or -1 if the children start other treelets.
+            i64 children;
+        };
+
+        // The treelets are laid out depth-first, hence the treelets of a subtree are close to each other.
+        Array<Pending_Treelet> pending;
+        pending.push_back(Pending_Treelet{{0, 0}, 1, -1});
+        Array<Treelet_Member> members;
+        i64 node_count = 0;
+        while(pending.size() > 0) {
+            Pending_Treelet const treelet = pending.back();
+            pending.pop_back();
+            members.clear();
+            for(i64 i = 0; i < treelet.count; ++i) {
+                members.push_back(Treelet_Member{treelet.build_indices[i], -1});
+            }
+
+            // Add the children of the members breadth-first while they fit in a block.
+            for(i64 i = 0; i < members.size() && members.size() + 2 <= node_block_size; ++i) {
+                i64 const build_index = members[i].build_index;
+                Build_Node const& build_node = tree.nodes[build_index];
+                if(build_node.axis != -1) {
+                    members[i].children = members.size();
+                    members.push_back(Treelet_Member{build_index + 1, -1});
+                    members.push_back(Treelet_Member{build_node.offset, -1});
+                }
+            }
+
+            // Start a new block unless the treelet fits in the rest of the current one.
+            i64 const block_remaining = node_block_size - node_count % node_block_size;
+            if(members.size() > block_remaining) {
+                node_count += block_remaining;
+            }
+
+            i64 const first = node_count;
+            node_count += members.size();
+            while(node_blocks.size() * node_block_size < node_count) {
+                node_blocks.push_back(empty_block);
+            }
+
+            if(treelet.parent != -1) {
+                Node& parent = node_at(treelet.parent);
+                parent.initialize_interior(parent.axis(), parent.split_position, first);
+            }
+
+            for(i64 i = 0; i < members.size(); ++i) {
+                Build_Node const& build_node = tree.nodes[members[i].build_index];
+                Node& node = node_at(first + i);
+                if(build_node.axis == -1) {
+                    lay_out_leaf(build_node, node);
+                } else {
+                    i64 const children = (members[i].children != -1 ? first + members[i].children : 0);
+                    node.initialize_interior(build_node.axis, build_node.split_position, children);
+                }
+            }
+
+            // Push the pairs starting other treelets in reverse, so that they are laid out in order.
+            for(i64 i = members.size() - 1; i >= 0; --i) {
+                Build_Node const& build_node = tree.nodes[members[i].build_index];
+                if(build_node.axis != -1 && members[i].children == -1) {
+                    pending.push_back(Pending_Treelet{{members[i].build_index + 1, build_node.offset}, 2, first + i});
+                }
+            }
+        }
+    }
+
+    void KD_Tree::quantize_vertices(Scene const& scene) {
+        Extent3 bounds{Vec3{math::infinity}, Vec3{-math::infinity}};
+        for(Vec3 const vertex: scene.vertices) {
+            bounds.min = math::min(bounds.min, vertex);
+            bounds.max = math::max(bounds.max, vertex);
+        }
+
+        quantization_origin = bounds.min;
+        quantization_scale = (bounds.max - bounds.min) / 65535.0f;
+        quantized_vertices.clear();
+        quantized_vertices.ensure_capacity(scene.vertices.size());
+        for(Vec3 const vertex: scene.vertices) {
+            Quantized_Vertex quantized;
+            for(i32 axis = 0; axis < 3; ++axis) {
+                // All vertices lie on a plane perpendicular to the axis if the scale is 0.
+                f32 const steps = (quantization_scale[axis] > 0.0f ? (vertex[axis] - quantization_origin[axis]) / quantization_scale[axis] : 0.0f);
+                quantized.position[axis] = static_cast<u16>(math::clamp(steps + 0.5f, 0.0f, 65535.0f));
+            }
+            quantized_vertices.push_back(quantized);
+        }
+    }
+
+    Vec3 KD_Tree::dequantize_vertex(u32 const index) const {
+        Quantized_Vertex const vertex = quantized_vertices[index];
+        Vec3 const steps{static_cast<f32>(vertex.position[0]), static_cast<f32>(vertex.position[1]), static_cast<f32>(vertex.position[2])};
+        return quantization_origin + steps * quantization_scale;
     }
 
     void KD_Tree::build(Scene const& scene, Build_Options const& options) {
-        i64 const primitives = scene.triangles.size();
+        RT_SCOPED_TIMER(build);
+        triangle_count = scene.triangles.size();
+        compressed = options.compress_triangles;
+        i64 const primitives = triangle_count + scene.spheres.size();
+        ANTON_ASSERT(primitives <= 0xFFFFFFFF, "the number of primitives exceeds the range of the primitive indices");
+        // The intersection data is only needed to build the packets.
+        Array<Triangle_Data> triangles{reserve, compressed ? 0 : triangle_count};
         primitive_bv.ensure_capacity(primitives);
-        for(Triangle const& triangle: scene.triangles) {
+        for(i64 i = 0; i < triangle_count; ++i) {
+            Triangle const triangle = get_triangle(scene, i);
+            if(!compressed) {
+                triangles.push_back(precompute_triangle(triangle));
+            }
+
             Extent3 const triangle_bounds = calculate_triangle_bounds(triangle);
             primitive_bv.push_back(triangle_bounds);
             root_bounds = math::outer_extent(root_bounds, triangle_bounds);
         }
 
-        i64 const max_depth = (options.max_depth == 0 ? calculate_tree_max_depth(primitives) : options.max_depth);
-        node_queue.ensure_capacity(2 * max_depth);
+        for(Sphere const& sphere: scene.spheres) {
+            Extent3 const sphere_bounds = calculate_sphere_bounds(sphere);
+            primitive_bv.push_back(sphere_bounds);
+            root_bounds = math::outer_extent(root_bounds, sphere_bounds);
+        }
+
+        max_depth = (options.max_depth == 0 ? calculate_tree_max_depth(primitives) : options.max_depth);
+        max_depth = math::min(max_depth, max_supported_depth);
+        i64 const threads = (options.threads > 0 ? options.threads : get_hardware_concurrency());
 
+        // Sort the edges along all 3 axes once. The nodes partition them stably, hence they remain sorted.
         i64 const edge_count = 2 * primitives;
-        // Allocate working memory for all 3 axes for edges (2 * the number of primitives).
         Array<Edge> edges{reserve, 3 * edge_count};
-        Slice<Edge> edges_slices[3] = {{edges.data(), edge_count}, {edges.data() + edge_count, edge_count}, {edges.data() + 2 * edge_count, edge_count}};
-        // Storage for double the number of primitives due to up to primitives overlaps with both children.
-        Array<i64> primitive_indices{reserve, (max_depth + 2) * primitives};
-        primitive_indices.force_size(primitives);
-        fill_with_consecutive(primitive_indices.begin(), primitive_indices.end(), 0);
+        edges.force_size(3 * edge_count);
+        auto sort_edges = [this, &edges, edge_count](i32 const axis) {
+            Edge* const axis_edges = edges.data() + axis * edge_count;
+            for(i64 i = 0; i < primitive_bv.size(); ++i) {
+                Extent3 const bounds = primitive_bv[i];
+                axis_edges[2 * i] = Edge{i, bounds.min[axis], true};
+                axis_edges[2 * i + 1] = Edge{i, bounds.max[axis], false};
+            }
+
+            quick_sort(axis_edges, axis_edges + edge_count, [](Edge const& lhs, Edge const& rhs) {
+                // Sort by position with secondary sorting on min. min edges come first.
+                return lhs.position < rhs.position || (lhs.position == rhs.position && lhs.min > rhs.min);
+            });
+        };
+
+        if(threads > 1) {
+            std::thread y_thread(sort_edges, 1);
+            std::thread z_thread(sort_edges, 2);
+            sort_edges(0);
+            y_thread.join();
+            z_thread.join();
+        } else {
+            for(i32 axis = 0; axis < 3; ++axis) {
+                sort_edges(axis);
+            }
+        }
+
+        Array<u8> classification{reserve, primitives};
+        classification.force_size(primitives);
+        Array<Array<Edge>> above_edges(max_depth + 1);
         Construct_Parameters parameters;
-        parameters.edges = Slice{edges_slices};
-        parameters.primitive_indices = primitive_indices;
-        parameters.primitive_indices_reusable = primitive_indices.data();
-        parameters.primitive_indices_nonreusable = primitive_indices.data() + primitives;
+        for(i32 axis = 0; axis < 3; ++axis) {
+            parameters.edges[axis] = Slice<Edge>{edges.data() + axis * edge_count, edge_count};
+        }
+        parameters.classification = classification;
+        parameters.above_edges = above_edges;
         parameters.bounds = root_bounds;
         parameters.depth = max_depth;
         parameters.max_primitives = options.max_primitives;
@@ -227,7 +523,20 @@ namespace raytracing {
         parameters.traverse_cost = options.traverse_cost;
         parameters.bad_refines = 0;
         parameters.empty_bonus = options.empty_bonus;
-        construct_node(parameters);
+        parameters.parallel_cutoff = options.parallel_cutoff;
+        // Every level of parallel construction doubles the number of threads. Allow one
+        // more level than necessary to occupy all threads since the splits are uneven.
+        parameters.parallel_depth = (threads > 1 ? math::ilog2((u64)threads - 1) + 2 : 0);
+        Subtree tree;
+        construct_node(parameters, tree);
+        layout_nodes(tree, triangles);
+        if(compressed) {
+            quantize_vertices(scene);
+        } else {
+            quantized_vertices = Array<Quantized_Vertex>();
+        }
+        // The bounding volumes are only needed to find the splits.
+        primitive_bv = Array<Extent3>();
     }
 
     struct Min_Max_Distance {
@@ -253,18 +562,196 @@ namespace raytracing {
         }
     }
 
-    Pair<KD_Tree::Node*, KD_Tree::Node*> KD_Tree::order_child_nodes(Node* const node, Ray const ray) {
+    Pair<KD_Tree::Node const*, KD_Tree::Node const*> KD_Tree::order_child_nodes(Node const* const node, Ray const ray) const {
         f32 const split_position = node->split_position;
         i32 const axis = node->axis();
         bool const below_first = (ray.origin[axis] < split_position) || (ray.origin[axis] == split_position && ray.direction[axis] <= 0.0f);
+        Node const* const below = &get_node(node->child_index());
         if(below_first) {
-            return {node + 1, &nodes[node->second_child_index]};
+            return {below, below + 1};
+        } else {
+            return {below + 1, below};
+        }
+    }
+
+    Triangle_Data KD_Tree::get_triangle_data(Scene const& scene, u32 const index) const {
+        Indexed_Triangle const triangle = scene.triangles[index];
+        Vec3 v1;
+        Vec3 v2;
+        Vec3 v3;
+        if(compressed) {
+            v1 = dequantize_vertex(triangle.v1);
+            v2 = dequantize_vertex(triangle.v2);
+            v3 = dequantize_vertex(triangle.v3);
         } else {
-            return {&nodes[node->second_child_index], node + 1};
+            v1 = scene.vertices[triangle.v1];
+            v2 = scene.vertices[triangle.v2];
+            v3 = scene.vertices[triangle.v3];
+        }
+
+        // The normal is only needed for the closest hit.
+        return Triangle_Data{v1, v2 - v1, v3 - v1, Vec3{0.0f}, Handle<Material>{triangle.material}};
+    }
+
+    bool KD_Tree::intersect_indexed_triangle(Scene const& scene, u32 const index, Ray const ray, Surface_Interaction& result) const {
+        Triangle_Data const triangle_data = get_triangle_data(scene, index);
+        Optional<Surface_Interaction> const intersection_result = intersect_triangle(ray, triangle_data);
+        if(intersection_result && intersection_result->distance < result.distance) {
+            result = intersection_result.value();
+            result.normal = math::normalize(math::cross(triangle_data.edge1, triangle_data.edge2));
+            return true;
+        }
+        return false;
+    }
+
+    bool KD_Tree::intersect_leaf(Scene const& scene, Node const* const node, Ray const ray, Surface_Interaction& result) const {
+        u32 const primitives = node->primitives();
+        if(primitives == 1) {
+            u32 const index = node->primitive_index;
+            if(index < triangle_count) {
+                return intersect_indexed_triangle(scene, index, ray, result);
+            }
+
+            Optional<Surface_Interaction> const intersection_result = intersect_sphere(ray, scene.spheres[index - triangle_count]);
+            if(intersection_result && intersection_result->distance < result.distance) {
+                result = intersection_result.value();
+                return true;
+            }
+            return false;
+        }
+
+        if(primitives == 0) {
+            return false;
+        }
+
+        bool hit = false;
+        u32 const* const header = primitive_indices.data() + node->primitive_indices_offset;
+        u32 const leaf_triangles = header[0];
+        u32 const* const indices = header + leaf_header_size;
+        if(compressed) {
+            for(u32 i = 0; i < leaf_triangles; ++i) {
+                hit |= intersect_indexed_triangle(scene, indices[i], ray, result);
+            }
+        } else if(leaf_triangles > 0) {
+            i64 const packets = (leaf_triangles + triangle_packet_width - 1) / triangle_packet_width;
+            Triangle_Packet const* const first_packet = triangle_packets.data() + header[1];
+            Optional<Triangle_Packet_Hit> const packet_hit = intersect_triangle_packets(ray, first_packet, packets, result.distance);
+            if(packet_hit) {
+                Handle<Material> const material{scene.triangles[packet_hit->index].material};
+                result = Surface_Interaction{packet_hit->normal, packet_hit->distance, material};
+                hit = true;
+            }
+        }
+
+        for(u32 i = leaf_triangles; i < primitives; ++i) {
+            Optional<Surface_Interaction> const intersection_result = intersect_sphere(ray, scene.spheres[indices[i] - triangle_count]);
+            if(intersection_result && intersection_result->distance < result.distance) {
+                result = intersection_result.value();
+                hit = true;
+            }
         }
+        return hit;
     }
 
-    Optional<Surface_Interaction> KD_Tree::intersect(Scene const& scene, Ray const ray) {
+    bool KD_Tree::occluded_leaf(Scene const& scene, Node const* const node, Ray const ray, f32 const max_distance) const {
+        u32 const primitives = node->primitives();
+        if(primitives == 1) {
+            u32 const index = node->primitive_index;
+            Optional<f32> const distance = (index < triangle_count ? intersect_triangle_distance(ray, get_triangle_data(scene, index))
+                                                                   : intersect_sphere_distance(ray, scene.spheres[index - triangle_count]));
+            return distance && distance.value() < max_distance;
+        }
+
+        if(primitives == 0) {
+            return false;
+        }
+
+        u32 const* const header = primitive_indices.data() + node->primitive_indices_offset;
+        u32 const leaf_triangles = header[0];
+        u32 const* const indices = header + leaf_header_size;
+        if(compressed) {
+            for(u32 i = 0; i < leaf_triangles; ++i) {
+                Optional<f32> const distance = intersect_triangle_distance(ray, get_triangle_data(scene, indices[i]));
+                if(distance && distance.value() < max_distance) {
+                    return true;
+                }
+            }
+        } else if(leaf_triangles > 0) {
+            i64 const packets = (leaf_triangles + triangle_packet_width - 1) / triangle_packet_width;
+            Triangle_Packet const* const first_packet = triangle_packets.data() + header[1];
+            if(intersect_triangle_packets(ray, first_packet, packets, max_distance)) {
+                return true;
+            }
+        }
+
+        for(u32 i = leaf_triangles; i < primitives; ++i) {
+            Optional<f32> const distance = intersect_sphere_distance(ray, scene.spheres[indices[i] - triangle_count]);
+            if(distance && distance.value() < max_distance) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // add_traversal_cost
+    // Adds the cost of a traversal to the cost of the calling thread and to the counters.
+    //
+    static void add_traversal_cost(Traversal_Cost const cost) {
+        thread_traversal_cost.nodes += cost.nodes;
+        thread_traversal_cost.primitives += cost.primitives;
+        RT_COUNT(kd_tree_nodes, cost.nodes);
+        RT_COUNT(kd_tree_primitives, cost.primitives);
+    }
+
+    bool KD_Tree::occluded(Scene const& scene, Ray const ray, f32 const max_distance) const {
+        Vec3 const inv_ray_direction = Vec3{1.0f} / ray.direction;
+        Optional<Min_Max_Distance> bounds_result = intersect_extent(ray.origin, inv_ray_direction, root_bounds);
+        if(!bounds_result) {
+            return false;
+        }
+
+        Traversal_Cost cost{0, 0};
+        Search_Node node_stack[max_supported_depth + 1];
+        i64 stack_size = 0;
+        node_stack[stack_size++] = Search_Node{&get_node(0), bounds_result->min, bounds_result->max};
+        while(stack_size > 0) {
+            stack_size -= 1;
+            auto [node, min, max] = node_stack[stack_size];
+            if(min > max_distance) {
+                continue;
+            }
+
+            cost.nodes += 1;
+            if(!node->is_leaf()) {
+                // Visiting the nearer child first finds the occluders closer to the origin sooner.
+                auto [first, second] = order_child_nodes(node, ray);
+                i32 const axis = node->axis();
+                f32 const split = (node->split_position - ray.origin[axis]) * inv_ray_direction[axis];
+                if(split != split) {
+                    node_stack[stack_size++] = Search_Node{second, min, max};
+                    node_stack[stack_size++] = Search_Node{first, min, max};
+                } else if(split > max || split <= 0) {
+                    node_stack[stack_size++] = Search_Node{first, min, max};
+                } else if(split < min) {
+                    node_stack[stack_size++] = Search_Node{second, min, max};
+                } else {
+                    node_stack[stack_size++] = Search_Node{second, split, max};
+                    node_stack[stack_size++] = Search_Node{first, min, split};
+                }
+            } else {
+                cost.primitives += node->primitives();
+                if(occluded_leaf(scene, node, ray, max_distance)) {
+                    add_traversal_cost(cost);
+                    return true;
+                }
+            }
+        }
+
+        add_traversal_cost(cost);
+        return false;
+    }
+
+    Optional<Surface_Interaction> KD_Tree::intersect(Scene const& scene, Ray const ray) const {
         Vec3 const inv_ray_direction = Vec3{1.0f} / ray.direction;
         Optional<Min_Max_Distance> bounds_result = intersect_extent(ray.origin, inv_ray_direction, root_bounds);
         if(!bounds_result) {
@@ -272,49 +759,311 @@ namespace raytracing {
         }
 
         bool hit = false;
-        f32 minimal_max = math::infinity;
         Surface_Interaction result;
-        node_queue.push_back(Search_Node{&nodes[0], bounds_result->min, bounds_result->max});
-        while(node_queue.size() > 0) {
-            auto [node, min, max] = node_queue.back();
-            if(min > minimal_max) {
-                break;
+        Traversal_Cost cost{0, 0};
+        // Every interior node replaces itself with at most 2 children, hence
+        // the stack never holds more than max_depth + 1 nodes.
+        Search_Node node_stack[max_supported_depth + 1];
+        i64 stack_size = 0;
+        node_stack[stack_size++] = Search_Node{&get_node(0), bounds_result->min, bounds_result->max};
+        while(stack_size > 0) {
+            stack_size -= 1;
+            auto [node, min, max] = node_stack[stack_size];
+            // Primitives may extend beyond the leaves they are referenced by and spheres
+            // are usually referenced by many leaves, hence we may only skip a node once
+            // the closest hit found so far is in front of it.
+            if(min > result.distance) {
+                continue;
             }
 
-            node_queue.pop_back();
+            cost.nodes += 1;
             if(!node->is_leaf()) {
                 auto [first, second] = order_child_nodes(node, ray);
                 i32 const axis = node->axis();
                 f32 const split = (node->split_position - ray.origin[axis]) * inv_ray_direction[axis];
-                if(split > max || split <= 0) {
-                    node_queue.push_back(Search_Node{first, min, max});
+                if(split != split) {
+                    // The ray lies inside the split plane and both children contain it.
+                    node_stack[stack_size++] = Search_Node{second, min, max};
+                    node_stack[stack_size++] = Search_Node{first, min, max};
+                } else if(split > max || split <= 0) {
+                    node_stack[stack_size++] = Search_Node{first, min, max};
                 } else if(split < min) {
-                    node_queue.push_back(Search_Node{second, min, max});
+                    node_stack[stack_size++] = Search_Node{second, min, max};
                 } else {
-                    node_queue.push_back(Search_Node{second, split, max});
-                    node_queue.push_back(Search_Node{first, min, split});
+                    node_stack[stack_size++] = Search_Node{second, split, max};
+                    node_stack[stack_size++] = Search_Node{first, min, split};
                 }
             } else {
                 // Intersect the primitives inside the leaf node.
-                i64 const primitives = node->primitives;
-                i64 const* const indices = primitive_indices.data() + node->primitives_indices_offset;
-                for(i64 i = 0; i < primitives; ++i) {
-                    i64 const index = indices[i];
-                    Triangle const& triangle = scene.triangles[index];
-                    Optional<Surface_Interaction> intersection_result = intersect_triangle(ray, triangle);
-                    if(intersection_result && intersection_result->distance < result.distance) {
-                        result = intersection_result.value();
-                        hit = true;
-                        minimal_max = math::min(minimal_max, max);
-                    }
-                }
+                cost.primitives += node->primitives();
+                hit |= intersect_leaf(scene, node, ray, result);
             }
         }
 
+        add_traversal_cost(cost);
         if(hit) {
             return result;
         } else {
             return null_optional;
         }
     }
+
+    void KD_Tree::intersect_packet(Scene const& scene, Slice<Ray const> const rays, Slice<Optional<Surface_Interaction>> const results) const {
+        ANTON_ASSERT(rays.size() == results.size(), "rays and results must be the same size");
+        for(i64 i = 0; i < rays.size(); i += ray_packet_width) {
+            i64 const count = math::min(ray_packet_width, rays.size() - i);
+            intersect_ray_packet(scene, rays.data() + i, count, results.data() + i);
+        }
+    }
+
+    void KD_Tree::intersect_ray_packet(Scene const& scene, Ray const* const rays, i64 const count, Optional<Surface_Interaction>* const results) const {
+#if RT_KD_TREE_PACKET_TRAVERSAL
+        static_assert(ray_packet_width == 4, "the packet traversal uses 4-wide SSE vectors");
+        // The rays visit the children of an interior node in the order determined
+        // by the sign of the direction, hence all of them must share the signs.
+        alignas(16) f32 lane_origin[3][4];
+        alignas(16) f32 lane_inv_direction[3][4];
+        bool direction_negative[3];
+        bool coherent = true;
+        for(i32 axis = 0; axis < 3; ++axis) {
+            for(i64 lane = 0; lane < ray_packet_width; ++lane) {
+                // Unused lanes replicate the first ray and are masked out below.
+                Ray const& ray = rays[lane < count ? lane : 0];
+                lane_origin[axis][lane] = ray.origin[axis];
+                lane_inv_direction[axis][lane] = 1.0f / ray.direction[axis];
+            }
+
+            direction_negative[axis] = lane_inv_direction[axis][0] < 0.0f;
+            for(i64 lane = 1; lane < count; ++lane) {
+                coherent &= (lane_inv_direction[axis][lane] < 0.0f) == direction_negative[axis];
+            }
+        }
+
+        if(!coherent) {
+            for(i64 lane = 0; lane < count; ++lane) {
+                results[lane] = intersect(scene, rays[lane]);
+            }
+            return;
+        }
+
+        __m128 const origin[3] = {_mm_load_ps(lane_origin[0]), _mm_load_ps(lane_origin[1]), _mm_load_ps(lane_origin[2])};
+        __m128 const inv_direction[3] = {_mm_load_ps(lane_inv_direction[0]), _mm_load_ps(lane_inv_direction[1]), _mm_load_ps(lane_inv_direction[2])};
+        __m128 const infinity = _mm_set1_ps(math::infinity);
+        // AABB slab test of the root bounds. Unused lanes start with an empty interval.
+        alignas(16) f32 lane_used[4];
+        for(i64 lane = 0; lane < ray_packet_width; ++lane) {
+            lane_used[lane] = (lane < count ? 0.0f : math::infinity);
+        }
+
+        __m128 root_min = _mm_load_ps(lane_used);
+        __m128 root_max = infinity;
+        for(i32 axis = 0; axis < 3; ++axis) {
+            __m128 const t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(root_bounds.min[axis]), origin[axis]), inv_direction[axis]);
+            __m128 const t2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(root_bounds.max[axis]), origin[axis]), inv_direction[axis]);
+            root_min = _mm_max_ps(root_min, _mm_min_ps(t1, t2));
+            root_max = _mm_min_ps(root_max, _mm_max_ps(t1, t2));
+        }
+
+        struct Packet_Search_Node {
+            Node const* node;
+            __m128 min;
+            __m128 max;
+        };
+
+        bool hit[4] = {false, false, false, false};
+        Surface_Interaction result[4];
+        alignas(16) f32 closest[4] = {math::infinity, math::infinity, math::infinity, math::infinity};
+        Traversal_Cost cost{0, 0};
+        Packet_Search_Node node_stack[max_supported_depth + 1];
+        i64 stack_size = 0;
+        node_stack[stack_size++] = Packet_Search_Node{&get_node(0), root_min, root_max};
+        while(stack_size > 0) {
+            stack_size -= 1;
+            Node const* node = node_stack[stack_size].node;
+            __m128 min = node_stack[stack_size].min;
+            // Lanes that have found a hit in front of the node do not visit it.
+            __m128 max = _mm_min_ps(node_stack[stack_size].max, _mm_load_ps(closest));
+            if(_mm_movemask_ps(_mm_cmple_ps(min, max)) == 0) {
+                continue;
+            }
+
+            cost.nodes += 1;
+            while(!node->is_leaf()) {
+                i32 const axis = node->axis();
+                __m128 const split = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node->split_position), origin[axis]), inv_direction[axis]);
+                // Rays inside the split plane produce NaN and visit both children with their whole interval
+                // like in intersect. _mm_min_ps and _mm_max_ps return the second operand when the first one is NaN.
+                __m128 const in_plane = _mm_cmpunord_ps(split, split);
+                Node const* near = &get_node(node->child_index());
+                Node const* far = near + 1;
+                if(direction_negative[axis]) {
+                    Node const* const tmp = near;
+                    near = far;
+                    far = tmp;
+                }
+
+                __m128 const active = _mm_cmple_ps(min, max);
+                i32 const visit_near = _mm_movemask_ps(_mm_and_ps(active, _mm_or_ps(in_plane, _mm_cmple_ps(min, split))));
+                i32 const visit_far = _mm_movemask_ps(_mm_and_ps(active, _mm_or_ps(in_plane, _mm_cmple_ps(split, max))));
+                if(visit_far == 0) {
+                    node = near;
+                } else if(visit_near == 0) {
+                    node = far;
+                } else {
+                    node_stack[stack_size++] = Packet_Search_Node{far, _mm_max_ps(split, min), max};
+                    node = near;
+                    max = _mm_min_ps(split, max);
+                }
+                cost.nodes += 1;
+            }
+
+            alignas(16) f32 lane_min[4];
+            alignas(16) f32 lane_max[4];
+            _mm_store_ps(lane_min, min);
+            _mm_store_ps(lane_max, max);
+            for(i64 lane = 0; lane < count; ++lane) {
+                if(lane_min[lane] > lane_max[lane]) {
+                    continue;
+                }
+
+                cost.primitives += node->primitives();
+                if(intersect_leaf(scene, node, rays[lane], result[lane])) {
+                    hit[lane] = true;
+                    closest[lane] = result[lane].distance;
+                }
+            }
+        }
+
+        add_traversal_cost(cost);
+
+        for(i64 lane = 0; lane < count; ++lane) {
+            if(hit[lane]) {
+                results[lane] = result[lane];
+            } else {
+                results[lane] = null_optional;
+            }
+        }
+#else
+        for(i64 lane = 0; lane < count; ++lane) {
+            results[lane] = intersect(scene, rays[lane]);
+        }
+#endif
+    }
+
+    i64 KD_Tree::size_bytes() const {
+        return node_blocks.size() * sizeof(Node_Block) + primitive_indices.size() * sizeof(u32) + triangle_packets.size() * sizeof(Triangle_Packet) +
+               quantized_vertices.size() * sizeof(Quantized_Vertex);
+    }
+
+    // Identifies the layout of the serialized tree. Trees written by builds with
+    // different layouts of the nodes or the triangle data are rejected by read.
+    [[nodiscard]] static constexpr u64 get_serialized_layout(i64 const node_size, i64 const packet_size, i64 const vertex_size) {
+        return static_cast<u64>(node_size) | (static_cast<u64>(packet_size) << 16) | (static_cast<u64>(vertex_size) << 32);
+    }
+
+    void KD_Tree::write(Output_Stream& stream) const {
+        write_value(stream, get_serialized_layout(sizeof(Node_Block), sizeof(Triangle_Packet), sizeof(Quantized_Vertex)));
+        write_value(stream, root_bounds);
+        write_value(stream, max_depth);
+        write_value(stream, triangle_count);
+        write_value(stream, compressed);
+        write_value(stream, quantization_origin);
+        write_value(stream, quantization_scale);
+        write_array<Node_Block>(stream, node_blocks);
+        write_array<u32>(stream, primitive_indices);
+        write_array<Triangle_Packet>(stream, triangle_packets);
+        write_array<Quantized_Vertex>(stream, quantized_vertices);
+    }
+
+    bool KD_Tree::read(Binary_Reader& reader, Scene const& scene) {
+        u64 layout = 0;
+        if(!reader.read_value(layout) || layout != get_serialized_layout(sizeof(Node_Block), sizeof(Triangle_Packet), sizeof(Quantized_Vertex))) {
+            return false;
+        }
+
+        bool const read = reader.read_value(root_bounds) && reader.read_value(max_depth) && reader.read_value(triangle_count) &&
+                          reader.read_value(compressed) && reader.read_value(quantization_origin) && reader.read_value(quantization_scale) &&
+                          reader.read_array(node_blocks) && reader.read_array(primitive_indices) && reader.read_array(triangle_packets) &&
+                          reader.read_array(quantized_vertices);
+        if(!read || node_blocks.size() == 0 || max_depth < 0 || max_depth > max_supported_depth || triangle_count != scene.triangles.size()) {
+            return false;
+        }
+
+        if(compressed && quantized_vertices.size() != scene.vertices.size()) {
+            return false;
+        }
+
+        // The traversal trusts the indices stored in the tree, hence all of them are checked
+        // against the sizes of the arrays they index.
+        i64 const primitive_count = triangle_count + scene.spheres.size();
+        for(Triangle_Packet const& packet: triangle_packets) {
+            for(i64 lane = 0; lane < triangle_packet_width; ++lane) {
+                if(packet.indices[lane] != empty_lane_index && packet.indices[lane] >= triangle_count) {
+                    return false;
+                }
+            }
+        }
+
+        // The children follow their parents, hence the depths are known before the children are visited.
+        // The depth of a node is bounded by max_depth, which bounds the traversal stack.
+        i64 const node_count = node_blocks.size() * node_block_size;
+        Array<i64> depths(node_count, 0);
+        for(i64 i = 0; i < node_count; ++i) {
+            Node const& node = get_node(i);
+            if(!node.is_leaf()) {
+                i64 const child_index = node.child_index();
+                if(child_index <= i || child_index + 1 >= node_count || depths[i] + 1 > max_depth) {
+                    return false;
+                }
+
+                depths[child_index] = math::max(depths[child_index], depths[i] + 1);
+                depths[child_index + 1] = math::max(depths[child_index + 1], depths[i] + 1);
+                continue;
+            }
+
+            i64 const primitives = node.primitives();
+            if(primitives == 1) {
+                if(node.primitive_index >= primitive_count) {
+                    return false;
+                }
+                continue;
+            }
+
+            if(primitives == 0) {
+                continue;
+            }
+
+            i64 const offset = node.primitive_indices_offset;
+            if(offset + leaf_header_size + primitives > primitive_indices.size()) {
+                return false;
+            }
+
+            u32 const* const header = primitive_indices.data() + offset;
+            i64 const leaf_triangles = header[0];
+            if(leaf_triangles > primitives) {
+                return false;
+            }
+
+            u32 const* const indices = header + leaf_header_size;
+            for(i64 j = 0; j < primitives; ++j) {
+                bool const triangle = j < leaf_triangles;
+                if(indices[j] >= primitive_count || (indices[j] < triangle_count) != triangle) {
+                    return false;
+                }
+            }
+
+            i64 const packets = (leaf_triangles + triangle_packet_width - 1) / triangle_packet_width;
+            if(!compressed && leaf_triangles > 0 && header[1] + packets > triangle_packets.size()) {
+                return false;
+            }
+        }
+
+        primitive_bv = Array<Extent3>();
+        return true;
+    }
+
+    u64 KD_Tree::hash() const {
+        u64 const nodes_hash = hash_bytes(node_blocks.data(), node_blocks.size() * sizeof(Node_Block));
+        return hash_bytes(primitive_indices.data(), primitive_indices.size() * sizeof(u32), nodes_hash);
+    }
 } // namespace raytracing
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <acceleration_structure.hpp>
 #include <anton/array.hpp>
 #include <anton/math/math.hpp>
 #include <anton/optional.hpp>
@@ -8,27 +9,62 @@
 #include <build_config.hpp>
 #include <intersections.hpp>
 #include <scene.hpp>
+#include <serialization.hpp>
+#include <triangle_packets.hpp>
 
 namespace raytracing {
-    struct KD_Tree {
+    struct KD_Tree: Acceleration_Structure {
     private:
         // Bounding volumes of the primitives in the scene.
         Array<Extent3> primitive_bv;
-        Array<i64> primitive_indices;
+        // The primitives are indexed with the triangles of the scene first followed by the spheres,
+        // i.e. index i refers to scene.triangles[i] if i < triangle_count and to
+        // scene.spheres[i - triangle_count] otherwise.
+        //
+        // Every leaf with more than one primitive stores a header of leaf_header_size values
+        // followed by the indices of its primitives, triangles first. The header holds the number
+        // of the triangles of the leaf and the index of their first packet in triangle_packets.
+        Array<u32> primitive_indices;
+        // The triangles of every leaf packed for the SIMD intersection kernels.
+        // Empty if the triangles are compressed.
+        Array<Triangle_Packet> triangle_packets;
+        i64 triangle_count = 0;
+
+        struct Quantized_Vertex {
+            u16 position[3];
+        };
+
+        // Whether the leaves intersect the indexed triangles of the scene with the positions
+        // of their vertices read from quantized_vertices instead of triangle_packets.
+        bool compressed = false;
+        // Positions of the vertices of the scene quantized to 16 bits per coordinate on the grid
+        // spanning the bounds of the vertices. Every vertex is quantized once, hence the triangles
+        // sharing a vertex remain watertight. Empty unless the triangles are compressed.
+        Array<Quantized_Vertex> quantized_vertices;
+        Vec3 quantization_origin;
+        // Size of a step of the quantization grid along each axis.
+        Vec3 quantization_scale;
+
+        static constexpr i64 leaf_header_size = 2;
 
         struct Node {
             // initialize_leaf
             //
-            void initialize_leaf(i64 primitives, i64 primitices_indices_offset);
+            // Parameters:
+            //          primitives - number of the primitives of the leaf.
+            // primitive_or_offset - index of the primitive if the leaf has exactly one primitive,
+            //                       offset of the header of the leaf in primitive_indices otherwise.
+            //
+            void initialize_leaf(i64 primitives, u32 primitive_or_offset);
 
             // initialize_interior
             //
             // Parameters:
-            //               axis - 0 (x), 1 (y) or 2 (z) depending on which axis the node has been split.
-            //     split_position - position of the split along axis in the world space.
-            // second_child_index - index of the second child in the nodes array of the KD_Tree.
+            //           axis - 0 (x), 1 (y) or 2 (z) depending on which axis the node has been split.
+            // split_position - position of the split along axis in the world space.
+            //    child_index - index of the first child. The second child immediately follows it.
             //
-            void initialize_interior(i32 axis, f32 split_position, i64 second_child_index);
+            void initialize_interior(i32 axis, f32 split_position, i64 child_index);
 
             // is_leaf
             //
@@ -38,33 +74,54 @@ namespace raytracing {
             //
             [[nodiscard]] i32 axis() const;
 
+            // primitives
+            //
+            [[nodiscard]] u32 primitives() const;
+
+            // child_index
+            //
+            [[nodiscard]] u32 child_index() const;
+
             union {
-                i64 primitives_indices_offset;
-                struct {
-                    f32 split_position;
-                    i32 _padding;
-                };
-            };
-            u64 flags : 2;
-            union {
-                u64 primitives : 62;
-                // Index of the second child. The index of the first child is <index of the node> + 1.
-                u64 second_child_index : 62;
+                f32 split_position;
+                // The primitive of a leaf with exactly one primitive.
+                u32 primitive_index;
+                // Offset of the header of a leaf with multiple primitives in primitive_indices.
+                u32 primitive_indices_offset;
             };
+            // The lowest 2 bits hold the axis of an interior node or 3 for a leaf. The upper 30 bits
+            // hold the index of the first child of an interior node or the number of the primitives of a leaf.
+            u32 packed;
         };
 
-        Array<Node> nodes;
+        static_assert(sizeof(Node) == 8, "Node must be 8 bytes");
+
+        // The number of nodes that fit in a cache line.
+        static constexpr i64 node_block_size = 8;
+
+        // Node_Block
+        // The nodes are stored in cache line aligned blocks. Every block holds a treelet: a pair of
+        // siblings (or the root) together with as many of their descendants in breadth-first order
+        // as fit in the block, so that a ray usually descends several levels per cache line. Small
+        // treelets are packed together as long as they do not straddle a block. The children of
+        // an interior node are adjacent and never straddle a block.
+        //
+        struct alignas(64) Node_Block {
+            Node nodes[node_block_size];
+        };
+
+        Array<Node_Block> node_blocks;
 
         struct Search_Node {
-            Node* node;
+            Node const* node;
             // Parametric minimum along the ray of the intersection with the bounding volume of the node.
             f32 min;
             // Parametric maximum along the ray of the intersection with the bounding volume of the node.
             f32 max;
         };
 
-        Array<Search_Node> node_queue;
         Extent3 root_bounds;
+        i64 max_depth = 0;
 
         struct Edge {
             i64 primitive_index;
@@ -75,29 +132,96 @@ namespace raytracing {
         };
 
         struct Construct_Parameters {
-            // Working memory for finding the best split.
-            Slice<Slice<Edge> const> edges;
-            Slice<i64> primitive_indices;
-            i64* primitive_indices_reusable;
-            i64* primitive_indices_nonreusable;
+            // Edges of the bounding volumes of the primitives in the node sorted along each axis.
+            // The construction of the node overwrites them with the edges of its 'below' child.
+            Slice<Edge> edges[3];
+            // Working memory for classifying the primitives against the split. Indexed by primitive index.
+            Slice<u8> classification;
+            // Working memory for the edges of the 'above' child of a node. Indexed by depth.
+            Slice<Array<Edge>> above_edges;
             Extent3 bounds;
             i64 intersect_cost = 0;
             i64 traverse_cost = 0;
             // Max primitives in a node.
             i64 max_primitives = 0;
             i64 primitives = 0;
+            // Nodes with at least parallel_cutoff primitives build their 'above' subtree
+            // on a separate thread while parallel_depth is greater than 0.
+            i64 parallel_cutoff = 0;
+            i32 parallel_depth = 0;
             i32 depth = 0;
             i32 bad_refines = 0;
             f32 empty_bonus = 0.0f;
         };
 
-        void construct_node(Construct_Parameters const& parameters);
-        Pair<Node*, Node*> order_child_nodes(Node* node, Ray ray);
+        // The node produced by the construction. The nodes of a subtree are stored in
+        // depth-first order, i.e. the first child of a node immediately follows it.
+        struct Build_Node {
+            // Index of the second child of an interior node or the offset of the primitives
+            // of a leaf in the primitive indices of the subtree.
+            i64 offset;
+            i64 primitives;
+            f32 split_position;
+            // -1 for leaves.
+            i32 axis;
+        };
+
+        // The nodes and primitive indices of a subtree. The offsets stored in
+        // the nodes are relative to the beginning of the subtree.
+        struct Subtree {
+            Array<Build_Node> nodes;
+            Array<u32> primitive_indices;
+        };
+
+        void construct_node(Construct_Parameters const& parameters, Subtree& subtree) const;
+        static void append_subtree(Subtree& subtree, Subtree const& appended_subtree);
+        // layout_nodes
+        // Lays the constructed nodes out in treelets in node_blocks and writes the leaves to
+        // primitive_indices. The triangles of every leaf are moved in front of its spheres and,
+        // unless the triangles are compressed, packed into triangle_packets.
+        //
+        void layout_nodes(Subtree const& tree, Slice<Triangle_Data const> triangles);
+        [[nodiscard]] Node const& get_node(u32 index) const;
+        // get_triangle_data
+        // The intersection data of a triangle of the scene with the positions of its vertices
+        // in the scene or the quantized positions if the triangles are compressed. The normal
+        // is not computed.
+        //
+        [[nodiscard]] Triangle_Data get_triangle_data(Scene const& scene, u32 index) const;
+        // intersect_indexed_triangle
+        // Intersects a triangle of the scene using the positions of its vertices in the scene
+        // or the quantized positions if the triangles are compressed.
+        //
+        [[nodiscard]] bool intersect_indexed_triangle(Scene const& scene, u32 index, Ray ray, Surface_Interaction& result) const;
+        // quantize_vertices
+        // Quantizes the vertices of the scene into quantized_vertices.
+        //
+        void quantize_vertices(Scene const& scene);
+        [[nodiscard]] Vec3 dequantize_vertex(u32 index) const;
+        [[nodiscard]] Pair<Node const*, Node const*> order_child_nodes(Node const* node, Ray ray) const;
+        // intersect_leaf
+        // Intersects the primitives of a leaf and updates result if any of them is closer.
+        //
+        // Returns:
+        // Whether result has been updated.
+        //
+        [[nodiscard]] bool intersect_leaf(Scene const& scene, Node const* node, Ray ray, Surface_Interaction& result) const;
+        // occluded_leaf
+        //
+        // Returns:
+        // Whether any primitive of the leaf intersects the ray closer than max_distance.
+        //
+        [[nodiscard]] bool occluded_leaf(Scene const& scene, Node const* node, Ray ray, f32 max_distance) const;
+        // intersect_ray_packet
+        // Traverses the tree with up to ray_packet_width rays at once.
+        //
+        void intersect_ray_packet(Scene const& scene, Ray const* rays, i64 count, Optional<Surface_Interaction>* results) const;
 
     public:
         struct Build_Options {
             // Maximum depth of the tree. If max_depth is set to 0, the max depth
             // will be calculated based on the number of primitives in the scene.
+            // The depth is clamped to max_supported_depth.
             i64 max_depth = 0;
             // Maximum number of primitives in a node.
             i64 max_primitives = 1;
@@ -108,10 +232,71 @@ namespace raytracing {
             // The bonus for a node being empty.
             // Must be in range [0, 1].
             f32 empty_bonus = 0.5f;
+            // Number of threads to build the tree with. If threads is set to 0,
+            // one thread per hardware thread will be used. The built tree does
+            // not depend on the number of threads.
+            i64 threads = 0;
+            // Minimum number of primitives in a node for its subtrees to be built in parallel.
+            i64 parallel_cutoff = 16384;
+            // Whether to intersect the indexed triangles of the scene with quantized positions
+            // instead of building SIMD packets of full precision triangles. Reduces the memory
+            // retained by the tree from 52 bytes per triangle to 6 bytes per vertex at the cost
+            // of slower leaf intersections and vertices moved by up to half a step of the grid,
+            // i.e. 1/131070 of the extent of the vertices along each axis.
+            bool compress_triangles = false;
         };
 
+        // The maximum depth of a tree. Bounds the size of the traversal stack.
+        static constexpr i64 max_supported_depth = 64;
+        // Number of rays traversing the tree together in intersect_packet.
+        static constexpr i64 ray_packet_width = 4;
+
         void build(Scene const& scene, Build_Options const& options);
 
-        [[nodiscard]] Optional<Surface_Interaction> intersect(Scene const& scene, Ray ray);
+        // intersect
+        // The traversal keeps its stack in a fixed-size array on the call stack
+        // and does not modify the tree, therefore it is safe to intersect
+        // the same tree from multiple threads.
+        //
+        [[nodiscard]] Optional<Surface_Interaction> intersect(Scene const& scene, Ray ray) const override;
+
+        // occluded
+        // Traverses the tree like intersect, but stops at the first leaf with a primitive
+        // closer than max_distance.
+        //
+        [[nodiscard]] bool occluded(Scene const& scene, Ray ray, f32 max_distance) const override;
+
+        // intersect_packet
+        // Splits the rays into packets of ray_packet_width rays which traverse the tree
+        // together with SIMD while any of their rays is active. Packets whose rays do not
+        // share the signs of their directions visit the children in different orders and
+        // fall back to intersecting the rays one by one.
+        //
+        void intersect_packet(Scene const& scene, Slice<Ray const> rays, Slice<Optional<Surface_Interaction>> results) const override;
+
+        [[nodiscard]] i64 size_bytes() const override;
+
+        // write
+        // Serializes the built tree. The tree may be restored with read without rebuilding it.
+        //
+        void write(Output_Stream& stream) const;
+
+        // read
+        // Restores a tree serialized with write by the same build of the program.
+        //
+        // Parameters:
+        // scene - the scene the tree has been built over.
+        //
+        // Returns:
+        // false if the data is truncated, has been written with a different node layout
+        // or references nodes, primitives or packets that do not exist.
+        //
+        [[nodiscard]] bool read(Binary_Reader& reader, Scene const& scene);
+
+        // hash
+        // Hashes the layout of the nodes and the primitive indices.
+        // Trees built from the same scene with the same options have equal hashes.
+        //
+        [[nodiscard]] u64 hash() const;
     };
 } // namespace raytracing
@@ -2,7 +2,6 @@
 #include <anton/console.hpp>
 #include <anton/filesystem.hpp>
 #include <anton/format.hpp>
-#include <anton/import.hpp>
 #include <anton/intrinsics.hpp>
 #include <anton/iterators/range.hpp>
 #include <anton/iterators/zip.hpp>
@@ -11,176 +10,157 @@
 #include <anton/slice.hpp>
 #include <build_config.hpp>
 #include <camera.hpp>
+#include <counters.hpp>
 #include <filesystem.hpp>
-#include <intersections.hpp>
-#include <kd_tree.hpp>
+#include <image_writer.hpp>
+#include <instancing.hpp>
 #include <materials.hpp>
+#include <obj_loader.hpp>
 #include <random_engine.hpp>
+#include <renderer.hpp>
 #include <scene.hpp>
+#include <scene_cache.hpp>
+#include <transform.hpp>
 
 namespace raytracing {
-    struct Context {
-        Random_Engine* random_engine = nullptr;
-        i64 bounces = 0;
-        i64 samples = 0;
-    };
-
-    [[nodiscard]] static Optional<Surface_Interaction> intersect_scene(Scene const& scene, Ray const ray) {
-        bool hit = false;
-        Surface_Interaction result;
-        // Intersect spheres in the scene.
-        {
-            for(Sphere const& sphere: scene.spheres) {
-                Optional<Surface_Interaction> intersection_result = intersect_sphere(ray, sphere);
-                if(intersection_result && intersection_result < result.distance) {
-                    result = intersection_result.value();
-                    hit = true;
-                }
-            }
-        }
-        // Instersect triangles in the scene.
-        {
-            for(Triangle const& triangle: scene.triangles) {
-                Optional<Surface_Interaction> intersection_result = intersect_triangle(ray, triangle);
-                if(intersection_result && intersection_result->distance < result.distance) {
-                    result = intersection_result.value();
-                    hit = true;
-                }
-            }
-        }
-
-        if(hit) {
-            return result;
-        } else {
-            return anton::null_optional;
-        }
-    }
-
-    static Vec3 cast_ray(Context const& ctx, Scene const& scene, KD_Tree& tree, Ray const ray, i64 const bounce) {
-        if(bounce >= ctx.bounces) {
-            return Vec3{0.0f};
-        }
-
-        Optional<Surface_Interaction> const result = tree.intersect(scene, ray);
-        if(result) {
-            Optional<Scatter_Result> scatter_result = scatter(ctx.random_engine, ray, result->distance, result->normal, result->material);
-            if(scatter_result) {
-                Vec3 const color = cast_ray(ctx, scene, tree, scatter_result->ray, bounce + 1);
-                return scatter_result->attenuation * color;
-            } else {
-                return Vec3{0.0f};
-            }
-        }
-
-        // Sky gradient
-        f32 const t = 0.5f * (ray.direction.y + 1.0f);
-        return (1.0f - t) * Vec3{1.0f} + t * Vec3{0.5f, 0.7f, 1.0f};
-    }
-
-    [[nodiscard]] static Array<Vec3> render_scene(Context const& ctx, Scene const& scene, Camera const& camera, Camera_Target const& target) {
-        // TODO: The lookat code does not correctly handle camera target being positioned exactly above the camera.
-        Vec3 const camera_view = math::normalize(target.position - camera.position);
-        Vec3 const camera_right = math::normalize(math::cross(camera_view, Vec3{0.0f, 1.0f, 0.0f}));
-        Vec3 const camera_up = math::cross(camera_right, camera_view);
-        Mat3 const viewport_rotation{camera_right, camera_up, camera_view};
-        Vec3 const viewport_top_left = viewport_rotation * Vec3{-0.5f * camera.viewport_width, 0.5f * camera.viewport_height, camera.focal_length};
-
-        KD_Tree tree;
-        tree.build(scene, KD_Tree::Build_Options{.max_primitives = 16, .empty_bonus = 0.2f});
-
+    // write_heatmap
+    // Writes the values as a false colour image next to the rendered image.
+    //
+    static void write_heatmap(String_View const path, Slice<i64 const> const values, i64 const width, i64 const height) {
         Console_Output cout;
-        Array<Vec3> pixels{reserve, camera.image_width * camera.image_height};
-        i64 const samples_root = math::sqrt(ctx.samples);
-        for(i64 y = 0; y < camera.image_height; ++y) {
-            cout.write(format("processing row {}\n", y));
-            for(i64 x = 0; x < camera.image_width; ++x) {
-                Vec3& pixel = pixels.push_back(Vec3{0.0f});
-                for(i64 sample = 0; sample < samples_root * samples_root; ++sample) {
-                    f32 const u = (static_cast<f32>(x) + static_cast<f32>(sample % samples_root) / samples_root) / (camera.image_width - 1);
-                    f32 const v = (static_cast<f32>(y) + static_cast<f32>(sample / samples_root) / samples_root) / (camera.image_height - 1);
-                    Ray const ray{camera.position,
-                                  math::normalize(viewport_top_left + u * camera.viewport_width * camera_right - v * camera.viewport_height * camera_up)};
-                    Vec3 const color = cast_ray(ctx, scene, tree, ray, 0);
-                    pixel += color;
-                }
-                pixel /= samples_root * samples_root;
-                pixel.x = math::sqrt(pixel.x);
-                pixel.y = math::sqrt(pixel.y);
-                pixel.z = math::sqrt(pixel.z);
-            }
+        fs::Output_File_Stream stream(String{path});
+        if(!stream) {
+            cout.write(format("could not open {} for writing\n"_sv, path));
+            return;
         }
-        return pixels;
+
+        Array<Vec3> const colors = create_heatmap(values);
+        write_ppm_file(stream, colors, width, height);
     }
 
-    static int entry() {
+    // entry
+    //
+    // Parameters:
+    // pixel_costs - whether to write the costs of the pixels as heatmaps next to img.ppm.
+    //
+    static int entry(bool const pixel_costs) {
         Context ctx;
-        ctx.random_engine = create_random_engine(7849034);
+        ctx.seed = 7849034;
         ctx.bounces = 8;
         ctx.samples = 16;
+        // Most paths bouncing between the grey skulls and the ground carry little light after a few bounces.
+        ctx.russian_roulette = true;
 
         Camera camera{Vec3{2.0f, 2.0f, 5.0f}, 90.0f, 16.0f / 9.0f, 720};
         Camera_Target target{Vec3{0.0f, 0.0f, 0.0f}};
 
+        // The primitives placed directly in the world form a mesh with a single instance.
+        // The skulls instanced into the world use the materials of the world.
+        Scene world;
         Material green_diffuse{Vec3{0.8f, 0.8f, 0.0f}};
-        Handle<Material> green_diffuse_handle = create_material(green_diffuse);
+        Handle<Material> green_diffuse_handle = world.materials.create_material(green_diffuse);
         Material glass{Vec3{1.0f, 1.0f, 1.0f}, false, 0.0f, true, 1.4f};
-        Handle<Material> glass_handle = create_material(glass);
+        Handle<Material> glass_handle = world.materials.create_material(glass);
         Material red_metallic{Vec3{0.8f, 0.0f, 0.0f}, true, 0.0f};
-        Handle<Material> red_metallic_handle = create_material(red_metallic);
+        Handle<Material> red_metallic_handle = world.materials.create_material(red_metallic);
         Material green_metallic{Vec3{0.8f, 0.8f, 0.0f}, true, 0.5f};
-        Handle<Material> green_metallic_handle = create_material(green_metallic);
+        Handle<Material> green_metallic_handle = world.materials.create_material(green_metallic);
         Material grey_diffuse{Vec3{0.4f, 0.4f, 0.4f}};
-        Handle<Material> grey_diffuse_handle = create_material(grey_diffuse);
+        Handle<Material> grey_diffuse_handle = world.materials.create_material(grey_diffuse);
+        Material light{Vec3{0.0f}, false, 0.0f, false, 1.0f, Vec3{6.0f, 5.5f, 5.0f}};
+        Handle<Material> light_handle = world.materials.create_material(light);
 
-        // Import cube.
+        world.spheres.push_back(Sphere{Vec3{0.0f, -201.0f, -3.0f}, 200.0f, green_diffuse_handle});
+        world.spheres.push_back(Sphere{Vec3{-2.0f, 5.0f, 1.0f}, 1.0f, light_handle});
+        BVH world_bvh;
+        world_bvh.build(world, ctx.bvh_options);
+
+        // Import the mesh and build the tree unless the scene cache is up to date.
         Console_Output cout;
-        Expected<Array<u8>, String> file_read_result = read_file("./assets/skull.obj");
-        if(!file_read_result) {
-            cout.write(file_read_result.error());
+        Mapped_File source;
+        if(!source.open("./assets/skull.obj"_sv)) {
+            cout.write("could not map ./assets/skull.obj for reading\n"_sv);
             return -1;
         }
-        Expected<Array<anton::Mesh>, String> import_result = import_obj(file_read_result.value(), {});
-        if(!import_result) {
-            cout.write(import_result.error());
+
+        Scene skull;
+        KD_Tree tree;
+        String_View const cache_path = "skull.rtcache"_sv;
+        u64 const cache_key = calculate_scene_cache_key(source.data(), world.materials, grey_diffuse_handle, skull, ctx.kd_tree_options);
+        if(load_scene_cache(cache_path, cache_key, world.materials, skull, tree)) {
+            cout.write(format("Loaded {} triangles from {}\n"_sv, skull.triangles.size(), cache_path));
+        } else {
+            Expected<i64, String> load_result = parse_obj_mesh(source.data(), grey_diffuse_handle, skull, {});
+            if(!load_result) {
+                cout.write(format("./assets/skull.obj: {}\n"_sv, load_result.error()));
+                return -1;
+            }
+
+            cout.write(format("Added {} triangles\n"_sv, load_result.value()));
+            tree.build(skull, ctx.kd_tree_options);
+            if(!write_scene_cache(cache_path, cache_key, world.materials, skull, tree)) {
+                cout.write(format("could not write {}\n"_sv, cache_path));
+            }
+        }
+        source.close();
+
+        // A row of skulls sharing the vertices and the tree of a single mesh.
+        Mesh const meshes[] = {{&world, &world_bvh}, {&skull, &tree}};
+        Array<Instance> instances;
+        instances.push_back(Instance{0, Transform{}});
+        for(i64 i = -1; i <= 1; ++i) {
+            f32 const offset = static_cast<f32>(i);
+            Transform const placement = translate(Vec3{2.5f * offset, 0.0f, -1.5f * offset * offset});
+            instances.push_back(Instance{1, compose(placement, rotate(Vec3{0.0f, 1.0f, 0.0f}, -0.5f * offset))});
+        }
+
+        Instance_BVH instance_bvh;
+        instance_bvh.build(Slice<Mesh const>{meshes, 2}, instances, {});
+        ctx.prebuilt_acceleration_structure = &instance_bvh;
+
+        // The image is written to the file while the remaining tiles are being rendered.
+        Image_File_Writer writer;
+        if(!writer.open("img.ppm"_sv, Image_Format::ppm, camera.image_width, camera.image_height)) {
+            cout.write("could not open img.ppm for writing\n"_sv);
             return -1;
         }
 
-        Random_Engine* rnd = create_random_engine(100478823);
-        Scene scene;
-        for(anton::Mesh const& mesh: import_result.value()) {
-            cout.write(format("Adding mesh {} (indices: {})\n"_sv, mesh.name, mesh.indices.size()));
-            for(i64 i = 0; i < mesh.indices.size(); i += 3) {
-                Vec3 const v1 = mesh.vertices[mesh.indices[i]];
-                Vec3 const v2 = mesh.vertices[mesh.indices[i + 1]];
-                Vec3 const v3 = mesh.vertices[mesh.indices[i + 2]];
-                // TODO: Apply object-world transform here.
-                Triangle triangle{v1, v2, v3, grey_diffuse_handle};
-                scene.triangles.push_back(ANTON_MOV(triangle));
-            }
-            // f32 const x = random_f32(rnd, -2.0f, 2.0f);
-            // f32 const y = random_f32(rnd, -2.0f, 2.0f);
-            // f32 const z = random_f32(rnd, -2.0f, 2.0f);
-            // scene.mesh_transforms.push_back(Transform{Vec3{x, y, z}});
+        Pixel_Costs costs;
+        if(pixel_costs) {
+            ctx.pixel_costs = &costs;
+        }
+
+        Array<Vec3> const pixels = render_scene(ctx, world, camera, target, &writer);
+        if(!writer.finish()) {
+            cout.write("could not write img.ppm\n"_sv);
+            return -1;
+        }
+
+        if(pixel_costs) {
+            write_heatmap("img_cycles.ppm"_sv, costs.cycles, camera.image_width, camera.image_height);
+            write_heatmap("img_nodes.ppm"_sv, costs.nodes, camera.image_width, camera.image_height);
+            write_heatmap("img_primitives.ppm"_sv, costs.primitives, camera.image_width, camera.image_height);
+        }
+
+#if RT_COUNTERS
+        Counters const counters = get_counters();
+        print_counters(counters);
+        if(!write_counters_json("counters.json"_sv, counters)) {
+            cout.write("could not write counters.json\n"_sv);
         }
-        // Add spheres.
-        // scene.spheres.push_back(Sphere{1.0f, red_metallic_handle});
-        // scene.sphere_transforms.push_back(Transform{Vec3{-2.0f, 0.0f, -5.0f}});
-        // scene.spheres.push_back(Sphere{1.0f, green_metallic_handle});
-        // scene.sphere_transforms.push_back(Transform{Vec3{2.0f, 0.0f, -5.0f}});
-        // scene.spheres.push_back(Sphere{1.0f, green_diffuse_handle});
-        // scene.sphere_transforms.push_back(Transform{Vec3{0.0f, 0.0f, -5.0f}});
-        // scene.spheres.push_back(Sphere{0.5f, glass_handle});
-        // scene.sphere_transforms.push_back(Transform{Vec3{-1.0f, -0.5f, -3.0f}});
-        scene.spheres.push_back(Sphere{Vec3{0.0f, -201.0f, -3.0f}, 200.0f, green_diffuse_handle});
-
-        Array<Vec3> const pixels = render_scene(ctx, scene, camera, target);
-
-        fs::Output_File_Stream stream("img.ppm"_s);
-        write_ppm_file(stream, pixels, camera.image_width, camera.image_height);
+#endif
         return 0;
     }
 } // namespace raytracing
 
-int main() {
-    return raytracing::entry();
+int main(int argc, char** argv) {
+    using namespace raytracing;
+    // --pixel-costs writes img_cycles.ppm, img_nodes.ppm and img_primitives.ppm next to img.ppm.
+    bool pixel_costs = false;
+    for(int i = 1; i < argc; ++i) {
+        if(String_View{argv[i]} == "--pixel-costs"_sv) {
+            pixel_costs = true;
+        }
+    }
+    return entry(pixel_costs);
 }
@@ -1,19 +1,91 @@
 #include <anton/array.hpp>
 #include <anton/assert.hpp>
+#include <counters.hpp>
 #include <materials.hpp>
 
 namespace raytracing {
-    static Array<Material> materials;
+    Material_Store::Material_Store(Material_Store const& other) {
+        std::lock_guard<std::mutex> lock{other.mutex};
+        lambertian = other.lambertian;
+        metallic = other.metallic;
+        transmissive = other.transmissive;
+    }
+
+    Material_Store::Material_Store(Material_Store&& other) {
+        std::lock_guard<std::mutex> lock{other.mutex};
+        lambertian = ANTON_MOV(other.lambertian);
+        metallic = ANTON_MOV(other.metallic);
+        transmissive = ANTON_MOV(other.transmissive);
+    }
+
+    Material_Store& Material_Store::operator=(Material_Store const& other) {
+        if(this != &other) {
+            std::scoped_lock lock{mutex, other.mutex};
+            lambertian = other.lambertian;
+            metallic = other.metallic;
+            transmissive = other.transmissive;
+        }
+        return *this;
+    }
+
+    Material_Store& Material_Store::operator=(Material_Store&& other) {
+        if(this != &other) {
+            std::scoped_lock lock{mutex, other.mutex};
+            lambertian = ANTON_MOV(other.lambertian);
+            metallic = ANTON_MOV(other.metallic);
+            transmissive = ANTON_MOV(other.transmissive);
+        }
+        return *this;
+    }
+
+    [[nodiscard]] static Handle<Material> create_handle(Material_Kind const kind, i64 const index) {
+        return {(index << material_kind_bits) | static_cast<i64>(kind)};
+    }
+
+    Handle<Material> Material_Store::create_material(Material const& material) {
+        std::lock_guard<std::mutex> lock{mutex};
+        if(material.transmissive) {
+            transmissive.push_back(Transmissive_Material{material.albedo, material.ior, material.emission});
+            return create_handle(Material_Kind::transmissive, transmissive.size() - 1);
+        } else if(material.metallic) {
+            metallic.push_back(Metallic_Material{material.albedo, material.roughness, material.emission});
+            return create_handle(Material_Kind::metallic, metallic.size() - 1);
+        } else {
+            lambertian.push_back(Lambertian_Material{material.albedo, material.emission});
+            return create_handle(Material_Kind::lambertian, lambertian.size() - 1);
+        }
+    }
+
+    Material Material_Store::get_material(Handle<Material> const& handle) const {
+        switch(get_material_kind(handle)) {
+            case Material_Kind::lambertian: {
+                Lambertian_Material const& material = get_lambertian(handle);
+                return Material{material.albedo, false, 0.0f, false, 1.0f, material.emission};
+            }
+
+            case Material_Kind::metallic: {
+                Metallic_Material const& material = get_metallic(handle);
+                return Material{material.albedo, true, material.roughness, false, 1.0f, material.emission};
+            }
 
-    Handle<Material> create_material(Material const& material) {
-        i64 const index = materials.size();
-        materials.push_back(material);
-        return {index};
+            case Material_Kind::transmissive: {
+                Transmissive_Material const& material = get_transmissive(handle);
+                return Material{material.albedo, false, 0.0f, true, material.ior, material.emission};
+            }
+        }
+        return Material{};
     }
 
-    Material const& get_material(Handle<Material> const& handle) {
-        ANTON_ASSERT(handle.value < materials.size(), "invalid material handle");
-        return materials[handle.value];
+    Vec3 Material_Store::get_emission(Handle<Material> const& handle) const {
+        switch(get_material_kind(handle)) {
+            case Material_Kind::lambertian:
+                return get_lambertian(handle).emission;
+            case Material_Kind::metallic:
+                return get_metallic(handle).emission;
+            case Material_Kind::transmissive:
+                return get_transmissive(handle).emission;
+        }
+        return Vec3{0.0f};
     }
 
     static Vec3 reflect(Vec3 const incident, Vec3 const normal) {
@@ -35,43 +107,99 @@ namespace raytracing {
         }
     }
 
-    Optional<Scatter_Result> scatter(Random_Engine* const random_engine, Ray incident_ray, f32 distance, Vec3 normal, Handle<Material> const& handle) {
-        Material const& material = get_material(handle);
+    [[nodiscard]] static Scatter_Result scatter_transmissive(Transmissive_Material const& material, Ray const incident_ray, f32 const distance,
+                                                             Vec3 const normal) {
+        RT_COUNT(scatter_transmissive, 1);
         Vec3 const incident_point = incident_ray.origin + incident_ray.direction * distance;
-        if(material.transmissive) {
-            // Transmissive
-            f32 const cos_theta_incident = math::dot(incident_ray.direction, normal);
-            bool const front_facing = cos_theta_incident < 0.0f;
-            f32 const ior_ratio = front_facing ? 1.0f / material.ior : material.ior;
-            f32 const sin_theta_incident = math::sqrt(1.0f - cos_theta_incident * cos_theta_incident);
-            if(ior_ratio * sin_theta_incident > 1.0f) {
-                // Total Internal Reflection
-                Vec3 const reflected = reflect(incident_ray.direction, normal);
-                return Scatter_Result{Ray{incident_point, reflected}, material.albedo};
-            } else {
-                Vec3 const refracted = refract(incident_ray.direction, normal, ior_ratio);
-                return Scatter_Result{Ray{incident_point, refracted}, material.albedo};
-            }
-        } else if(material.metallic) {
-            // Metallic reflection
+        f32 const cos_theta_incident = math::dot(incident_ray.direction, normal);
+        bool const front_facing = cos_theta_incident < 0.0f;
+        f32 const ior_ratio = front_facing ? 1.0f / material.ior : material.ior;
+        f32 const sin_theta_incident = math::sqrt(1.0f - cos_theta_incident * cos_theta_incident);
+        if(ior_ratio * sin_theta_incident > 1.0f) {
+            // Total Internal Reflection
             Vec3 const reflected = reflect(incident_ray.direction, normal);
-            Vec3 const roughness = material.roughness * random_unit_vec3(random_engine);
-            if(math::dot(reflected + roughness, normal) > 0) {
-                Vec3 const rough_reflected = math::normalize(reflected + roughness);
-                return Scatter_Result{Ray{incident_point, rough_reflected}, material.albedo};
-            } else {
-                Vec3 const rough_reflected = math::normalize(reflected - roughness);
-                return Scatter_Result{Ray{incident_point, rough_reflected}, material.albedo};
-            }
+            return Scatter_Result{Ray{incident_point, reflected}, material.albedo};
         } else {
-            // Lambertian scatter
-            Vec3 const unit_vec = random_unit_vec3(random_engine);
-            Vec3 scatter_direction = math::normalize(unit_vec + normal);
-            if(math::is_almost_zero(scatter_direction)) {
-                scatter_direction = normal;
-            }
+            Vec3 const refracted = refract(incident_ray.direction, normal, ior_ratio);
+            return Scatter_Result{Ray{incident_point, refracted}, material.albedo};
+        }
+    }
+
+    [[nodiscard]] static Scatter_Result scatter_metallic(Metallic_Material const& material, Vec2 const sample, Ray const incident_ray, f32 const distance,
+                                                         Vec3 const normal) {
+        RT_COUNT(scatter_metallic, 1);
+        Vec3 const incident_point = incident_ray.origin + incident_ray.direction * distance;
+        Vec3 const reflected = reflect(incident_ray.direction, normal);
+        Vec3 const roughness = material.roughness * sample_unit_vec3(sample);
+        if(math::dot(reflected + roughness, normal) > 0) {
+            Vec3 const rough_reflected = math::normalize(reflected + roughness);
+            return Scatter_Result{Ray{incident_point, rough_reflected}, material.albedo};
+        } else {
+            Vec3 const rough_reflected = math::normalize(reflected - roughness);
+            return Scatter_Result{Ray{incident_point, rough_reflected}, material.albedo};
+        }
+    }
+
+    [[nodiscard]] static Scatter_Result scatter_lambertian(Lambertian_Material const& material, Vec2 const sample, Ray const incident_ray,
+                                                           f32 const distance, Vec3 const normal) {
+        RT_COUNT(scatter_lambertian, 1);
+        Vec3 const incident_point = incident_ray.origin + incident_ray.direction * distance;
+        Vec3 const scatter_direction = sample_cosine_hemisphere_vec3(sample, normal);
+        f32 const pdf = math::max(math::dot(scatter_direction, normal), 0.0f) / math::pi;
+        return Scatter_Result{Ray{incident_point, scatter_direction}, material.albedo, pdf};
+    }
+
+    Optional<Scatter_Result> scatter(Material_Store const& materials, Vec2 const sample, Ray const incident_ray, f32 const distance, Vec3 const normal,
+                                     Handle<Material> const& handle) {
+        switch(get_material_kind(handle)) {
+            case Material_Kind::lambertian:
+                return scatter_lambertian(materials.get_lambertian(handle), sample, incident_ray, distance, normal);
+            case Material_Kind::metallic:
+                return scatter_metallic(materials.get_metallic(handle), sample, incident_ray, distance, normal);
+            case Material_Kind::transmissive:
+                return scatter_transmissive(materials.get_transmissive(handle), incident_ray, distance, normal);
+        }
+        return null_optional;
+    }
+
+    void scatter_batch(Material_Store const& materials, Material_Kind const kind, Slice<Scatter_Query const> const queries,
+                       Slice<Optional<Scatter_Result>> const results) {
+        ANTON_ASSERT(queries.size() == results.size(), "the number of results does not match the number of queries");
+        // The branch on the kind is taken once for all queries.
+        switch(kind) {
+            case Material_Kind::lambertian: {
+                for(i64 i = 0; i < queries.size(); ++i) {
+                    Scatter_Query const& query = queries[i];
+                    Lambertian_Material const& material = materials.get_lambertian(query.material);
+                    results[i] = scatter_lambertian(material, query.sample, query.incident_ray, query.distance, query.normal);
+                }
+            } break;
+
+            case Material_Kind::metallic: {
+                for(i64 i = 0; i < queries.size(); ++i) {
+                    Scatter_Query const& query = queries[i];
+                    Metallic_Material const& material = materials.get_metallic(query.material);
+                    results[i] = scatter_metallic(material, query.sample, query.incident_ray, query.distance, query.normal);
+                }
+            } break;
+
+            case Material_Kind::transmissive: {
+                for(i64 i = 0; i < queries.size(); ++i) {
+                    Scatter_Query const& query = queries[i];
+                    Transmissive_Material const& material = materials.get_transmissive(query.material);
+                    results[i] = scatter_transmissive(material, query.incident_ray, query.distance, query.normal);
+                }
+            } break;
+        }
+    }
 
-            return Scatter_Result{Ray{incident_point, scatter_direction}, material.albedo};
+    Scatter_Evaluation evaluate_scatter(Material_Store const& materials, Vec3 const normal, Vec3 const direction, Handle<Material> const& handle) {
+        Lambertian_Material const& material = materials.get_lambertian(handle);
+        // Lambertian reflectance albedo / pi times the cosine, whose density under scatter is cosine / pi.
+        f32 const cos_theta = math::dot(direction, normal);
+        if(cos_theta <= 0.0f) {
+            return Scatter_Evaluation{Vec3{0.0f}, 0.0f};
         }
+        return Scatter_Evaluation{material.albedo * (cos_theta / math::pi), cos_theta / math::pi};
     }
 } // namespace raytracing
@@ -1,13 +1,22 @@
 #pragma once
 
+#include <anton/array.hpp>
+#include <anton/assert.hpp>
 #include <anton/math/primitives.hpp>
 #include <anton/math/vec3.hpp>
 #include <anton/optional.hpp>
+#include <anton/slice.hpp>
 #include <build_config.hpp>
 #include <handle.hpp>
 #include <random_engine.hpp>
 
+#include <mutex>
+
 namespace raytracing {
+    // Material
+    // Description of a material. The store keeps only the properties of its kind,
+    // which is transmissive if transmissive is set, metallic if metallic is set and lambertian otherwise.
+    //
     struct Material {
         Vec3 albedo;
         bool metallic = false;
@@ -16,17 +25,159 @@ namespace raytracing {
         bool transmissive = false;
         // Index of refraction
         f32 ior = 1.0f;
+        // Radiance emitted by the surface. Spheres with emissive materials are sampled
+        // explicitly as lights by the integrators.
+        Vec3 emission{0.0f, 0.0f, 0.0f};
+    };
+
+    [[nodiscard]] inline bool is_emissive(Vec3 const emission) {
+        return emission.x > 0.0f || emission.y > 0.0f || emission.z > 0.0f;
+    }
+
+    [[nodiscard]] inline bool is_emissive(Material const& material) {
+        return is_emissive(material.emission);
+    }
+
+    // Kinds of materials. Every kind is stored in its own table of a Material_Store.
+    enum struct Material_Kind : i64 {
+        lambertian,
+        metallic,
+        transmissive,
+    };
+
+    constexpr i64 material_kind_count = 3;
+    // The kind of a material is stored in the lowest bits of the value of its handle
+    // and the index into the table of the kind in the remaining bits.
+    constexpr i64 material_kind_bits = 2;
+
+    [[nodiscard]] inline Material_Kind get_material_kind(Handle<Material> const& handle) {
+        return static_cast<Material_Kind>(handle.value & ((1 << material_kind_bits) - 1));
+    }
+
+    struct Lambertian_Material {
+        Vec3 albedo;
+        Vec3 emission;
+    };
+
+    struct Metallic_Material {
+        Vec3 albedo;
+        f32 roughness;
+        Vec3 emission;
+    };
+
+    struct Transmissive_Material {
+        Vec3 albedo;
+        f32 ior;
+        Vec3 emission;
     };
 
-    [[nodiscard]] Handle<Material> create_material(Material const& material);
-    [[nodiscard]] Material const& get_material(Handle<Material> const& handle);
+    // Material_Store
+    // The materials of a scene split into one table per kind, so that the shading of many hits
+    // of one kind reads only the properties of that kind. Handles are never invalidated.
+    // Materials may be created by several threads at once. Reading does not lock, hence
+    // materials must not be created while the store is being read, e.g. during rendering.
+    //
+    struct Material_Store {
+    private:
+        Array<Lambertian_Material> lambertian;
+        Array<Metallic_Material> metallic;
+        Array<Transmissive_Material> transmissive;
+        // Serializes the creation of materials.
+        mutable std::mutex mutex;
+
+    public:
+        Material_Store() = default;
+        // The mutex is not copied, the tables of other are copied or moved while holding its lock.
+        Material_Store(Material_Store const& other);
+        Material_Store(Material_Store&& other);
+        Material_Store& operator=(Material_Store const& other);
+        Material_Store& operator=(Material_Store&& other);
+        ~Material_Store() = default;
+
+        [[nodiscard]] Handle<Material> create_material(Material const& material);
+
+        // get_material
+        //
+        // Returns:
+        // The description the material has been created from.
+        //
+        [[nodiscard]] Material get_material(Handle<Material> const& handle) const;
+
+        [[nodiscard]] Vec3 get_emission(Handle<Material> const& handle) const;
+
+        [[nodiscard]] Lambertian_Material const& get_lambertian(Handle<Material> const& handle) const {
+            ANTON_ASSERT(get_material_kind(handle) == Material_Kind::lambertian, "material is not lambertian");
+            ANTON_ASSERT((handle.value >> material_kind_bits) < lambertian.size(), "invalid material handle");
+            return lambertian[handle.value >> material_kind_bits];
+        }
+
+        [[nodiscard]] Metallic_Material const& get_metallic(Handle<Material> const& handle) const {
+            ANTON_ASSERT(get_material_kind(handle) == Material_Kind::metallic, "material is not metallic");
+            ANTON_ASSERT((handle.value >> material_kind_bits) < metallic.size(), "invalid material handle");
+            return metallic[handle.value >> material_kind_bits];
+        }
+
+        [[nodiscard]] Transmissive_Material const& get_transmissive(Handle<Material> const& handle) const {
+            ANTON_ASSERT(get_material_kind(handle) == Material_Kind::transmissive, "material is not transmissive");
+            ANTON_ASSERT((handle.value >> material_kind_bits) < transmissive.size(), "invalid material handle");
+            return transmissive[handle.value >> material_kind_bits];
+        }
+    };
 
     struct Scatter_Result {
         // Scattered ray
         Ray ray;
         // Attenuation
         Vec3 attenuation;
+        // Density of the direction of the scattered ray with respect to the solid angle.
+        // 0 if the material scatters in a single direction or the density is not known,
+        // in which case the light arriving at the surface is not sampled explicitly.
+        f32 pdf = 0.0f;
+    };
+
+    struct Scatter_Evaluation {
+        // Reflectance times the cosine of the angle between the direction and the normal.
+        Vec3 value;
+        // Density of the direction when sampled by scatter.
+        f32 pdf;
     };
 
-    [[nodiscard]] Optional<Scatter_Result> scatter(Random_Engine* random_engine, Ray incident_ray, f32 distance, Vec3 normal, Handle<Material> const& material);
+    // scatter
+    // Scatters a single ray off a material of any kind.
+    //
+    // Parameters:
+    // sample - a point uniformly distributed in [0, 1)^2 which determines the scattered direction.
+    //
+    [[nodiscard]] Optional<Scatter_Result> scatter(Material_Store const& materials, Vec2 sample, Ray incident_ray, f32 distance, Vec3 normal,
+                                                   Handle<Material> const& material);
+
+    // Scatter_Query
+    // A ray that hit a surface waiting to be scattered by scatter_batch.
+    //
+    struct Scatter_Query {
+        Ray incident_ray;
+        Vec3 normal;
+        f32 distance;
+        Handle<Material> material;
+        // A point uniformly distributed in [0, 1)^2 which determines the scattered direction.
+        Vec2 sample;
+    };
+
+    // scatter_batch
+    // Scatters the rays of the queries in a loop specialized for a single kind of material.
+    //
+    // Parameters:
+    //    kind - the kind of the materials of all queries.
+    // results - receives the result of every query. Must have the size of queries.
+    //
+    void scatter_batch(Material_Store const& materials, Material_Kind kind, Slice<Scatter_Query const> queries, Slice<Optional<Scatter_Result>> results);
+
+    // evaluate_scatter
+    // Evaluates the scattering of the light arriving from direction into the incident ray.
+    // Only materials for which scatter reports a non-zero pdf may be evaluated.
+    //
+    // Parameters:
+    // direction - normalized direction towards the source of the light.
+    //
+    [[nodiscard]] Scatter_Evaluation evaluate_scatter(Material_Store const& materials, Vec3 normal, Vec3 direction, Handle<Material> const& material);
 } // namespace raytracing
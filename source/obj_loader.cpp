@@ -0,0 +1,417 @@
+#include <obj_loader.hpp>
+
+#include <anton/format.hpp>
+#include <anton/math/math.hpp>
+#include <counters.hpp>
+#include <filesystem.hpp>
+#include <scheduler.hpp>
+
+#include <cstring>
+
+namespace raytracing {
+    // A range of whole lines of the file parsed by a single task.
+    struct Obj_Chunk {
+        char const* begin;
+        char const* end;
+        i64 lines = 0;
+        i64 vertices = 0;
+        i64 triangles = 0;
+        // Number of the lines, the vertices and the triangles in the preceding chunks.
+        i64 first_line = 0;
+        i64 first_vertex = 0;
+        i64 first_triangle = 0;
+        // Index of the first malformed line within the chunk or -1 if the chunk is well-formed.
+        i64 error_line = -1;
+        String_View error;
+    };
+
+    enum struct Obj_Statement {
+        vertex,
+        face,
+        other,
+    };
+
+    [[nodiscard]] static bool is_blank(char const c) {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    [[nodiscard]] static bool is_digit(char const c) {
+        return c >= '0' && c <= '9';
+    }
+
+    [[nodiscard]] static char const* skip_blanks(char const* cursor, char const* const end) {
+        while(cursor != end && is_blank(*cursor)) {
+            ++cursor;
+        }
+        return cursor;
+    }
+
+    [[nodiscard]] static char const* skip_token(char const* cursor, char const* const end) {
+        while(cursor != end && !is_blank(*cursor)) {
+            ++cursor;
+        }
+        return cursor;
+    }
+
+    // find_line_end
+    //
+    // Returns:
+    // Pointer to the newline terminating the line starting at cursor or end if there is none.
+    //
+    [[nodiscard]] static char const* find_line_end(char const* const cursor, char const* const end) {
+        void const* const newline = memchr(cursor, '\n', end - cursor);
+        return newline != nullptr ? static_cast<char const*>(newline) : end;
+    }
+
+    // parse_statement
+    // Identifies the statement of the line and advances cursor past its keyword.
+    //
+    [[nodiscard]] static Obj_Statement parse_statement(char const*& cursor, char const* const line_end) {
+        cursor = skip_blanks(cursor, line_end);
+        if(line_end - cursor >= 2 && is_blank(cursor[1])) {
+            if(cursor[0] == 'v') {
+                cursor += 2;
+                return Obj_Statement::vertex;
+            }
+
+            if(cursor[0] == 'f') {
+                cursor += 2;
+                return Obj_Statement::face;
+            }
+        }
+        return Obj_Statement::other;
+    }
+
+    // parse_f32
+    // Parses a decimal floating point number with an optional exponent. The digits are
+    // accumulated into an integer mantissa which is scaled once by a power of 10.
+    //
+    [[nodiscard]] static bool parse_f32(char const*& cursor, char const* const end, f32& value) {
+        constexpr f64 powers_of_10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+        // Digits beyond the precision of the mantissa only change the exponent.
+        constexpr u64 mantissa_limit = 100000000000000000ULL;
+
+        char const* c = cursor;
+        bool negative = false;
+        if(c != end && (*c == '-' || *c == '+')) {
+            negative = (*c == '-');
+            ++c;
+        }
+
+        u64 mantissa = 0;
+        i64 exponent = 0;
+        i64 digits = 0;
+        for(; c != end && is_digit(*c); ++c, ++digits) {
+            if(mantissa < mantissa_limit) {
+                mantissa = mantissa * 10 + (*c - '0');
+            } else {
+                exponent += 1;
+            }
+        }
+
+        if(c != end && *c == '.') {
+            ++c;
+            for(; c != end && is_digit(*c); ++c, ++digits) {
+                if(mantissa < mantissa_limit) {
+                    mantissa = mantissa * 10 + (*c - '0');
+                    exponent -= 1;
+                }
+            }
+        }
+
+        if(digits == 0) {
+            return false;
+        }
+
+        if(c != end && (*c == 'e' || *c == 'E')) {
+            ++c;
+            bool negative_exponent = false;
+            if(c != end && (*c == '-' || *c == '+')) {
+                negative_exponent = (*c == '-');
+                ++c;
+            }
+
+            if(c == end || !is_digit(*c)) {
+                return false;
+            }
+
+            i64 explicit_exponent = 0;
+            for(; c != end && is_digit(*c); ++c) {
+                if(explicit_exponent < 10000) {
+                    explicit_exponent = explicit_exponent * 10 + (*c - '0');
+                }
+            }
+            exponent += (negative_exponent ? -explicit_exponent : explicit_exponent);
+        }
+
+        if(c != end && !is_blank(*c)) {
+            return false;
+        }
+
+        f64 result = static_cast<f64>(mantissa);
+        if(exponent < 0) {
+            for(; exponent < -22 && result != 0.0; exponent += 22) {
+                result /= 1e22;
+            }
+            result /= powers_of_10[math::min(-exponent, (i64)22)];
+        } else {
+            for(; exponent > 22 && result != 0.0; exponent -= 22) {
+                result *= 1e22;
+            }
+            result *= powers_of_10[math::min(exponent, (i64)22)];
+        }
+
+        value = static_cast<f32>(negative ? -result : result);
+        cursor = c;
+        return true;
+    }
+
+    // parse_vertex_index
+    // Parses the vertex index of a face vertex and skips its texture coordinate and normal indices.
+    //
+    [[nodiscard]] static bool parse_vertex_index(char const*& cursor, char const* const end, i64& index) {
+        char const* c = cursor;
+        bool negative = false;
+        if(c != end && (*c == '-' || *c == '+')) {
+            negative = (*c == '-');
+            ++c;
+        }
+
+        if(c == end || !is_digit(*c)) {
+            return false;
+        }
+
+        i64 value = 0;
+        for(; c != end && is_digit(*c); ++c) {
+            if(value < (i64(1) << 48)) {
+                value = value * 10 + (*c - '0');
+            }
+        }
+
+        if(c != end && *c != '/' && !is_blank(*c)) {
+            return false;
+        }
+
+        index = (negative ? -value : value);
+        cursor = skip_token(c, end);
+        return true;
+    }
+
+    static void set_chunk_error(Obj_Chunk& chunk, i64 const line, String_View const error) {
+        chunk.error_line = line;
+        chunk.error = error;
+    }
+
+    // count_chunk
+    // Counts the lines, the vertices and the triangles of the chunk.
+    //
+    static void count_chunk(Obj_Chunk& chunk) {
+        for(char const* line = chunk.begin; line != chunk.end; chunk.lines += 1) {
+            char const* const line_end = find_line_end(line, chunk.end);
+            char const* cursor = line;
+            Obj_Statement const statement = parse_statement(cursor, line_end);
+            if(statement == Obj_Statement::vertex) {
+                chunk.vertices += 1;
+            } else if(statement == Obj_Statement::face) {
+                i64 face_vertices = 0;
+                for(cursor = skip_blanks(cursor, line_end); cursor != line_end; cursor = skip_blanks(cursor, line_end)) {
+                    cursor = skip_token(cursor, line_end);
+                    face_vertices += 1;
+                }
+
+                if(face_vertices < 3) {
+                    set_chunk_error(chunk, chunk.lines, "face has fewer than 3 vertices"_sv);
+                    return;
+                }
+
+                chunk.triangles += face_vertices - 2;
+            }
+            line = (line_end != chunk.end ? line_end + 1 : line_end);
+        }
+    }
+
+    // parse_chunk_vertices
+    // Parses the vertices of the chunk into vertices starting at chunk.first_vertex.
+    //
+    static void parse_chunk_vertices(Obj_Chunk& chunk, Vec3* const vertices) {
+        Vec3* vertex = vertices + chunk.first_vertex;
+        i64 line_index = 0;
+        for(char const* line = chunk.begin; line != chunk.end; line_index += 1) {
+            char const* const line_end = find_line_end(line, chunk.end);
+            char const* cursor = line;
+            if(parse_statement(cursor, line_end) == Obj_Statement::vertex) {
+                // The optional w component and vertex colors that follow the position are ignored.
+                f32 coordinates[3];
+                for(f32& coordinate: coordinates) {
+                    cursor = skip_blanks(cursor, line_end);
+                    if(!parse_f32(cursor, line_end, coordinate)) {
+                        set_chunk_error(chunk, line_index, "invalid vertex position"_sv);
+                        return;
+                    }
+                }
+
+                *vertex = Vec3{coordinates[0], coordinates[1], coordinates[2]};
+                ++vertex;
+            }
+            line = (line_end != chunk.end ? line_end + 1 : line_end);
+        }
+    }
+
+    // parse_chunk_faces
+    // Triangulates the faces of the chunk into triangles starting at chunk.first_triangle.
+    //
+    // Parameters:
+    //  vertex_count - number of the vertices of the file.
+    // vertex_offset - index of the first vertex of the file in the vertex buffer.
+    //
+    static void parse_chunk_faces(Obj_Chunk& chunk, i64 const vertex_count, u32 const vertex_offset, u32 const material, Indexed_Triangle* const triangles) {
+        Indexed_Triangle* triangle = triangles + chunk.first_triangle;
+        // Negative indices are relative to the vertices defined so far.
+        i64 defined_vertices = chunk.first_vertex;
+        i64 line_index = 0;
+        for(char const* line = chunk.begin; line != chunk.end; line_index += 1) {
+            char const* const line_end = find_line_end(line, chunk.end);
+            char const* cursor = line;
+            Obj_Statement const statement = parse_statement(cursor, line_end);
+            if(statement == Obj_Statement::vertex) {
+                defined_vertices += 1;
+            } else if(statement == Obj_Statement::face) {
+                u32 first = 0;
+                u32 previous = 0;
+                i64 face_vertices = 0;
+                for(cursor = skip_blanks(cursor, line_end); cursor != line_end; cursor = skip_blanks(cursor, line_end)) {
+                    i64 index = 0;
+                    if(!parse_vertex_index(cursor, line_end, index)) {
+                        set_chunk_error(chunk, line_index, "invalid face vertex"_sv);
+                        return;
+                    }
+
+                    i64 const resolved_index = (index > 0 ? index - 1 : defined_vertices + index);
+                    if(index == 0 || resolved_index < 0 || resolved_index >= vertex_count) {
+                        set_chunk_error(chunk, line_index, "face vertex index out of range"_sv);
+                        return;
+                    }
+
+                    u32 const vertex = vertex_offset + static_cast<u32>(resolved_index);
+                    if(face_vertices == 0) {
+                        first = vertex;
+                    } else if(face_vertices >= 2) {
+                        *triangle = Indexed_Triangle{first, previous, vertex, material};
+                        ++triangle;
+                    }
+                    previous = vertex;
+                    face_vertices += 1;
+                }
+            }
+            line = (line_end != chunk.end ? line_end + 1 : line_end);
+        }
+    }
+
+    // find_chunk_error
+    //
+    // Returns:
+    // The chunk containing the first malformed line of the file or nullptr.
+    //
+    [[nodiscard]] static Obj_Chunk const* find_chunk_error(Slice<Obj_Chunk const> const chunks) {
+        for(Obj_Chunk const& chunk: chunks) {
+            if(chunk.error_line != -1) {
+                return &chunk;
+            }
+        }
+        return nullptr;
+    }
+
+    [[nodiscard]] static String format_chunk_error(Obj_Chunk const& chunk) {
+        return format("line {}: {}"_sv, chunk.first_line + chunk.error_line + 1, chunk.error);
+    }
+
+    Expected<i64, String> parse_obj_mesh(Slice<u8 const> const source, Handle<Material> const material, Scene& scene, Obj_Load_Options const& options) {
+        RT_SCOPED_TIMER(import);
+        // Split the file into chunks ending right after a newline.
+        char const* const data = reinterpret_cast<char const*>(source.data());
+        char const* const data_end = data + source.size();
+        i64 const chunk_size = math::max(options.chunk_size, (i64)1);
+        i64 const nominal_chunks = math::max((source.size() + chunk_size - 1) / chunk_size, (i64)1);
+        Array<Obj_Chunk> chunks{reserve, nominal_chunks};
+        for(char const* begin = data; begin != data_end;) {
+            char const* const nominal_end = data + source.size() * (chunks.size() + 1) / nominal_chunks;
+            char const* end = find_line_end(nominal_end > begin ? nominal_end : begin, data_end);
+            end = (end != data_end ? end + 1 : end);
+            chunks.push_back(Obj_Chunk{begin, end});
+            begin = end;
+        }
+
+        if(chunks.size() == 0) {
+            return {expected_value, 0};
+        }
+
+        i64 const threads = (options.threads > 0 ? options.threads : get_hardware_concurrency());
+        i64 const workers = math::min(threads, chunks.size());
+        auto count_task = [&chunks](i64 const, i64 const task) { count_chunk(chunks[task]); };
+        (void)execute_tasks(workers, chunks.size(), count_task);
+
+        i64 vertex_count = 0;
+        i64 triangle_count = 0;
+        i64 line_count = 0;
+        for(Obj_Chunk& chunk: chunks) {
+            chunk.first_line = line_count;
+            chunk.first_vertex = vertex_count;
+            chunk.first_triangle = triangle_count;
+            line_count += chunk.lines;
+            vertex_count += chunk.vertices;
+            triangle_count += chunk.triangles;
+        }
+
+        if(Obj_Chunk const* const chunk = find_chunk_error(chunks)) {
+            return {expected_error, format_chunk_error(*chunk)};
+        }
+
+        i64 const first_vertex = scene.vertices.size();
+        if(first_vertex + vertex_count > 0xFFFFFFFF) {
+            return {expected_error, String{"the number of vertices exceeds the range of the indices"_sv}};
+        }
+
+        // The faces may reference vertices of any chunk, therefore all vertices are parsed
+        // before the faces. Both are parsed directly into the buffers of the scene.
+        scene.vertices.ensure_capacity(first_vertex + vertex_count);
+        scene.vertices.force_size(first_vertex + vertex_count);
+        Vec3* const vertices = scene.vertices.data() + first_vertex;
+        auto vertices_task = [&chunks, vertices](i64 const, i64 const task) { parse_chunk_vertices(chunks[task], vertices); };
+        (void)execute_tasks(workers, chunks.size(), vertices_task);
+        if(Obj_Chunk const* const chunk = find_chunk_error(chunks)) {
+            scene.vertices.force_size(first_vertex);
+            return {expected_error, format_chunk_error(*chunk)};
+        }
+
+        i64 const first_triangle = scene.triangles.size();
+        scene.triangles.ensure_capacity(first_triangle + triangle_count);
+        scene.triangles.force_size(first_triangle + triangle_count);
+        Indexed_Triangle* const triangles = scene.triangles.data() + first_triangle;
+        u32 const material_value = static_cast<u32>(material.value);
+        auto faces_task = [&chunks, vertex_count, first_vertex, material_value, triangles](i64 const, i64 const task) {
+            parse_chunk_faces(chunks[task], vertex_count, static_cast<u32>(first_vertex), material_value, triangles);
+        };
+        (void)execute_tasks(workers, chunks.size(), faces_task);
+        if(Obj_Chunk const* const chunk = find_chunk_error(chunks)) {
+            scene.vertices.force_size(first_vertex);
+            scene.triangles.force_size(first_triangle);
+            return {expected_error, format_chunk_error(*chunk)};
+        }
+
+        return {expected_value, triangle_count};
+    }
+
+    Expected<i64, String> load_obj_mesh(String_View const path, Handle<Material> const material, Scene& scene, Obj_Load_Options const& options) {
+        Mapped_File file;
+        if(!file.open(path)) {
+            return {expected_error, format("could not map file \"{}\" for reading"_sv, path)};
+        }
+
+        Expected<i64, String> result = parse_obj_mesh(file.data(), material, scene, options);
+        if(!result) {
+            return {expected_error, format("{}: {}"_sv, path, result.error())};
+        }
+        return ANTON_MOV(result);
+    }
+} // namespace raytracing
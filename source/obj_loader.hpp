@@ -0,0 +1,47 @@
+#pragma once
+
+#include <anton/array.hpp>
+#include <anton/expected.hpp>
+#include <anton/slice.hpp>
+#include <anton/string.hpp>
+#include <build_config.hpp>
+#include <handle.hpp>
+#include <materials.hpp>
+#include <scene.hpp>
+
+namespace raytracing {
+    struct Obj_Load_Options {
+        // Number of threads to parse the file with. If threads is set to 0,
+        // one thread per hardware thread will be used. The loaded triangles
+        // do not depend on the number of threads.
+        i64 threads = 0;
+        // Approximate size of the chunks of the file parsed by a single task in bytes.
+        i64 chunk_size = 1 << 20;
+    };
+
+    // parse_obj_mesh
+    // Parses the vertices and the faces of an OBJ file into the vertex buffer and the triangles
+    // of the scene. Polygonal faces are triangulated as fans. All other statements, including
+    // objects, groups, texture coordinates and normals, are ignored, hence all meshes of the file
+    // are merged. The file is split into chunks of whole lines which are parsed in parallel in
+    // three passes: the first one counts the vertices and the triangles of every chunk, the second
+    // one parses the vertices and the third one the faces directly into their final positions in
+    // the buffers of the scene.
+    //
+    // Parameters:
+    //   source - contents of the OBJ file.
+    // material - material of the triangles.
+    //    scene - receives the vertices and the triangles. They are appended after the existing ones.
+    //
+    // Returns:
+    // The number of the appended triangles or a description of the first malformed line.
+    // scene is left unchanged on failure.
+    //
+    [[nodiscard]] Expected<i64, String> parse_obj_mesh(Slice<u8 const> source, Handle<Material> material, Scene& scene, Obj_Load_Options const& options);
+
+    // load_obj_mesh
+    // Maps the OBJ file at path into memory and parses it with parse_obj_mesh without
+    // copying the contents of the file.
+    //
+    [[nodiscard]] Expected<i64, String> load_obj_mesh(String_View path, Handle<Material> material, Scene& scene, Obj_Load_Options const& options);
+} // namespace raytracing
@@ -12,10 +12,26 @@ namespace raytracing {
         Handle<Material> material;
     };
 
+    // Triangle
+    // Triangle with the positions of its vertices stored by value.
+    //
     struct Triangle {
         Vec3 v1;
         Vec3 v2;
         Vec3 v3;
         Handle<Material> material;
     };
+
+    // Indexed_Triangle
+    // Triangle referencing its vertices in the vertex buffer of the scene. The vertices
+    // shared by neighbouring triangles are stored once, hence a triangle of a closed mesh
+    // takes 16 bytes plus about half of a vertex instead of the 48 bytes of Triangle.
+    //
+    struct Indexed_Triangle {
+        u32 v1;
+        u32 v2;
+        u32 v3;
+        // Value of the handle of the material.
+        u32 material;
+    };
 } // namespace raytracing
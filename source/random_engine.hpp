@@ -1,13 +1,187 @@
 #pragma once
 
+#include <anton/math/math.hpp>
 #include <build_config.hpp>
 
 namespace raytracing {
-    struct Random_Engine;
+    // Random_Engine
+    // PCG32 generator (XSH RR output of a 64-bit LCG). The state is small enough to create
+    // an engine per sample, which keeps the random numbers of a sample independent of the
+    // thread rendering it and of the order in which the samples are rendered.
+    //
+    struct Random_Engine {
+        u64 state;
+        // Selects one of 2^63 sequences. Always odd.
+        u64 increment;
+    };
 
-    [[nodiscard]] Random_Engine* create_random_engine(i64 seed);
-    void destroy_random_engine(Random_Engine* engine);
+    // mix_u64
+    // The finalizer of splitmix64. Maps similar values, e.g. consecutive indices, to unrelated ones.
+    //
+    [[nodiscard]] inline u64 mix_u64(u64 value) {
+        value += 0x9E3779B97F4A7C15ULL;
+        value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+        return value ^ (value >> 31);
+    }
 
-    [[nodiscard]] f32 random_f32(Random_Engine* engine, f32 min, f32 max);
-    [[nodiscard]] Vec3 random_unit_vec3(Random_Engine* engine);
+    [[nodiscard]] inline u32 random_u32(Random_Engine& engine) {
+        u64 const state = engine.state;
+        engine.state = state * 6364136223846793005ULL + engine.increment;
+        u32 const xorshifted = static_cast<u32>(((state >> 18) ^ state) >> 27);
+        u32 const rotation = static_cast<u32>(state >> 59);
+        return (xorshifted >> rotation) | (xorshifted << ((-rotation) & 31));
+    }
+
+    // create_random_engine
+    //
+    // Parameters:
+    //   seed - seed of the engine.
+    // stream - index of the sequence. Engines with the same seed and different streams
+    //          produce independent sequences.
+    //
+    [[nodiscard]] inline Random_Engine create_random_engine(u64 const seed, u64 const stream = 0) {
+        Random_Engine engine{0, (mix_u64(stream ^ mix_u64(seed)) << 1) | 1};
+        (void)random_u32(engine);
+        engine.state += mix_u64(seed + stream);
+        (void)random_u32(engine);
+        return engine;
+    }
+
+    // random_f32
+    //
+    // Returns:
+    // A uniformly distributed number in [0, 1) with a resolution of 2^-24.
+    //
+    [[nodiscard]] inline f32 random_f32(Random_Engine& engine) {
+        return static_cast<f32>(random_u32(engine) >> 8) * 0x1.0p-24f;
+    }
+
+    // random_f32
+    //
+    // Returns:
+    // A uniformly distributed number in [min, max).
+    //
+    [[nodiscard]] inline f32 random_f32(Random_Engine& engine, f32 const min, f32 const max) {
+        return min + (max - min) * random_f32(engine);
+    }
+
+    // sample_unit_vec3
+    //
+    // Parameters:
+    // sample - a point uniformly distributed in [0, 1)^2.
+    //
+    // Returns:
+    // A direction uniformly distributed on the unit sphere.
+    //
+    [[nodiscard]] inline Vec3 sample_unit_vec3(Vec2 const sample) {
+        // By Archimedes' hat-box theorem z is uniform when the directions are uniform.
+        f32 const z = 1.0f - 2.0f * sample.x;
+        f32 const phi = 2.0f * math::pi * sample.y;
+        f32 const r = math::sqrt(math::max(0.0f, 1.0f - z * z));
+        return Vec3{r * math::cos(phi), r * math::sin(phi), z};
+    }
+
+    // sample_hemisphere_vec3
+    //
+    // Parameters:
+    // sample - a point uniformly distributed in [0, 1)^2.
+    //
+    // Returns:
+    // A direction uniformly distributed on the unit hemisphere around normal.
+    //
+    [[nodiscard]] inline Vec3 sample_hemisphere_vec3(Vec2 const sample, Vec3 const normal) {
+        // Mirror the directions below the surface to the other side instead of branching.
+        Vec3 const direction = sample_unit_vec3(sample);
+        return direction - 2.0f * math::min(0.0f, math::dot(direction, normal)) * normal;
+    }
+
+    // sample_cosine_hemisphere_vec3
+    //
+    // Parameters:
+    // sample - a point uniformly distributed in [0, 1)^2.
+    //
+    // Returns:
+    // A direction distributed on the unit hemisphere around normal with the density
+    // proportional to the cosine of the angle to the normal.
+    //
+    [[nodiscard]] inline Vec3 sample_cosine_hemisphere_vec3(Vec2 const sample, Vec3 const normal) {
+        // Normalized sums of the normal and uniform directions are cosine distributed.
+        // The sum vanishes only when the direction is exactly opposite to the normal.
+        Vec3 const sum = normal + sample_unit_vec3(sample);
+        f32 const length_squared = math::dot(sum, sum);
+        return length_squared > 1e-12f ? sum / math::sqrt(length_squared) : normal;
+    }
+
+    // sample_cone_vec3
+    //
+    // Parameters:
+    //                  sample - a point uniformly distributed in [0, 1)^2.
+    //                    axis - normalized axis of the cone.
+    // one_minus_cos_theta_max - 1 minus the cosine of the half-angle of the cone.
+    //
+    // Returns:
+    // A direction uniformly distributed in the solid angle of the cone.
+    //
+    [[nodiscard]] inline Vec3 sample_cone_vec3(Vec2 const sample, Vec3 const axis, f32 const one_minus_cos_theta_max) {
+        // The cosine is uniform in [cos_max, 1]. 1 - cos^2 is factored to keep narrow cones accurate.
+        f32 const one_minus_cos_theta = sample.x * one_minus_cos_theta_max;
+        f32 const cos_theta = 1.0f - one_minus_cos_theta;
+        f32 const sin_theta = math::sqrt(math::max(0.0f, one_minus_cos_theta * (2.0f - one_minus_cos_theta)));
+        f32 const phi = 2.0f * math::pi * sample.y;
+        // Orthonormal basis around the axis without branches on the axis except its sign (Duff et al.).
+        f32 const sign = (axis.z >= 0.0f ? 1.0f : -1.0f);
+        f32 const a = -1.0f / (sign + axis.z);
+        f32 const b = axis.x * axis.y * a;
+        Vec3 const tangent{1.0f + sign * axis.x * axis.x * a, sign * b, -sign * axis.x};
+        Vec3 const bitangent{b, sign + axis.y * axis.y * a, -axis.y};
+        return tangent * (sin_theta * math::cos(phi)) + bitangent * (sin_theta * math::sin(phi)) + axis * cos_theta;
+    }
+
+    // sample_unit_disk
+    // Maps the square onto the disk with Shirley's concentric mapping, which keeps
+    // neighbouring points together and therefore preserves the stratification of the samples.
+    //
+    // Parameters:
+    // sample - a point uniformly distributed in [0, 1)^2.
+    //
+    // Returns:
+    // A point uniformly distributed on the unit disk.
+    //
+    [[nodiscard]] inline Vec2 sample_unit_disk(Vec2 const sample) {
+        f32 const a = 2.0f * sample.x - 1.0f;
+        f32 const b = 2.0f * sample.y - 1.0f;
+        if(a == 0.0f && b == 0.0f) {
+            return Vec2{0.0f, 0.0f};
+        }
+
+        f32 radius;
+        f32 phi;
+        if(a * a > b * b) {
+            radius = a;
+            phi = 0.25f * math::pi * (b / a);
+        } else {
+            radius = b;
+            phi = 0.5f * math::pi - 0.25f * math::pi * (a / b);
+        }
+        return Vec2{radius * math::cos(phi), radius * math::sin(phi)};
+    }
+
+    [[nodiscard]] inline Vec3 random_unit_vec3(Random_Engine& engine) {
+        f32 const u = random_f32(engine);
+        f32 const v = random_f32(engine);
+        return sample_unit_vec3(Vec2{u, v});
+    }
+
+    [[nodiscard]] inline Vec3 random_hemisphere_vec3(Random_Engine& engine, Vec3 const normal) {
+        f32 const u = random_f32(engine);
+        f32 const v = random_f32(engine);
+        return sample_hemisphere_vec3(Vec2{u, v}, normal);
+    }
+
+    [[nodiscard]] inline Vec3 random_cosine_hemisphere_vec3(Random_Engine& engine, Vec3 const normal) {
+        f32 const u = random_f32(engine);
+        f32 const v = random_f32(engine);
+        return sample_cosine_hemisphere_vec3(Vec2{u, v}, normal);
+    }
 } // namespace raytracing
@@ -0,0 +1,782 @@
+#include <renderer.hpp>
+
+#include <anton/algorithm/sort.hpp>
+#include <anton/console.hpp>
+#include <anton/format.hpp>
+#include <anton/math/math.hpp>
+#include <anton/optional.hpp>
+#include <counters.hpp>
+#include <intersections.hpp>
+#include <materials.hpp>
+#include <sampler.hpp>
+#include <scheduler.hpp>
+
+#include <chrono>
+
+#if defined(__x86_64__) || defined(_M_X64)
+    #define RT_TIME_STAMP_COUNTER 1
+    #if defined(_MSC_VER)
+        #include <intrin.h>
+    #else
+        #include <x86intrin.h>
+    #endif
+#endif
+
+namespace raytracing {
+    // State of a path in flight in the wavefront integrator.
+    struct Path_State {
+        Ray ray;
+        // Product of the attenuations along the path.
+        Vec3 throughput;
+        // Index of the pixel within the tile.
+        i64 pixel;
+        i64 bounce;
+        // The sample of the image the path belongs to.
+        Pixel_Sample sample;
+        // Density of the direction of the ray reported by scatter, 0 for the camera rays.
+        f32 scatter_pdf;
+    };
+
+    // Working memory owned by a single render thread.
+    struct Thread_Context {
+        // Rays being intersected and their closest intersections.
+        Array<Ray> rays;
+        Array<Optional<Surface_Interaction>> hits;
+        // Queues of the wavefront integrator.
+        Array<Path_State> paths;
+        Array<Path_State> next_paths;
+        // Indices of the paths that hit a surface ordered by the kind of the material.
+        Array<i64> shade_order;
+        // The hits of the paths in shade_order and their scattered rays.
+        Array<Scatter_Query> scatter_queries;
+        Array<Optional<Scatter_Result>> scatter_results;
+        // Radiance accumulated by the pixels of the tile.
+        Array<Vec3> radiance;
+    };
+
+    // Orientation of the viewport of the camera in the world space.
+    struct Camera_Frame {
+        Vec3 right;
+        Vec3 up;
+        Vec3 viewport_top_left;
+    };
+
+    // generate_camera_ray
+    // Generates the ray of a sample through the point of the pixel and the point of the lens
+    // given by the pixel and the lens dimensions of the sample.
+    //
+    [[nodiscard]] static Ray generate_camera_ray(Camera const& camera, Camera_Frame const& frame, Sampler const& sampler, Pixel_Sample const sample) {
+        i64 const x = sample.pixel % camera.image_width;
+        i64 const y = sample.pixel / camera.image_width;
+        Vec2 const offset = sampler.get_2d(sample, pixel_dimension);
+        f32 const u = (static_cast<f32>(x) + offset.x) / (camera.image_width - 1);
+        f32 const v = (static_cast<f32>(y) + offset.y) / (camera.image_height - 1);
+        Vec3 const direction = frame.viewport_top_left + u * camera.viewport_width * frame.right - v * camera.viewport_height * frame.up;
+        if(camera.aperture <= 0.0f) {
+            return Ray{camera.position, math::normalize(direction)};
+        }
+
+        // Thin lens. All rays through the point of the pixel converge on the plane in focus.
+        Vec2 const lens = sample_unit_disk(sampler.get_2d(sample, lens_dimension));
+        Vec3 const origin = camera.position + (0.5f * camera.aperture) * (lens.x * frame.right + lens.y * frame.up);
+        Vec3 const focus = camera.position + camera.focus_distance * direction;
+        return Ray{origin, math::normalize(focus - origin)};
+    }
+
+    [[nodiscard]] static Vec3 sky(Ray const ray) {
+        f32 const t = 0.5f * (ray.direction.y + 1.0f);
+        return (1.0f - t) * Vec3{1.0f} + t * Vec3{0.5f, 0.7f, 1.0f};
+    }
+
+    [[nodiscard]] static Vec3 resolve_pixel(Vec3 pixel, i64 const samples) {
+        pixel /= samples;
+        pixel.x = math::sqrt(pixel.x);
+        pixel.y = math::sqrt(pixel.y);
+        pixel.z = math::sqrt(pixel.z);
+        return pixel;
+    }
+
+    [[nodiscard]] static i64 read_cycle_counter() {
+#if RT_TIME_STAMP_COUNTER
+        return static_cast<i64>(__rdtsc());
+#else
+        auto const now = std::chrono::steady_clock::now().time_since_epoch();
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+#endif
+    }
+
+    // Readings of the calling thread taken before rendering a pixel.
+    struct Pixel_Cost_Start {
+        i64 cycles;
+        i64 nodes;
+        i64 primitives;
+    };
+
+    [[nodiscard]] static Pixel_Cost_Start begin_pixel_cost() {
+        return Pixel_Cost_Start{read_cycle_counter(), thread_traversal_cost.nodes, thread_traversal_cost.primitives};
+    }
+
+    // end_pixel_cost
+    // Adds the cost since start to the pixel. The tiles do not overlap, hence the threads
+    // never write the same pixel.
+    //
+    static void end_pixel_cost(Pixel_Costs& costs, i64 const pixel, Pixel_Cost_Start const& start) {
+        costs.cycles[pixel] += read_cycle_counter() - start.cycles;
+        costs.nodes[pixel] += thread_traversal_cost.nodes - start.nodes;
+        costs.primitives[pixel] += thread_traversal_cost.primitives - start.primitives;
+    }
+
+    // survive_russian_roulette
+    // Decides whether a path continues after scattering at bounce and compensates the
+    // throughput of the surviving paths.
+    //
+    // Returns:
+    // false if the path is terminated.
+    //
+    [[nodiscard]] static bool survive_russian_roulette(Context const& ctx, Sampler const& sampler, Pixel_Sample const sample, i64 const bounce,
+                                                       Vec3& throughput) {
+        if(!ctx.russian_roulette || bounce + 1 < ctx.russian_roulette_bounces) {
+            return true;
+        }
+
+        f32 const contribution = math::max(throughput.x, math::max(throughput.y, throughput.z));
+        if(contribution >= ctx.russian_roulette_threshold) {
+            return true;
+        }
+
+        f32 const survival = contribution / ctx.russian_roulette_threshold;
+        if(sampler.get_1d(sample, get_bounce_dimension(bounce, russian_roulette_dimension)) >= survival) {
+            return false;
+        }
+
+        throughput /= survival;
+        return true;
+    }
+
+    [[nodiscard]] static f32 power_heuristic(f32 const pdf, f32 const other_pdf) {
+        return (pdf * pdf) / (pdf * pdf + other_pdf * other_pdf);
+    }
+
+    // get_light_cone
+    //
+    // Returns:
+    // 1 minus the cosine of the half-angle of the cone of directions from point towards
+    // the light or null_optional if the point is inside the light.
+    //
+    [[nodiscard]] static Optional<f32> get_light_cone(Vec3 const point, Sphere const& light) {
+        Vec3 const offset = light.position - point;
+        f32 const sin_theta_max_squared = (light.radius * light.radius) / math::dot(offset, offset);
+        if(sin_theta_max_squared >= 1.0f) {
+            return null_optional;
+        }
+
+        // 1 - sqrt(1 - s) rewritten to not cancel for small, distant lights.
+        return sin_theta_max_squared / (1.0f + math::sqrt(1.0f - sin_theta_max_squared));
+    }
+
+    // Density of the directions of sample_lights with respect to the solid angle.
+    [[nodiscard]] static f32 get_light_pdf(f32 const one_minus_cos_theta_max, i64 const light_count) {
+        return 1.0f / (2.0f * math::pi * one_minus_cos_theta_max * static_cast<f32>(light_count));
+    }
+
+    // sample_lights
+    // Next-event estimation. Samples a direction towards a randomly chosen light, casts
+    // a shadow ray and weights the light arriving at the surface against the chance of
+    // scatter finding the light with the power heuristic.
+    //
+    // Returns:
+    // The light scattered by the surface into the incident ray.
+    //
+    [[nodiscard]] static Vec3 sample_lights(Sampler const& sampler, Pixel_Sample const sample, i64 const bounce, Scene const& scene,
+                                            Acceleration_Structure const& tree, Slice<Sphere const> const lights, Ray const ray,
+                                            Surface_Interaction const& hit) {
+        f32 const selection = sampler.get_1d(sample, get_bounce_dimension(bounce, light_selection_dimension));
+        i64 const light_index = math::min(static_cast<i64>(selection * static_cast<f32>(lights.size())), lights.size() - 1);
+        Sphere const& light = lights[light_index];
+        Vec3 const point = ray.origin + ray.direction * hit.distance;
+        Optional<f32> const one_minus_cos_theta_max = get_light_cone(point, light);
+        if(!one_minus_cos_theta_max) {
+            return Vec3{0.0f};
+        }
+
+        Vec2 const light_sample = sampler.get_2d(sample, get_bounce_dimension(bounce, light_dimension));
+        Vec3 const axis = math::normalize(light.position - point);
+        Vec3 const direction = sample_cone_vec3(light_sample, axis, one_minus_cos_theta_max.value());
+        Scatter_Evaluation const evaluation = evaluate_scatter(scene.materials, hit.normal, direction, hit.material);
+        if(evaluation.pdf <= 0.0f) {
+            return Vec3{0.0f};
+        }
+
+        Ray const shadow_ray{point, direction};
+        Optional<f32> const light_distance = intersect_sphere_distance(shadow_ray, light);
+        if(!light_distance) {
+            return Vec3{0.0f};
+        }
+
+        // Stop the shadow ray short of the light to not find the light itself.
+        if(tree.occluded(scene, shadow_ray, 0.999f * light_distance.value())) {
+            return Vec3{0.0f};
+        }
+
+        f32 const light_pdf = get_light_pdf(one_minus_cos_theta_max.value(), lights.size());
+        f32 const weight = power_heuristic(light_pdf, evaluation.pdf);
+        return evaluation.value * scene.materials.get_emission(light.material) * (weight / light_pdf);
+    }
+
+    // get_emitted_radiance
+    // Light emitted by the surface towards the origin of the ray.
+    //
+    // Parameters:
+    // scatter_pdf - density of the direction of the ray reported by scatter at the origin
+    //               of the ray or 0 if the light at the origin has not been sampled by sample_lights.
+    //
+    [[nodiscard]] static Vec3 get_emitted_radiance(Scene const& scene, Slice<Sphere const> const lights, Ray const ray, Surface_Interaction const& hit,
+                                                   f32 const scatter_pdf) {
+        Vec3 const emission = scene.materials.get_emission(hit.material);
+        if(!is_emissive(emission) || scatter_pdf <= 0.0f) {
+            return emission;
+        }
+
+        // The light the ray has hit is identified by its material and the distance to it.
+        for(Sphere const& light: lights) {
+            if(light.material.value != hit.material.value) {
+                continue;
+            }
+
+            Optional<f32> const distance = intersect_sphere_distance(ray, light);
+            if(!distance || math::abs(distance.value() - hit.distance) > 1e-4f * hit.distance) {
+                continue;
+            }
+
+            Optional<f32> const one_minus_cos_theta_max = get_light_cone(ray.origin, light);
+            if(!one_minus_cos_theta_max) {
+                break;
+            }
+
+            f32 const light_pdf = get_light_pdf(one_minus_cos_theta_max.value(), lights.size());
+            return emission * power_heuristic(scatter_pdf, light_pdf);
+        }
+
+        // Emissive surfaces that are not sampled as lights are found by scatter alone.
+        return emission;
+    }
+
+    // trace_path
+    // Follows a path from a ray whose closest intersection has already been found until
+    // it escapes to the sky, is absorbed, reaches ctx.bounces or is terminated by Russian roulette.
+    // The lights are sampled at every surface that reports the density of its scattered directions.
+    //
+    [[nodiscard]] static Vec3 trace_path(Context const& ctx, Sampler const& sampler, Pixel_Sample const sample, Scene const& scene,
+                                         Acceleration_Structure const& tree, Slice<Sphere const> const lights, Ray ray,
+                                         Optional<Surface_Interaction> hit) {
+        Vec3 radiance{0.0f};
+        Vec3 throughput{1.0f};
+        // The camera rays have not been sampled by scatter.
+        f32 scatter_pdf = 0.0f;
+        for(i64 bounce = 0; hit; ++bounce) {
+            radiance += throughput * get_emitted_radiance(scene, lights, ray, hit.value(), scatter_pdf);
+            Vec2 const scatter_sample = sampler.get_2d(sample, get_bounce_dimension(bounce, scatter_dimension));
+            Optional<Scatter_Result> const scatter_result = scatter(scene.materials, scatter_sample, ray, hit->distance, hit->normal, hit->material);
+            if(!scatter_result || bounce + 1 >= ctx.bounces) {
+                return radiance;
+            }
+
+            if(scatter_result->pdf > 0.0f && lights.size() > 0) {
+                radiance += throughput * sample_lights(sampler, sample, bounce, scene, tree, lights, ray, hit.value());
+            }
+
+            throughput = throughput * scatter_result->attenuation;
+            if(!survive_russian_roulette(ctx, sampler, sample, bounce, throughput)) {
+                return radiance;
+            }
+
+            scatter_pdf = scatter_result->pdf;
+            ray = scatter_result->ray;
+            hit = tree.intersect(scene, ray);
+            RT_COUNT_RAYS(bounce + 1, 1);
+            RT_COUNT(intersection_hits, hit.holds_value());
+        }
+
+        return radiance + throughput * sky(ray);
+    }
+
+    static void render_tile_recursive(Context const& ctx, Thread_Context& thread_ctx, Sampler const& sampler, Scene const& scene,
+                                      Acceleration_Structure const& tree, Slice<Sphere const> const lights, Camera const& camera, Camera_Frame const& frame,
+                                      Tile const tile, Slice<Vec3> const pixels) {
+        for(i64 y = tile.y_begin; y < tile.y_end; ++y) {
+            for(i64 x = tile.x_begin; x < tile.x_end; ++x) {
+                // The camera rays of a pixel are coherent, hence they traverse the tree together.
+                // The scattered rays lose the coherence and are traced one by one.
+                i64 const pixel_index = y * camera.image_width + x;
+                Pixel_Cost_Start const cost_start = (ctx.pixel_costs != nullptr ? begin_pixel_cost() : Pixel_Cost_Start{});
+                Array<Ray>& rays = thread_ctx.rays;
+                Array<Optional<Surface_Interaction>>& hits = thread_ctx.hits;
+                rays.clear();
+                for(i64 sample = 0; sample < ctx.samples; ++sample) {
+                    rays.push_back(generate_camera_ray(camera, frame, sampler, Pixel_Sample{pixel_index, sample}));
+                }
+
+                hits.resize(rays.size());
+                Vec3 pixel{0.0f};
+                if(ctx.bounces > 0) {
+                    tree.intersect_packet(scene, rays, hits);
+                    RT_COUNT_RAYS(0, rays.size());
+                    for(i64 sample = 0; sample < rays.size(); ++sample) {
+                        RT_COUNT(intersection_hits, hits[sample].holds_value());
+                        pixel += trace_path(ctx, sampler, Pixel_Sample{pixel_index, sample}, scene, tree, lights, rays[sample], hits[sample]);
+                    }
+                }
+                pixels[pixel_index] = resolve_pixel(pixel, ctx.samples);
+                if(ctx.pixel_costs != nullptr) {
+                    end_pixel_cost(*ctx.pixel_costs, pixel_index, cost_start);
+                }
+            }
+        }
+    }
+
+    // Running estimate of the value of a pixel in progressive rendering.
+    struct Pixel_Estimate {
+        Vec3 sum{0.0f};
+        i64 samples = 0;
+        // Mean and sum of squared deviations of the luminance of the samples (Welford's algorithm).
+        f32 luminance_mean = 0.0f;
+        f32 luminance_m2 = 0.0f;
+        bool finished = false;
+    };
+
+    [[nodiscard]] static f32 luminance(Vec3 const color) {
+        return 0.2126f * color.x + 0.7152f * color.y + 0.0722f * color.z;
+    }
+
+    static void add_sample(Pixel_Estimate& estimate, Vec3 const color) {
+        estimate.sum += color;
+        estimate.samples += 1;
+        f32 const value = luminance(color);
+        f32 const delta = value - estimate.luminance_mean;
+        estimate.luminance_mean += delta / estimate.samples;
+        estimate.luminance_m2 += delta * (value - estimate.luminance_mean);
+    }
+
+    [[nodiscard]] static bool is_converged(Context const& ctx, Pixel_Estimate const& estimate) {
+        if(estimate.samples < ctx.adaptive_min_samples || estimate.samples < 2) {
+            return false;
+        }
+
+        f32 const variance = estimate.luminance_m2 / (estimate.samples - 1);
+        f32 const standard_error = math::sqrt(variance / estimate.samples);
+        // The pixels are written with a gamma of 2, i.e. as sqrt(mean), which scales the error
+        // of the mean by 1 / (2 * sqrt(mean)). Clamp the mean to not chase the noise of nearly black pixels.
+        f32 const display_error = standard_error / (2.0f * math::sqrt(math::max(estimate.luminance_mean, 0.0001f)));
+        return display_error <= ctx.adaptive_threshold;
+    }
+
+    // render_tile_progressive
+    // Adds one pass of samples to the unfinished pixels of the tile.
+    //
+    static void render_tile_progressive(Context const& ctx, Thread_Context& thread_ctx, Sampler const& sampler, Scene const& scene,
+                                        Acceleration_Structure const& tree, Slice<Sphere const> const lights, Camera const& camera, Camera_Frame const& frame,
+                                        Tile const tile, Slice<Pixel_Estimate> const estimates) {
+        Array<Ray>& rays = thread_ctx.rays;
+        Array<Optional<Surface_Interaction>>& hits = thread_ctx.hits;
+        for(i64 y = tile.y_begin; y < tile.y_end; ++y) {
+            for(i64 x = tile.x_begin; x < tile.x_end; ++x) {
+                i64 const pixel_index = y * camera.image_width + x;
+                Pixel_Estimate& estimate = estimates[pixel_index];
+                if(estimate.finished) {
+                    continue;
+                }
+
+                // A pass continues the sequence of samples of the pixel where the previous one stopped.
+                Pixel_Cost_Start const cost_start = (ctx.pixel_costs != nullptr ? begin_pixel_cost() : Pixel_Cost_Start{});
+                i64 const first_sample = estimate.samples;
+                // Every pass adds at least one sample, otherwise the passes would never finish the pixels.
+                i64 const samples = math::min(math::max(ctx.progressive_pass_samples, (i64)1), ctx.samples - first_sample);
+                rays.clear();
+                for(i64 sample = 0; sample < samples; ++sample) {
+                    rays.push_back(generate_camera_ray(camera, frame, sampler, Pixel_Sample{pixel_index, first_sample + sample}));
+                }
+
+                hits.resize(rays.size());
+                tree.intersect_packet(scene, rays, hits);
+                RT_COUNT_RAYS(0, rays.size());
+                for(i64 sample = 0; sample < rays.size(); ++sample) {
+                    RT_COUNT(intersection_hits, hits[sample].holds_value());
+                    Pixel_Sample const pixel_sample{pixel_index, first_sample + sample};
+                    add_sample(estimate, trace_path(ctx, sampler, pixel_sample, scene, tree, lights, rays[sample], hits[sample]));
+                }
+
+                estimate.finished = estimate.samples >= ctx.samples || is_converged(ctx, estimate);
+                if(ctx.pixel_costs != nullptr) {
+                    end_pixel_cost(*ctx.pixel_costs, pixel_index, cost_start);
+                }
+            }
+        }
+    }
+
+    // render_tile_wavefront
+    // Traces the paths of the tile breadth-first. Up to ctx.wavefront_size paths are
+    // kept in a queue and advanced one bounce at a time in separate stages:
+    //  - regenerate: fill the queue with camera paths of the samples not traced yet,
+    //  - extend: find the closest intersections of all paths,
+    //  - sort: order the paths that hit a surface by the kind of the material,
+    //  - scatter: scatter the paths in one batch per kind of material,
+    //  - shade: sample the lights and write the surviving paths compacted to the next queue.
+    //
+    static void render_tile_wavefront(Context const& ctx, Thread_Context& thread_ctx, Sampler const& sampler, Scene const& scene,
+                                      Acceleration_Structure const& tree, Slice<Sphere const> const lights, Camera const& camera, Camera_Frame const& frame,
+                                      Tile const tile, Slice<Vec3> const pixels) {
+        i64 const tile_width = tile.x_end - tile.x_begin;
+        i64 const tile_pixels = tile_width * (tile.y_end - tile.y_begin);
+        i64 const pixel_samples = ctx.samples;
+        // Paths at bounce ctx.bounces contribute nothing, hence no path is started when there are no bounces.
+        i64 const total_samples = (ctx.bounces > 0 ? tile_pixels * pixel_samples : 0);
+        Array<Path_State>& paths = thread_ctx.paths;
+        Array<Path_State>& next_paths = thread_ctx.next_paths;
+        Array<Ray>& rays = thread_ctx.rays;
+        Array<Optional<Surface_Interaction>>& hits = thread_ctx.hits;
+        Array<i64>& shade_order = thread_ctx.shade_order;
+        Array<Scatter_Query>& scatter_queries = thread_ctx.scatter_queries;
+        Array<Optional<Scatter_Result>>& scatter_results = thread_ctx.scatter_results;
+        Array<Vec3>& radiance = thread_ctx.radiance;
+        radiance.clear();
+        for(i64 i = 0; i < tile_pixels; ++i) {
+            radiance.push_back(Vec3{0.0f});
+        }
+
+        paths.clear();
+        i64 next_sample = 0;
+        while(true) {
+            // Regenerate. The samples of a pixel are consecutive and remain next to each other in the queue.
+            while(paths.size() < ctx.wavefront_size && next_sample < total_samples) {
+                i64 const pixel = next_sample / pixel_samples;
+                i64 const sample = next_sample % pixel_samples;
+                i64 const x = tile.x_begin + pixel % tile_width;
+                i64 const y = tile.y_begin + pixel / tile_width;
+                Pixel_Sample const pixel_sample{y * camera.image_width + x, sample};
+                paths.push_back(Path_State{generate_camera_ray(camera, frame, sampler, pixel_sample), Vec3{1.0f}, pixel, 0, pixel_sample, 0.0f});
+                next_sample += 1;
+            }
+
+            if(paths.size() == 0) {
+                break;
+            }
+
+            // Extend. Runs of camera rays are coherent and traverse the tree in packets.
+            rays.clear();
+            for(Path_State const& path: paths) {
+                rays.push_back(path.ray);
+            }
+
+            // When the costs are recorded, the runs end at the pixels, so that the cost of a packet belongs to a single pixel.
+            hits.resize(paths.size());
+            for(i64 i = 0; i < paths.size();) {
+                Pixel_Cost_Start const cost_start = (ctx.pixel_costs != nullptr ? begin_pixel_cost() : Pixel_Cost_Start{});
+                i64 end = i + 1;
+                if(paths[i].bounce == 0) {
+                    while(end < paths.size() && paths[end].bounce == 0 && (ctx.pixel_costs == nullptr || paths[end].pixel == paths[i].pixel)) {
+                        end += 1;
+                    }
+
+                    tree.intersect_packet(scene, Slice<Ray const>{rays.data() + i, end - i}, Slice<Optional<Surface_Interaction>>{hits.data() + i, end - i});
+                } else {
+                    hits[i] = tree.intersect(scene, rays[i]);
+                }
+
+                if(ctx.pixel_costs != nullptr) {
+                    end_pixel_cost(*ctx.pixel_costs, paths[i].sample.pixel, cost_start);
+                }
+                i = end;
+            }
+
+            // Sort. Paths that hit a surface receive its emission, paths that missed receive the sky and terminate.
+            i64 kind_offsets[material_kind_count + 1] = {};
+            for(i64 i = 0; i < paths.size(); ++i) {
+                RT_COUNT_RAYS(paths[i].bounce, 1);
+                RT_COUNT(intersection_hits, hits[i].holds_value());
+                if(hits[i]) {
+                    Vec3 const emission = get_emitted_radiance(scene, lights, paths[i].ray, hits[i].value(), paths[i].scatter_pdf);
+                    radiance[paths[i].pixel] += paths[i].throughput * emission;
+                    kind_offsets[static_cast<i64>(get_material_kind(hits[i]->material)) + 1] += 1;
+                } else {
+                    radiance[paths[i].pixel] += paths[i].throughput * sky(paths[i].ray);
+                }
+            }
+
+            for(i64 kind = 1; kind <= material_kind_count; ++kind) {
+                kind_offsets[kind] += kind_offsets[kind - 1];
+            }
+
+            // The offsets are advanced to the ends of the runs of the kinds while placing the paths.
+            i64 kind_begins[material_kind_count + 1];
+            for(i64 kind = 0; kind <= material_kind_count; ++kind) {
+                kind_begins[kind] = kind_offsets[kind];
+            }
+
+            shade_order.clear();
+            shade_order.resize(kind_offsets[material_kind_count]);
+            for(i64 i = 0; i < paths.size(); ++i) {
+                if(hits[i]) {
+                    i64& offset = kind_offsets[static_cast<i64>(get_material_kind(hits[i]->material))];
+                    shade_order[offset] = i;
+                    offset += 1;
+                }
+            }
+
+            // Scatter. The paths of a kind are consecutive and scattered by a loop specialized for the kind.
+            scatter_queries.clear();
+            for(i64 const index: shade_order) {
+                Path_State const& path = paths[index];
+                Surface_Interaction const& hit = hits[index].value();
+                Vec2 const scatter_sample = sampler.get_2d(path.sample, get_bounce_dimension(path.bounce, scatter_dimension));
+                scatter_queries.push_back(Scatter_Query{path.ray, hit.normal, hit.distance, hit.material, scatter_sample});
+            }
+
+            scatter_results.resize(scatter_queries.size());
+            for(i64 kind = 0; kind < material_kind_count; ++kind) {
+                i64 const begin = kind_begins[kind];
+                i64 const end = kind_begins[kind + 1];
+                if(begin == end) {
+                    continue;
+                }
+
+                i64 const batch_start = (ctx.pixel_costs != nullptr ? read_cycle_counter() : 0);
+                scatter_batch(scene.materials, static_cast<Material_Kind>(kind), Slice<Scatter_Query const>{scatter_queries.data() + begin, end - begin},
+                              Slice<Optional<Scatter_Result>>{scatter_results.data() + begin, end - begin});
+                if(ctx.pixel_costs != nullptr) {
+                    // The paths of a batch are scattered together, hence they share its time evenly.
+                    i64 const cycles = (read_cycle_counter() - batch_start) / (end - begin);
+                    for(i64 i = begin; i < end; ++i) {
+                        ctx.pixel_costs->cycles[paths[shade_order[i]].sample.pixel] += cycles;
+                    }
+                }
+            }
+
+            // Shade. Paths that are absorbed, reach the bounce limit or are terminated
+            // by Russian roulette are not written to the next queue.
+            next_paths.clear();
+            for(i64 i = 0; i < shade_order.size(); ++i) {
+                Path_State const& path = paths[shade_order[i]];
+                Optional<Scatter_Result> const& scatter_result = scatter_results[i];
+                i64 const bounce = path.bounce + 1;
+                if(!scatter_result || bounce >= ctx.bounces) {
+                    continue;
+                }
+
+                // Records the light sampling, whose shadow rays traverse the structure.
+                Pixel_Cost_Start const cost_start = (ctx.pixel_costs != nullptr ? begin_pixel_cost() : Pixel_Cost_Start{});
+                if(scatter_result->pdf > 0.0f && lights.size() > 0) {
+                    Surface_Interaction const& hit = hits[shade_order[i]].value();
+                    radiance[path.pixel] += path.throughput * sample_lights(sampler, path.sample, path.bounce, scene, tree, lights, path.ray, hit);
+                }
+
+                Vec3 throughput = path.throughput * scatter_result->attenuation;
+                bool const survived = survive_russian_roulette(ctx, sampler, path.sample, path.bounce, throughput);
+                if(ctx.pixel_costs != nullptr) {
+                    end_pixel_cost(*ctx.pixel_costs, path.sample.pixel, cost_start);
+                }
+
+                if(!survived) {
+                    continue;
+                }
+
+                next_paths.push_back(Path_State{scatter_result->ray, throughput, path.pixel, bounce, path.sample, scatter_result->pdf});
+            }
+
+            // The queues swap their roles while keeping their memory.
+            Array<Path_State> shaded_paths = ANTON_MOV(paths);
+            paths = ANTON_MOV(next_paths);
+            next_paths = ANTON_MOV(shaded_paths);
+        }
+
+        for(i64 pixel = 0; pixel < tile_pixels; ++pixel) {
+            i64 const x = tile.x_begin + pixel % tile_width;
+            i64 const y = tile.y_begin + pixel / tile_width;
+            pixels[y * camera.image_width + x] = resolve_pixel(radiance[pixel], pixel_samples);
+        }
+    }
+
+    [[nodiscard]] static i64 nanoseconds_to_milliseconds(i64 const nanoseconds) {
+        return nanoseconds / 1000000;
+    }
+
+    static void print_thread_report(Slice<Worker_Statistics const> const statistics, i64 const tiles, i64 const wall_time) {
+        Console_Output cout;
+        i64 busy_time = 0;
+        for(Worker_Statistics const& s: statistics) {
+            busy_time += s.busy_time;
+        }
+
+        // Parallel efficiency is the fraction of the wall time the threads spent rendering.
+        i64 const efficiency = wall_time > 0 ? (100 * busy_time) / (wall_time * statistics.size()) : 100;
+        cout.write(format("rendered {} tiles on {} threads in {} ms (efficiency {}%)\n"_sv, tiles, statistics.size(),
+                          nanoseconds_to_milliseconds(wall_time), efficiency));
+        for(i64 i = 0; i < statistics.size(); ++i) {
+            Worker_Statistics const& s = statistics[i];
+            i64 const utilisation = wall_time > 0 ? (100 * s.busy_time) / wall_time : 100;
+            cout.write(format("  thread {}: {} tiles, {} steals, busy {} ms, finished after {} ms ({}%)\n"_sv, i, s.tasks, s.steals,
+                              nanoseconds_to_milliseconds(s.busy_time), nanoseconds_to_milliseconds(s.total_time), utilisation));
+        }
+    }
+
+    Array<Vec3> create_heatmap(Slice<i64 const> const values) {
+        Array<Vec3> colors{reserve, values.size()};
+        if(values.size() == 0) {
+            return colors;
+        }
+
+        Array<i64> sorted{reserve, values.size()};
+        for(i64 const value: values) {
+            sorted.push_back(value);
+        }
+
+        quick_sort(sorted.data(), sorted.data() + sorted.size(), [](i64 const lhs, i64 const rhs) { return lhs < rhs; });
+        i64 const scale = math::max(sorted[(99 * (sorted.size() - 1)) / 100], (i64)1);
+        constexpr i64 stop_count = 5;
+        Vec3 const stops[stop_count] = {Vec3{0.0f, 0.0f, 0.0f}, Vec3{0.0f, 0.0f, 1.0f}, Vec3{1.0f, 0.0f, 0.0f}, Vec3{1.0f, 1.0f, 0.0f},
+                                        Vec3{1.0f, 1.0f, 1.0f}};
+        for(i64 const value: values) {
+            f32 const t = math::clamp(static_cast<f32>(value) / static_cast<f32>(scale), 0.0f, 1.0f) * (stop_count - 1);
+            i64 const stop = math::min(static_cast<i64>(t), stop_count - 2);
+            f32 const fraction = t - static_cast<f32>(stop);
+            colors.push_back(stops[stop] * (1.0f - fraction) + stops[stop + 1] * fraction);
+        }
+        return colors;
+    }
+
+    Array<Vec3> render_scene(Context const& ctx, Scene const& scene, Camera const& camera, Camera_Target const& target, Tile_Output* const output) {
+        // TODO: The lookat code does not correctly handle camera target being positioned exactly above the camera.
+        Vec3 const camera_view = math::normalize(target.position - camera.position);
+        Vec3 const camera_right = math::normalize(math::cross(camera_view, Vec3{0.0f, 1.0f, 0.0f}));
+        Vec3 const camera_up = math::cross(camera_right, camera_view);
+        Mat3 const viewport_rotation{camera_right, camera_up, camera_view};
+        Vec3 const viewport_top_left = viewport_rotation * Vec3{-0.5f * camera.viewport_width, 0.5f * camera.viewport_height, camera.focal_length};
+        Camera_Frame const frame{camera_right, camera_up, viewport_top_left};
+
+        KD_Tree kd_tree;
+        BVH bvh;
+        Acceleration_Structure const* tree = ctx.prebuilt_acceleration_structure;
+        if(tree == nullptr) {
+            switch(ctx.acceleration_structure) {
+                case Acceleration_Structure_Kind::kd_tree: {
+                    kd_tree.build(scene, ctx.kd_tree_options);
+                    tree = &kd_tree;
+                } break;
+
+                case Acceleration_Structure_Kind::bvh: {
+                    bvh.build(scene, ctx.bvh_options);
+                    tree = &bvh;
+                } break;
+            }
+        }
+
+        // Building the structure is measured by the build timer.
+        RT_SCOPED_TIMER(render);
+        Array<Sphere> lights;
+        if(ctx.next_event_estimation) {
+            for(Sphere const& sphere: scene.spheres) {
+                if(is_emissive(scene.materials.get_emission(sphere.material))) {
+                    lights.push_back(sphere);
+                }
+            }
+        }
+
+        i64 const threads = (ctx.threads > 0 ? ctx.threads : get_hardware_concurrency());
+        Array<Thread_Context> thread_contexts{reserve, threads};
+        for(i64 i = 0; i < threads; ++i) {
+            thread_contexts.push_back(Thread_Context{});
+        }
+
+        i64 const pixel_count = camera.image_width * camera.image_height;
+        if(ctx.pixel_costs != nullptr) {
+            ctx.pixel_costs->nodes = Array<i64>(pixel_count, 0);
+            ctx.pixel_costs->primitives = Array<i64>(pixel_count, 0);
+            ctx.pixel_costs->cycles = Array<i64>(pixel_count, 0);
+        }
+
+        Array<Vec3> pixels{reserve, pixel_count};
+        pixels.force_size(pixel_count);
+        i64 const tiles_x = (camera.image_width + ctx.tile_size - 1) / ctx.tile_size;
+        i64 const tiles_y = (camera.image_height + ctx.tile_size - 1) / ctx.tile_size;
+        Sampler* const sampler = create_sampler(ctx.sampler, static_cast<u64>(ctx.seed), ctx.samples, camera.image_width);
+        auto get_tile = [&](i64 const tile) {
+            i64 const x_begin = (tile % tiles_x) * ctx.tile_size;
+            i64 const y_begin = (tile / tiles_x) * ctx.tile_size;
+            i64 const x_end = math::min(x_begin + ctx.tile_size, camera.image_width);
+            i64 const y_end = math::min(y_begin + ctx.tile_size, camera.image_height);
+            return Tile{x_begin, y_begin, x_end, y_end};
+        };
+
+        auto render_tile = [&](i64 const worker, i64 const tile) {
+            Thread_Context& thread_ctx = thread_contexts[worker];
+            Tile const pixel_tile = get_tile(tile);
+            switch(ctx.integrator) {
+                case Integrator::recursive: {
+                    render_tile_recursive(ctx, thread_ctx, *sampler, scene, *tree, lights, camera, frame, pixel_tile, pixels);
+                } break;
+
+                case Integrator::wavefront: {
+                    render_tile_wavefront(ctx, thread_ctx, *sampler, scene, *tree, lights, camera, frame, pixel_tile, pixels);
+                } break;
+            }
+
+            if(output != nullptr) {
+                output->write_tile(pixels, pixel_tile);
+            }
+        };
+
+        auto const render_start = std::chrono::steady_clock::now();
+        if(ctx.progressive && ctx.bounces > 0 && ctx.samples > 0) {
+            Array<Pixel_Estimate> estimates{pixel_count};
+            auto render_pass = [&](i64 const worker, i64 const tile) {
+                Tile const pixel_tile = get_tile(tile);
+                render_tile_progressive(ctx, thread_contexts[worker], *sampler, scene, *tree, lights, camera, frame, pixel_tile, estimates);
+            };
+
+            i64 passes = 0;
+            i64 unfinished_pixels = pixel_count;
+            while(unfinished_pixels > 0) {
+                auto const elapsed = std::chrono::steady_clock::now() - render_start;
+                if(ctx.time_budget > 0 && passes > 0 && std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() >= ctx.time_budget) {
+                    break;
+                }
+
+                (void)execute_tasks(threads, tiles_x * tiles_y, render_pass);
+                passes += 1;
+                unfinished_pixels = 0;
+                for(Pixel_Estimate const& estimate: estimates) {
+                    unfinished_pixels += !estimate.finished;
+                }
+            }
+
+            i64 total_samples = 0;
+            i64 converged_pixels = 0;
+            for(i64 i = 0; i < pixel_count; ++i) {
+                Pixel_Estimate const& estimate = estimates[i];
+                pixels[i] = resolve_pixel(estimate.sum, estimate.samples);
+                total_samples += estimate.samples;
+                converged_pixels += estimate.samples < ctx.samples && estimate.finished;
+            }
+
+            if(output != nullptr) {
+                for(i64 tile = 0; tile < tiles_x * tiles_y; ++tile) {
+                    output->write_tile(pixels, get_tile(tile));
+                }
+            }
+
+            auto const render_duration = std::chrono::steady_clock::now() - render_start;
+            i64 const wall_time = std::chrono::duration_cast<std::chrono::milliseconds>(render_duration).count();
+            Console_Output cout;
+            cout.write(format("rendered {} progressive passes in {} ms, {}.{} samples per pixel on average, {}% of the pixels converged early\n"_sv, passes,
+                              wall_time, total_samples / pixel_count, (10 * total_samples / pixel_count) % 10, 100 * converged_pixels / pixel_count));
+        } else {
+            Array<Worker_Statistics> const statistics = execute_tasks(threads, tiles_x * tiles_y, render_tile);
+            auto const render_duration = std::chrono::steady_clock::now() - render_start;
+            i64 const wall_time = std::chrono::duration_cast<std::chrono::nanoseconds>(render_duration).count();
+            print_thread_report(statistics, tiles_x * tiles_y, wall_time);
+        }
+
+        destroy_sampler(sampler);
+
+        return pixels;
+    }
+} // namespace raytracing
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <acceleration_structure.hpp>
+#include <anton/array.hpp>
+#include <anton/slice.hpp>
+#include <build_config.hpp>
+#include <bvh.hpp>
+#include <camera.hpp>
+#include <kd_tree.hpp>
+#include <sampler.hpp>
+#include <scene.hpp>
+
+namespace raytracing {
+    enum struct Integrator {
+        // Traces every path depth-first to the end before starting the next one.
+        recursive,
+        // Advances many paths at once one bounce at a time.
+        wavefront,
+    };
+
+    // Pixel_Costs
+    // Cost of rendering every pixel of the image in row-major order.
+    //
+    struct Pixel_Costs {
+        // Nodes of the acceleration structures visited by the rays of the pixel.
+        Array<i64> nodes;
+        // Primitives tested by the rays of the pixel.
+        Array<i64> primitives;
+        // Time spent rendering the pixel in cycles of the time stamp counter or in
+        // nanoseconds where the time stamp counter is not available.
+        Array<i64> cycles;
+    };
+
+    struct Context {
+        // Seed of the sampler. The values of the samples depend only on the pixel
+        // and the index of the sample, hence the image does not depend on the number of threads.
+        i64 seed = 0;
+        i64 bounces = 0;
+        i64 samples = 0;
+        // Generator of the positions of the samples within the pixels, on the lens
+        // and of the directions of the bounces.
+        Sampler_Kind sampler = Sampler_Kind::sobol;
+        // Number of threads to render with. If threads is set to 0, one thread
+        // per hardware thread will be used.
+        i64 threads = 0;
+        // Width and height of the tiles the image is split into in pixels.
+        i64 tile_size = 32;
+        // The acceleration structure to build over the scene.
+        Acceleration_Structure_Kind acceleration_structure = Acceleration_Structure_Kind::kd_tree;
+        // If not nullptr, the structure is used instead of building acceleration_structure.
+        // Must have been built for the rendered scene, e.g. loaded from a scene cache.
+        Acceleration_Structure const* prebuilt_acceleration_structure = nullptr;
+        KD_Tree::Build_Options kd_tree_options{.max_primitives = 16, .empty_bonus = 0.2f};
+        BVH::Build_Options bvh_options;
+        Integrator integrator = Integrator::recursive;
+        // Number of paths the wavefront integrator keeps in flight on each thread.
+        i64 wavefront_size = 4096;
+        // Whether the integrators sample the spheres of the scene with emissive materials
+        // explicitly at every diffuse surface and combine the samples with the scattered
+        // rays hitting the lights by multiple importance sampling.
+        bool next_event_estimation = true;
+        // Whether the integrators terminate the paths randomly after russian_roulette_bounces
+        // bounces once the largest component of their throughput falls below russian_roulette_threshold.
+        // A path survives with probability throughput / russian_roulette_threshold and the
+        // throughput of the surviving paths is divided by it, hence the image stays unbiased.
+        bool russian_roulette = false;
+        i64 russian_roulette_bounces = 3;
+        f32 russian_roulette_threshold = 1.0f;
+        // Progressive rendering samples the image in passes of progressive_pass_samples
+        // samples per pixel with the recursive integrator. A pixel stops receiving
+        // samples once it has received samples samples or once it has received at least
+        // adaptive_min_samples samples and the standard error of its mean luminance after
+        // the gamma correction is below adaptive_threshold. progressive_pass_samples
+        // below 1 are treated as 1.
+        bool progressive = false;
+        i64 progressive_pass_samples = 4;
+        i64 adaptive_min_samples = 8;
+        f32 adaptive_threshold = 0.02f;
+        // Time in milliseconds after which progressive rendering starts no further passes.
+        // If time_budget is set to 0, the passes continue until all pixels stop.
+        i64 time_budget = 0;
+        // If not nullptr, receives the cost of every pixel. The wavefront integrator attributes
+        // the traversals and the shading of every path to its pixel and splits the time of
+        // a batch of scattered paths evenly among them.
+        Pixel_Costs* pixel_costs = nullptr;
+    };
+
+    // Rectangle of pixels [x_begin, x_end) x [y_begin, y_end).
+    struct Tile {
+        i64 x_begin;
+        i64 y_begin;
+        i64 x_end;
+        i64 y_end;
+    };
+
+    // Tile_Output
+    // Receives the tiles of the image as they are finished.
+    //
+    struct Tile_Output {
+        virtual ~Tile_Output() = default;
+
+        // write_tile
+        // Called by the render threads. The pixels of the tile are final and are not
+        // accessed by the renderer anymore, the other pixels may be being written.
+        //
+        // Parameters:
+        // pixels - all pixels of the image in row-major order.
+        //   tile - the finished tile.
+        //
+        virtual void write_tile(Slice<Vec3 const> pixels, Tile tile) = 0;
+    };
+
+    // render_scene
+    // Splits the image into tiles and renders them on ctx.threads threads.
+    // With ctx.progressive the tiles are rendered repeatedly in passes.
+    //
+    // Parameters:
+    // output - if not nullptr, receives every tile once it is finished. In progressive
+    //          rendering the tiles are finished after the last pass.
+    //
+    // Returns:
+    // Pixels of the image in row-major order starting at the top left corner.
+    //
+    [[nodiscard]] Array<Vec3> render_scene(Context const& ctx, Scene const& scene, Camera const& camera, Camera_Target const& target,
+                                           Tile_Output* output = nullptr);
+
+    // create_heatmap
+    // Maps the values to false colours ranging from black through blue, red and yellow
+    // to white. The colours are scaled to the 99th percentile of the values, hence a few
+    // outliers do not darken the rest of the image and saturate to white instead.
+    //
+    [[nodiscard]] Array<Vec3> create_heatmap(Slice<i64 const> values);
+} // namespace raytracing
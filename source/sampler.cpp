@@ -0,0 +1,413 @@
+#include <sampler.hpp>
+
+#include <anton/array.hpp>
+#include <anton/assert.hpp>
+#include <anton/math/math.hpp>
+#include <random_engine.hpp>
+
+namespace raytracing {
+    [[nodiscard]] static f32 u32_to_unit_f32(u32 const value) {
+        return static_cast<f32>(value >> 8) * 0x1.0p-24f;
+    }
+
+    [[nodiscard]] static u64 hash_pixel(u64 const seed, i64 const pixel) {
+        return mix_u64(seed ^ mix_u64(static_cast<u64>(pixel)));
+    }
+
+    [[nodiscard]] static u64 hash_sample(u64 const pixel_seed, i64 const sample, i64 const dimension) {
+        return mix_u64(mix_u64(pixel_seed ^ static_cast<u64>(sample)) ^ static_cast<u64>(dimension));
+    }
+
+    [[nodiscard]] static u32 reverse_bits(u32 value) {
+        value = ((value >> 1) & 0x55555555u) | ((value & 0x55555555u) << 1);
+        value = ((value >> 2) & 0x33333333u) | ((value & 0x33333333u) << 2);
+        value = ((value >> 4) & 0x0F0F0F0Fu) | ((value & 0x0F0F0F0Fu) << 4);
+        value = ((value >> 8) & 0x00FF00FFu) | ((value & 0x00FF00FFu) << 8);
+        return (value >> 16) | (value << 16);
+    }
+
+    // laine_karras_permutation
+    // Hash in which every bit depends only on itself and the less significant bits.
+    //
+    [[nodiscard]] static u32 laine_karras_permutation(u32 value, u32 const seed) {
+        value += seed;
+        value ^= value * 0x6C50B47Cu;
+        value ^= value * 0xB82F1E52u;
+        value ^= value * 0xC7AFE638u;
+        value ^= value * 0x8D22F6E6u;
+        return value;
+    }
+
+    // nested_uniform_scramble
+    // Owen scrambling in base 2 (Burley, Practical Hash-based Owen Scrambling). Applied to
+    // a point it randomizes the point while preserving the stratification of the sequence.
+    // Applied to an index it shuffles the sequence while preserving its progressive property.
+    //
+    [[nodiscard]] static u32 nested_uniform_scramble(u32 const value, u32 const seed) {
+        return reverse_bits(laine_karras_permutation(reverse_bits(value), seed));
+    }
+
+    constexpr i64 sobol_dimensions = 4;
+    constexpr i64 sobol_bits = 32;
+
+    // Sobol_Tables
+    // The generator matrices of the Sobol sequence multiplied with every value of every
+    // byte of the index. The value of the index is the xor of the entries of its bytes.
+    //
+    struct Sobol_Tables {
+        u32 bytes[sobol_dimensions][sobol_bits / 8][256];
+    };
+
+    [[nodiscard]] static constexpr Sobol_Tables compute_sobol_tables() {
+        // Primitive polynomials and initial direction numbers of the dimensions 2 to 4 of Joe and Kuo.
+        // The first dimension is the van der Corput sequence.
+        struct Polynomial {
+            i64 degree;
+            u32 coefficients;
+            u32 initial[3];
+        };
+
+        constexpr Polynomial polynomials[sobol_dimensions - 1] = {{1, 0, {1, 0, 0}}, {2, 1, {1, 3, 0}}, {3, 1, {1, 3, 1}}};
+        u32 directions[sobol_dimensions][sobol_bits] = {};
+        for(i64 bit = 0; bit < sobol_bits; ++bit) {
+            directions[0][bit] = 1u << (31 - bit);
+        }
+
+        for(i64 dimension = 1; dimension < sobol_dimensions; ++dimension) {
+            Polynomial const& polynomial = polynomials[dimension - 1];
+            for(i64 bit = 0; bit < sobol_bits; ++bit) {
+                if(bit < polynomial.degree) {
+                    directions[dimension][bit] = polynomial.initial[bit] << (31 - bit);
+                } else {
+                    u32 const previous = directions[dimension][bit - polynomial.degree];
+                    u32 direction = previous ^ (previous >> polynomial.degree);
+                    for(i64 j = 1; j < polynomial.degree; ++j) {
+                        if((polynomial.coefficients >> (polynomial.degree - 1 - j)) & 1) {
+                            direction ^= directions[dimension][bit - j];
+                        }
+                    }
+                    directions[dimension][bit] = direction;
+                }
+            }
+        }
+
+        Sobol_Tables tables{};
+        for(i64 dimension = 0; dimension < sobol_dimensions; ++dimension) {
+            for(i64 byte = 0; byte < sobol_bits / 8; ++byte) {
+                for(i64 value = 0; value < 256; ++value) {
+                    u32 result = 0;
+                    for(i64 bit = 0; bit < 8; ++bit) {
+                        if((value >> bit) & 1) {
+                            result ^= directions[dimension][8 * byte + bit];
+                        }
+                    }
+                    tables.bytes[dimension][byte][value] = result;
+                }
+            }
+        }
+        return tables;
+    }
+
+    static constexpr Sobol_Tables sobol_tables = compute_sobol_tables();
+
+    [[nodiscard]] static u32 sobol(u32 const index, i64 const dimension) {
+        u32 const(&bytes)[sobol_bits / 8][256] = sobol_tables.bytes[dimension];
+        return bytes[0][index & 0xFF] ^ bytes[1][(index >> 8) & 0xFF] ^ bytes[2][(index >> 16) & 0xFF] ^ bytes[3][index >> 24];
+    }
+
+    // Seed and shuffled index of the set of sobol_dimensions dimensions a dimension belongs to.
+    struct Sobol_Set {
+        u64 seed;
+        u32 index;
+    };
+
+    // get_sobol_set
+    // The dimensions beyond the sobol_dimensions of the matrices are padded with
+    // independently shuffled and scrambled sets of sobol_dimensions dimensions.
+    //
+    [[nodiscard]] static Sobol_Set get_sobol_set(u64 const seed, i64 const sample, i64 const dimension) {
+        u64 const set_seed = mix_u64(seed ^ mix_u64(static_cast<u64>(dimension / sobol_dimensions)));
+        return Sobol_Set{set_seed, nested_uniform_scramble(static_cast<u32>(sample), static_cast<u32>(set_seed))};
+    }
+
+    // sample_owen_sobol
+    // Value of a dimension of the scrambled Sobol sequence.
+    //
+    [[nodiscard]] static u32 sample_owen_sobol(Sobol_Set const set, i64 const dimension) {
+        i64 const component = dimension % sobol_dimensions;
+        return nested_uniform_scramble(sobol(set.index, component), static_cast<u32>(mix_u64(set.seed + static_cast<u64>(component))));
+    }
+
+    [[nodiscard]] static u32 sample_owen_sobol(u64 const seed, i64 const sample, i64 const dimension) {
+        return sample_owen_sobol(get_sobol_set(seed, sample, dimension), dimension);
+    }
+
+    // permute
+    // Element index of a random permutation of length elements selected by seed
+    // (Kensler, Correlated Multi-Jittered Sampling).
+    //
+    [[nodiscard]] static u32 permute(u32 index, u32 const length, u32 const seed) {
+        u32 mask = length - 1;
+        mask |= mask >> 1;
+        mask |= mask >> 2;
+        mask |= mask >> 4;
+        mask |= mask >> 8;
+        mask |= mask >> 16;
+        do {
+            index ^= seed;
+            index *= 0xE170893Du;
+            index ^= seed >> 16;
+            index ^= (index & mask) >> 4;
+            index ^= seed >> 8;
+            index *= 0x0929EB3Fu;
+            index ^= seed >> 23;
+            index ^= (index & mask) >> 1;
+            index *= 1 | seed >> 27;
+            index *= 0x6935FA69u;
+            index ^= (index & mask) >> 11;
+            index *= 0x74DCB303u;
+            index ^= (index & mask) >> 2;
+            index *= 0x9E501CC3u;
+            index ^= (index & mask) >> 2;
+            index *= 0xC860A3DFu;
+            index &= mask;
+            index ^= index >> 5;
+        } while(index >= length);
+        return (index + seed) % length;
+    }
+
+    struct Independent_Sampler: public Sampler {
+        u64 seed;
+
+        Independent_Sampler(u64 const seed): seed(seed) {}
+
+        [[nodiscard]] f32 get_1d(Pixel_Sample const sample, i64 const dimension) const override {
+            return u32_to_unit_f32(static_cast<u32>(hash_sample(hash_pixel(seed, sample.pixel), sample.sample, dimension)));
+        }
+
+        [[nodiscard]] Vec2 get_2d(Pixel_Sample const sample, i64 const dimension) const override {
+            return Vec2{get_1d(sample, dimension), get_1d(sample, dimension + 1)};
+        }
+    };
+
+    struct Stratified_Sampler: public Sampler {
+        u64 seed;
+        i64 samples;
+        // Side of the grid of the strata of the 2-dimensional points or 0 if samples is not a square.
+        i64 strata_root;
+
+        Stratified_Sampler(u64 const seed, i64 const samples): seed(seed), samples(samples), strata_root(0) {
+            i64 const root = math::sqrt(samples);
+            for(i64 candidate = math::max(root - 1, (i64)1); candidate <= root + 1; ++candidate) {
+                if(candidate * candidate == samples) {
+                    strata_root = candidate;
+                }
+            }
+        }
+
+        // The sample-th sample lies in the stratum at the permuted index, which decorrelates
+        // the dimensions from each other and the pixels from their neighbours.
+        [[nodiscard]] f32 get_1d(Pixel_Sample const sample, i64 const dimension) const override {
+            ANTON_ASSERT(sample.sample < samples, "sample index exceeds the number of samples of the stratified sampler");
+            u64 const pixel_seed = hash_pixel(seed, sample.pixel);
+            u32 const stratum = permute(static_cast<u32>(sample.sample), static_cast<u32>(samples), static_cast<u32>(hash_sample(pixel_seed, -1, dimension)));
+            f32 const jitter = u32_to_unit_f32(static_cast<u32>(hash_sample(pixel_seed, sample.sample, dimension)));
+            return (static_cast<f32>(stratum) + jitter) / static_cast<f32>(samples);
+        }
+
+        [[nodiscard]] Vec2 get_2d(Pixel_Sample const sample, i64 const dimension) const override {
+            if(strata_root == 0) {
+                // Latin hypercube sampling.
+                return Vec2{get_1d(sample, dimension), get_1d(sample, dimension + 1)};
+            }
+
+            ANTON_ASSERT(sample.sample < samples, "sample index exceeds the number of samples of the stratified sampler");
+            u64 const pixel_seed = hash_pixel(seed, sample.pixel);
+            u32 const stratum = permute(static_cast<u32>(sample.sample), static_cast<u32>(samples), static_cast<u32>(hash_sample(pixel_seed, -1, dimension)));
+            u64 const jitter = hash_sample(pixel_seed, sample.sample, dimension);
+            f32 const x = (static_cast<f32>(stratum % strata_root) + u32_to_unit_f32(static_cast<u32>(jitter))) / static_cast<f32>(strata_root);
+            f32 const y = (static_cast<f32>(stratum / strata_root) + u32_to_unit_f32(static_cast<u32>(jitter >> 32))) / static_cast<f32>(strata_root);
+            return Vec2{x, y};
+        }
+    };
+
+    struct Sobol_Sampler: public Sampler {
+        u64 seed;
+
+        Sobol_Sampler(u64 const seed): seed(seed) {}
+
+        [[nodiscard]] f32 get_1d(Pixel_Sample const sample, i64 const dimension) const override {
+            return u32_to_unit_f32(sample_owen_sobol(hash_pixel(seed, sample.pixel), sample.sample, dimension));
+        }
+
+        [[nodiscard]] Vec2 get_2d(Pixel_Sample const sample, i64 const dimension) const override {
+            u64 const pixel_seed = hash_pixel(seed, sample.pixel);
+            Sobol_Set const set = get_sobol_set(pixel_seed, sample.sample, dimension);
+            // Both dimensions belong to the same set unless the point straddles a multiple of sobol_dimensions.
+            Sobol_Set const next_set = ((dimension + 1) % sobol_dimensions != 0 ? set : get_sobol_set(pixel_seed, sample.sample, dimension + 1));
+            return Vec2{u32_to_unit_f32(sample_owen_sobol(set, dimension)), u32_to_unit_f32(sample_owen_sobol(next_set, dimension + 1))};
+        }
+    };
+
+    constexpr i64 blue_noise_size = 64;
+
+    // generate_blue_noise_texture
+    // Ranks the texels of a tileable blue-noise texture with the void-and-cluster method (Ulichney).
+    // Texels are inserted into the largest void of the pattern, i.e. the empty texel with the lowest
+    // energy. Past the half of the texels this is the same as removing the tightest cluster of the
+    // empty texels, hence the second and the third phase of the method are merged.
+    //
+    // Returns:
+    // The ranks scaled to the full range of u32 in row-major order.
+    //
+    [[nodiscard]] static Array<u32> generate_blue_noise_texture() {
+        constexpr i64 size = blue_noise_size;
+        constexpr i64 texels = size * size;
+        constexpr i64 mask = size - 1;
+        constexpr f32 sigma = 1.5f;
+        // Energy contributed by a texel to the texels at a toroidal offset.
+        Array<f32> kernel(texels, 0.0f);
+        for(i64 y = 0; y < size; ++y) {
+            for(i64 x = 0; x < size; ++x) {
+                f32 const dx = static_cast<f32>(math::min(x, size - x));
+                f32 const dy = static_cast<f32>(math::min(y, size - y));
+                kernel[y * size + x] = math::exp(-(dx * dx + dy * dy) / (2.0f * sigma * sigma));
+            }
+        }
+
+        Array<f32> energy(texels, 0.0f);
+        Array<u8> occupied(texels, 0);
+        auto update = [&](i64 const texel, bool const insert) {
+            occupied[texel] = insert;
+            f32 const sign = insert ? 1.0f : -1.0f;
+            i64 const texel_x = texel % size;
+            i64 const texel_y = texel / size;
+            for(i64 y = 0; y < size; ++y) {
+                for(i64 x = 0; x < size; ++x) {
+                    energy[y * size + x] += sign * kernel[((y - texel_y) & mask) * size + ((x - texel_x) & mask)];
+                }
+            }
+        };
+
+        auto find_tightest_cluster = [&]() {
+            i64 result = -1;
+            for(i64 i = 0; i < texels; ++i) {
+                if(occupied[i] && (result == -1 || energy[i] > energy[result])) {
+                    result = i;
+                }
+            }
+            return result;
+        };
+
+        auto find_largest_void = [&]() {
+            i64 result = -1;
+            for(i64 i = 0; i < texels; ++i) {
+                if(!occupied[i] && (result == -1 || energy[i] < energy[result])) {
+                    result = i;
+                }
+            }
+            return result;
+        };
+
+        // Initial pattern of randomly placed texels relaxed until the tightest
+        // cluster and the largest void coincide.
+        Random_Engine random_engine = create_random_engine(1997);
+        i64 const initial_texels = texels / 10;
+        for(i64 inserted = 0; inserted < initial_texels;) {
+            i64 const texel = random_u32(random_engine) % texels;
+            if(!occupied[texel]) {
+                update(texel, true);
+                inserted += 1;
+            }
+        }
+
+        for(i64 iteration = 0; iteration < texels; ++iteration) {
+            i64 const cluster = find_tightest_cluster();
+            update(cluster, false);
+            i64 const largest_void = find_largest_void();
+            update(largest_void, true);
+            if(largest_void == cluster) {
+                break;
+            }
+        }
+
+        Array<u32> ranks(texels, 0);
+        Array<f32> const pattern_energy = energy;
+        Array<u8> const pattern = occupied;
+        // Rank the texels of the initial pattern by removing the tightest clusters.
+        for(i64 rank = initial_texels - 1; rank >= 0; --rank) {
+            i64 const cluster = find_tightest_cluster();
+            update(cluster, false);
+            ranks[cluster] = rank;
+        }
+
+        energy = pattern_energy;
+        occupied = pattern;
+        // Rank the remaining texels by filling the largest voids.
+        for(i64 rank = initial_texels; rank < texels; ++rank) {
+            i64 const largest_void = find_largest_void();
+            update(largest_void, true);
+            ranks[largest_void] = rank;
+        }
+
+        constexpr u32 rank_shift = 32 - 12;
+        static_assert(texels == (1 << 12), "the ranks must fill the range of u32");
+        for(u32& rank: ranks) {
+            rank <<= rank_shift;
+        }
+        return ranks;
+    }
+
+    struct Blue_Noise_Sampler: public Sampler {
+        u64 seed;
+        i64 image_width;
+        Array<u32> const* texture;
+
+        Blue_Noise_Sampler(u64 const seed, i64 const image_width): seed(seed), image_width(image_width) {
+            static Array<u32> const blue_noise_texture = generate_blue_noise_texture();
+            texture = &blue_noise_texture;
+        }
+
+        // All pixels share one sequence that is shifted toroidally by the value of the texel
+        // of the pixel. Every dimension reads the texture at a different offset, which keeps
+        // the shifts of the dimensions uncorrelated.
+        [[nodiscard]] u32 get_shift(i64 const pixel, i64 const dimension) const {
+            i64 const x = pixel % image_width;
+            i64 const y = pixel / image_width;
+            u64 const offset = mix_u64(seed ^ static_cast<u64>(dimension));
+            i64 const texel_x = (x + static_cast<i64>(offset)) & (blue_noise_size - 1);
+            i64 const texel_y = (y + static_cast<i64>(offset >> 32)) & (blue_noise_size - 1);
+            return (*texture)[texel_y * blue_noise_size + texel_x];
+        }
+
+        // Unsigned overflow wraps the shifted values around [0, 1).
+        [[nodiscard]] f32 get_1d(Pixel_Sample const sample, i64 const dimension) const override {
+            return u32_to_unit_f32(sample_owen_sobol(seed, sample.sample, dimension) + get_shift(sample.pixel, dimension));
+        }
+
+        [[nodiscard]] Vec2 get_2d(Pixel_Sample const sample, i64 const dimension) const override {
+            Sobol_Set const set = get_sobol_set(seed, sample.sample, dimension);
+            Sobol_Set const next_set = ((dimension + 1) % sobol_dimensions != 0 ? set : get_sobol_set(seed, sample.sample, dimension + 1));
+            return Vec2{u32_to_unit_f32(sample_owen_sobol(set, dimension) + get_shift(sample.pixel, dimension)),
+                        u32_to_unit_f32(sample_owen_sobol(next_set, dimension + 1) + get_shift(sample.pixel, dimension + 1))};
+        }
+    };
+
+    Sampler* create_sampler(Sampler_Kind const kind, u64 const seed, i64 const samples, i64 const image_width) {
+        switch(kind) {
+            case Sampler_Kind::independent:
+                return new Independent_Sampler(seed);
+            case Sampler_Kind::stratified:
+                return new Stratified_Sampler(seed, samples);
+            case Sampler_Kind::sobol:
+                return new Sobol_Sampler(seed);
+            case Sampler_Kind::blue_noise:
+                return new Blue_Noise_Sampler(seed, image_width);
+        }
+        return nullptr;
+    }
+
+    void destroy_sampler(Sampler* const sampler) {
+        delete sampler;
+    }
+} // namespace raytracing
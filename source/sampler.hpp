@@ -0,0 +1,78 @@
+#pragma once
+
+#include <build_config.hpp>
+
+namespace raytracing {
+    enum struct Sampler_Kind {
+        // Uncorrelated random numbers.
+        independent,
+        // Jittered strata shuffled independently in every pixel and dimension.
+        stratified,
+        // Owen-scrambled Sobol sequence.
+        sobol,
+        // A single Sobol sequence shifted in every pixel by a blue-noise texture,
+        // which distributes the error of neighbouring pixels as high-frequency noise.
+        blue_noise,
+    };
+
+    // Dimensions of a sample. Each bounce of a path consumes bounce_dimensions dimensions
+    // after the camera dimensions whether it uses them or not, hence a dimension has
+    // the same meaning in all samples of a pixel. The 2-dimensional points never straddle
+    // a multiple of 4 because the Sobol sampler stratifies sets of 4 dimensions jointly.
+    constexpr i64 pixel_dimension = 0;
+    constexpr i64 lens_dimension = 2;
+    constexpr i64 first_bounce_dimension = 4;
+    constexpr i64 bounce_dimensions = 8;
+    // Offsets of the dimensions used by a bounce.
+    constexpr i64 scatter_dimension = 0;
+    constexpr i64 russian_roulette_dimension = 2;
+    // Choice of the light sampled by next-event estimation and the point on it.
+    constexpr i64 light_selection_dimension = 3;
+    constexpr i64 light_dimension = 4;
+
+    [[nodiscard]] constexpr i64 get_bounce_dimension(i64 const bounce, i64 const offset) {
+        return first_bounce_dimension + bounce * bounce_dimensions + offset;
+    }
+
+    // Identifies a sample of a pixel of the image.
+    struct Pixel_Sample {
+        // Index of the pixel in row-major order.
+        i64 pixel;
+        i64 sample;
+    };
+
+    // Sampler
+    // Supplies the values of the dimensions of the samples of the pixels. The values
+    // depend only on the pixel, the sample and the dimension, hence the samples may be
+    // generated in any order and on any thread.
+    //
+    struct Sampler {
+        virtual ~Sampler() = default;
+
+        // get_1d
+        //
+        // Returns:
+        // A value in [0, 1).
+        //
+        [[nodiscard]] virtual f32 get_1d(Pixel_Sample sample, i64 dimension) const = 0;
+
+        // get_2d
+        //
+        // Returns:
+        // A point in [0, 1)^2 made of the values of the dimensions dimension and dimension + 1.
+        //
+        [[nodiscard]] virtual Vec2 get_2d(Pixel_Sample sample, i64 dimension) const = 0;
+    };
+
+    // create_sampler
+    //
+    // Parameters:
+    //        kind - the sampler to create.
+    //        seed - seed of the scrambling.
+    //     samples - number of samples of each pixel. The stratified sampler distributes
+    //               its strata among this many samples.
+    // image_width - width of the image in pixels.
+    //
+    [[nodiscard]] Sampler* create_sampler(Sampler_Kind kind, u64 seed, i64 samples, i64 image_width);
+    void destroy_sampler(Sampler* sampler);
+} // namespace raytracing
@@ -1,11 +1,64 @@
 #pragma once
 
 #include <anton/array.hpp>
+#include <anton/assert.hpp>
+#include <anton/math/math.hpp>
 #include <primitives.hpp>
 
 namespace raytracing {
     struct Scene {
         Array<Sphere> spheres;
-        Array<Triangle> triangles;
+        // Positions of the vertices shared by the triangles.
+        Array<Vec3> vertices;
+        Array<Indexed_Triangle> triangles;
+        // The materials the handles of the primitives refer to. The handles of the primitives
+        // of meshes instanced into a scene refer to the materials of that scene instead.
+        Material_Store materials;
     };
+
+    // get_triangle
+    //
+    // Returns:
+    // The triangle at index with the positions of its vertices fetched from the vertex buffer.
+    //
+    [[nodiscard]] inline Triangle get_triangle(Scene const& scene, i64 const index) {
+        Indexed_Triangle const triangle = scene.triangles[index];
+        return Triangle{scene.vertices[triangle.v1], scene.vertices[triangle.v2], scene.vertices[triangle.v3], Handle<Material>{triangle.material}};
+    }
+
+    // add_vertex
+    //
+    // Returns:
+    // Index of the vertex in the vertex buffer of the scene.
+    //
+    [[nodiscard]] inline u32 add_vertex(Scene& scene, Vec3 const position) {
+        ANTON_ASSERT(scene.vertices.size() < 0xFFFFFFFF, "the number of vertices exceeds the range of the indices");
+        scene.vertices.push_back(position);
+        return static_cast<u32>(scene.vertices.size() - 1);
+    }
+
+    inline void add_triangle(Scene& scene, u32 const v1, u32 const v2, u32 const v3, Handle<Material> const material) {
+        ANTON_ASSERT(material.value >= 0 && material.value <= 0xFFFFFFFF, "the material handle exceeds the range of Indexed_Triangle");
+        scene.triangles.push_back(Indexed_Triangle{v1, v2, v3, static_cast<u32>(material.value)});
+    }
+
+    // calculate_scene_bounds
+    //
+    // Returns:
+    // The bounds of the vertices and the spheres of the scene. Empty, i.e. min greater than max,
+    // if the scene has no primitives.
+    //
+    [[nodiscard]] inline Extent3 calculate_scene_bounds(Scene const& scene) {
+        Extent3 bounds{Vec3{math::infinity}, Vec3{-math::infinity}};
+        for(Vec3 const v: scene.vertices) {
+            bounds.min = math::min(bounds.min, v);
+            bounds.max = math::max(bounds.max, v);
+        }
+
+        for(Sphere const& sphere: scene.spheres) {
+            bounds.min = math::min(bounds.min, sphere.position - Vec3{sphere.radius});
+            bounds.max = math::max(bounds.max, sphere.position + Vec3{sphere.radius});
+        }
+        return bounds;
+    }
 } // namespace raytracing
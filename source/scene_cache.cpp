@@ -0,0 +1,209 @@
+#include <scene_cache.hpp>
+
+#include <anton/filesystem.hpp>
+#include <anton/string.hpp>
+#include <filesystem.hpp>
+#include <hash.hpp>
+#include <materials.hpp>
+#include <serialization.hpp>
+
+namespace raytracing {
+    // "RTSCENE" followed by a null byte.
+    constexpr u64 scene_cache_magic = 0x00454E4543535452ULL;
+
+    // The structures contain padding, hence they are hashed member by member.
+
+    template<typename T>
+    [[nodiscard]] static u64 hash_value(T const value, u64 const seed) {
+        return hash_bytes(&value, sizeof(T), seed);
+    }
+
+    [[nodiscard]] static u64 hash_vec3(Vec3 const v, u64 const seed) {
+        return hash_value(v.z, hash_value(v.y, hash_value(v.x, seed)));
+    }
+
+    [[nodiscard]] static u64 hash_material(Material_Store const& materials, Handle<Material> const handle, u64 hash) {
+        Material const material = materials.get_material(handle);
+        hash = hash_vec3(material.albedo, hash);
+        hash = hash_value(material.metallic, hash);
+        hash = hash_value(material.roughness, hash);
+        hash = hash_value(material.transmissive, hash);
+        hash = hash_value(material.ior, hash);
+        return hash_vec3(material.emission, hash);
+    }
+
+    u64 calculate_scene_cache_key(Slice<u8 const> const source, Material_Store const& materials, Handle<Material> const source_material,
+                                  Scene const& scene, KD_Tree::Build_Options const& options) {
+        u64 hash = hash_bytes(source.data(), source.size());
+        hash = hash_material(materials, source_material, hash);
+        hash = hash_bytes(scene.vertices.data(), scene.vertices.size() * sizeof(Vec3), hash);
+        for(Indexed_Triangle const& triangle: scene.triangles) {
+            hash = hash_value(triangle.v1, hash);
+            hash = hash_value(triangle.v2, hash);
+            hash = hash_value(triangle.v3, hash);
+            hash = hash_material(materials, Handle<Material>{triangle.material}, hash);
+        }
+
+        for(Sphere const& sphere: scene.spheres) {
+            hash = hash_vec3(sphere.position, hash);
+            hash = hash_value(sphere.radius, hash);
+            hash = hash_material(materials, sphere.material, hash);
+        }
+
+        // The tree does not depend on the number of threads it is built with.
+        hash = hash_value(options.max_depth, hash);
+        hash = hash_value(options.max_primitives, hash);
+        hash = hash_value(options.intersect_cost, hash);
+        hash = hash_value(options.traverse_cost, hash);
+        hash = hash_value(options.empty_bonus, hash);
+        hash = hash_value(options.compress_triangles, hash);
+        return hash;
+    }
+
+    // find_material
+    // Finds the value of a handle among the values of the handles written to a cache.
+    // The primitives are usually sorted by the material, hence the previous index is checked first.
+    //
+    // Returns:
+    // Index of the value or -1 if it is not present.
+    //
+    [[nodiscard]] static i64 find_material(Slice<i64 const> const handles, i64 const value, i64 const previous_index) {
+        if(previous_index >= 0 && handles[previous_index] == value) {
+            return previous_index;
+        }
+
+        for(i64 i = 0; i < handles.size(); ++i) {
+            if(handles[i] == value) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    bool write_scene_cache(String_View const path, u64 const key, Material_Store const& materials, Scene const& scene, KD_Tree const& tree) {
+        fs::Output_File_Stream stream(String{path});
+        if(!stream) {
+            return false;
+        }
+
+        write_value(stream, scene_cache_magic);
+        write_value(stream, scene_cache_version);
+        write_value(stream, key);
+        // The materials referenced by the primitives are written with the values of their handles.
+        Array<i64> handles;
+        i64 previous_index = -1;
+        auto add_material = [&handles, &previous_index](i64 const value) {
+            previous_index = find_material(handles, value, previous_index);
+            if(previous_index == -1) {
+                handles.push_back(value);
+                previous_index = handles.size() - 1;
+            }
+        };
+
+        for(Indexed_Triangle const& triangle: scene.triangles) {
+            add_material(triangle.material);
+        }
+
+        for(Sphere const& sphere: scene.spheres) {
+            add_material(sphere.material.value);
+        }
+
+        Array<Material> descriptions{reserve, handles.size()};
+        for(i64 const value: handles) {
+            descriptions.push_back(materials.get_material(Handle<Material>{value}));
+        }
+
+        write_array<i64>(stream, handles);
+        write_array<Material>(stream, descriptions);
+        write_array<Vec3>(stream, scene.vertices);
+        write_array<Indexed_Triangle>(stream, scene.triangles);
+        write_array<Sphere>(stream, scene.spheres);
+        tree.write(stream);
+        if(!stream) {
+            return false;
+        }
+
+        // The writes do not report errors. A failed write leaves the file shorter than the data written.
+        i64 const size = stream.tell();
+        stream.close();
+        return get_file_size(path) == size;
+    }
+
+    bool load_scene_cache(String_View const path, u64 const key, Material_Store& materials, Scene& scene, KD_Tree& tree) {
+        Mapped_File file;
+        if(!file.open(path)) {
+            return false;
+        }
+
+        Binary_Reader reader{file.data()};
+        u64 magic = 0;
+        u32 version = 0;
+        u64 cache_key = 0;
+        if(!reader.read_value(magic) || !reader.read_value(version) || !reader.read_value(cache_key)) {
+            return false;
+        }
+
+        if(magic != scene_cache_magic || version != scene_cache_version || cache_key != key) {
+            return false;
+        }
+
+        Array<i64> handles;
+        Array<Material> descriptions;
+        Scene cached_scene;
+        KD_Tree cached_tree;
+        if(!reader.read_array(handles) || !reader.read_array(descriptions) || !reader.read_array(cached_scene.vertices) ||
+           !reader.read_array(cached_scene.triangles) || !reader.read_array(cached_scene.spheres) || !cached_tree.read(reader, cached_scene)) {
+            return false;
+        }
+
+        if(handles.size() != descriptions.size()) {
+            return false;
+        }
+
+        i64 const vertex_count = cached_scene.vertices.size();
+        for(Indexed_Triangle const& triangle: cached_scene.triangles) {
+            if(triangle.v1 >= vertex_count || triangle.v2 >= vertex_count || triangle.v3 >= vertex_count) {
+                return false;
+            }
+        }
+
+        // Check the primitives before any material is created, so that a malformed cache leaves the store unchanged.
+        i64 previous_index = -1;
+        for(Indexed_Triangle const& triangle: cached_scene.triangles) {
+            previous_index = find_material(handles, triangle.material, previous_index);
+            if(previous_index == -1) {
+                return false;
+            }
+        }
+
+        for(Sphere const& sphere: cached_scene.spheres) {
+            previous_index = find_material(handles, sphere.material.value, previous_index);
+            if(previous_index == -1) {
+                return false;
+            }
+        }
+
+        // The materials of the cache are created anew in the store.
+        Array<Handle<Material>> created_handles{reserve, descriptions.size()};
+        for(Material const& material: descriptions) {
+            created_handles.push_back(materials.create_material(material));
+        }
+
+        for(Indexed_Triangle& triangle: cached_scene.triangles) {
+            previous_index = find_material(handles, triangle.material, previous_index);
+            triangle.material = static_cast<u32>(created_handles[previous_index].value);
+        }
+
+        for(Sphere& sphere: cached_scene.spheres) {
+            previous_index = find_material(handles, sphere.material.value, previous_index);
+            sphere.material = created_handles[previous_index];
+        }
+
+        // The store may be the one of the scene, hence the scene is not replaced as a whole.
+        scene.vertices = ANTON_MOV(cached_scene.vertices);
+        scene.triangles = ANTON_MOV(cached_scene.triangles);
+        scene.spheres = ANTON_MOV(cached_scene.spheres);
+        tree = ANTON_MOV(cached_tree);
+        return true;
+    }
+} // namespace raytracing
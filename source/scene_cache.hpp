@@ -0,0 +1,50 @@
+#pragma once
+
+#include <anton/slice.hpp>
+#include <anton/string_view.hpp>
+#include <build_config.hpp>
+#include <kd_tree.hpp>
+#include <scene.hpp>
+
+namespace raytracing {
+    // Version of the scene cache format. Caches of other versions are ignored.
+    // Must be incremented whenever the layout of the cache changes.
+    constexpr u32 scene_cache_version = 6;
+
+    // calculate_scene_cache_key
+    // Hashes everything a cached scene is created from: the contents of the source asset and
+    // the material of its triangles, the primitives already added to the scene and the options
+    // the tree is built with. The materials are hashed by their properties, not their handles.
+    // A cache is only loaded if its key matches.
+    //
+    // Parameters:
+    // materials - the store the material handles of the scene refer to.
+    //
+    [[nodiscard]] u64 calculate_scene_cache_key(Slice<u8 const> source, Material_Store const& materials, Handle<Material> source_material,
+                                                Scene const& scene, KD_Tree::Build_Options const& options);
+
+    // write_scene_cache
+    // Writes the vertices, the triangles and the spheres of the scene, the materials they reference
+    // and the tree built over the scene to the file at path.
+    //
+    // Parameters:
+    // materials - the store the material handles of the scene refer to, usually scene.materials.
+    //
+    // Returns:
+    // false if the file could not be opened or written completely.
+    //
+    [[nodiscard]] bool write_scene_cache(String_View path, u64 key, Material_Store const& materials, Scene const& scene, KD_Tree const& tree);
+
+    // load_scene_cache
+    // Maps the cache at path and restores the scene and the tree by copying the arrays out of
+    // the mapping without parsing or rebuilding anything. The materials of the cache are created
+    // anew in materials and the material handles of the primitives are remapped to them.
+    // The materials of the scene are left as they are.
+    //
+    // Returns:
+    // false if the cache does not exist, has a different version or key or is malformed,
+    // including indices out of the range of the arrays they refer to, in which case scene
+    // and tree are left unchanged.
+    //
+    [[nodiscard]] bool load_scene_cache(String_View path, u64 key, Material_Store& materials, Scene& scene, KD_Tree& tree);
+} // namespace raytracing
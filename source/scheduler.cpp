@@ -0,0 +1,255 @@
+#include <scheduler.hpp>
+
+#include <anton/assert.hpp>
+#include <anton/math/math.hpp>
+#include <anton/slice.hpp>
+#include <counters.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace raytracing {
+    // Range of task indices [begin, end) owned by a worker. Both ends are packed
+    // into a single word so that the owner and the thieves can update the range
+    // with a single compare-exchange.
+    struct alignas(64) Task_Range {
+        std::atomic<u64> range = 0;
+    };
+
+    [[nodiscard]] static u64 pack_range(u64 const begin, u64 const end) {
+        return begin | (end << 32);
+    }
+
+    [[nodiscard]] static u64 range_begin(u64 const range) {
+        return range & 0xFFFFFFFF;
+    }
+
+    [[nodiscard]] static u64 range_end(u64 const range) {
+        return range >> 32;
+    }
+
+    // pop_task
+    // Takes the first task from the front of the range.
+    //
+    // Returns:
+    // Index of the task or -1 if the range is empty.
+    //
+    [[nodiscard]] static i64 pop_task(Task_Range& queue) {
+        u64 range = queue.range.load(std::memory_order_relaxed);
+        while(true) {
+            u64 const begin = range_begin(range);
+            u64 const end = range_end(range);
+            if(begin >= end) {
+                return -1;
+            }
+
+            if(queue.range.compare_exchange_weak(range, pack_range(begin + 1, end), std::memory_order_acq_rel, std::memory_order_relaxed)) {
+                return begin;
+            }
+        }
+    }
+
+    // steal_tasks
+    // Takes the upper half of the range of the victim.
+    //
+    // Returns:
+    // The stolen range or 0 if the range of the victim is empty.
+    //
+    [[nodiscard]] static u64 steal_tasks(Task_Range& victim) {
+        u64 range = victim.range.load(std::memory_order_relaxed);
+        while(true) {
+            u64 const begin = range_begin(range);
+            u64 const end = range_end(range);
+            if(begin >= end) {
+                return 0;
+            }
+
+            u64 const middle = begin + (end - begin) / 2;
+            if(victim.range.compare_exchange_weak(range, pack_range(begin, middle), std::memory_order_acq_rel, std::memory_order_relaxed)) {
+                return pack_range(middle, end);
+            }
+        }
+    }
+
+    [[nodiscard]] static i64 elapsed_nanoseconds(std::chrono::steady_clock::time_point const start) {
+        auto const duration = std::chrono::steady_clock::now() - start;
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+    }
+
+    // run_worker
+    // Executes and steals tasks until all ranges are empty, then merges the counters of the calling thread.
+    //
+    static void run_worker(i64 const worker, Slice<Task_Range> const queues, Task_Callback const callback, void* const user_data,
+                           Worker_Statistics& statistics) {
+        i64 const worker_count = queues.size();
+        auto const worker_start = std::chrono::steady_clock::now();
+        while(true) {
+            i64 const task = pop_task(queues[worker]);
+            if(task != -1) {
+                auto const task_start = std::chrono::steady_clock::now();
+                callback(user_data, worker, task);
+                statistics.busy_time += elapsed_nanoseconds(task_start);
+                statistics.tasks += 1;
+                continue;
+            }
+
+            // Our range is empty. Visit the other workers starting with our
+            // neighbour so that the thieves spread out over the victims.
+            u64 stolen = 0;
+            for(i64 i = 1; i < worker_count && stolen == 0; ++i) {
+                stolen = steal_tasks(queues[(worker + i) % worker_count]);
+            }
+
+            if(stolen == 0) {
+                break;
+            }
+
+            statistics.steals += 1;
+            queues[worker].range.store(stolen, std::memory_order_release);
+        }
+        statistics.total_time = elapsed_nanoseconds(worker_start);
+        merge_thread_counters();
+    }
+
+    // Batch
+    // The tasks of a call to execute_tasks.
+    //
+    struct Batch {
+        Slice<Task_Range> queues;
+        Slice<Worker_Statistics> statistics;
+        Task_Callback callback = nullptr;
+        void* user_data = nullptr;
+    };
+
+    // Worker_Pool
+    // The threads running the workers other than worker 0. Thread i runs worker i + 1.
+    // The threads are started by the first batch that needs them and stay alive until
+    // the pool is destroyed at exit. Every batch increments generation, which wakes
+    // the threads waiting for it.
+    //
+    struct Worker_Pool {
+        // Serializes the calls to execute_tasks.
+        std::mutex submit_mutex;
+        std::mutex mutex;
+        // Signalled when a batch is started or the pool is shut down.
+        std::condition_variable batch_started;
+        // Signalled when the last thread of a batch finishes its tasks.
+        std::condition_variable batch_finished;
+        Array<std::thread> threads;
+        // The current batch. Protected by mutex.
+        Batch batch;
+        // Number of the workers of the current batch. Protected by mutex.
+        i64 batch_workers = 0;
+        // Number of the threads still executing the current batch. Protected by mutex.
+        i64 running_threads = 0;
+        // Protected by mutex.
+        u64 generation = 0;
+        // Protected by mutex.
+        bool shutdown = false;
+
+        ~Worker_Pool();
+    };
+
+    static void run_pool_thread(Worker_Pool& pool, i64 const worker, u64 seen_generation) {
+        while(true) {
+            Batch batch;
+            {
+                std::unique_lock<std::mutex> lock{pool.mutex};
+                pool.batch_started.wait(lock, [&pool, seen_generation]() { return pool.shutdown || pool.generation != seen_generation; });
+                if(pool.shutdown) {
+                    return;
+                }
+
+                seen_generation = pool.generation;
+                // Batches with fewer workers leave the remaining threads waiting.
+                if(worker >= pool.batch_workers) {
+                    continue;
+                }
+
+                batch = pool.batch;
+            }
+
+            run_worker(worker, batch.queues, batch.callback, batch.user_data, batch.statistics[worker]);
+            {
+                std::lock_guard<std::mutex> lock{pool.mutex};
+                pool.running_threads -= 1;
+                if(pool.running_threads == 0) {
+                    pool.batch_finished.notify_one();
+                }
+            }
+        }
+    }
+
+    Worker_Pool::~Worker_Pool() {
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            shutdown = true;
+        }
+        batch_started.notify_all();
+        for(std::thread& thread: threads) {
+            thread.join();
+        }
+    }
+
+    [[nodiscard]] static Worker_Pool& get_worker_pool() {
+        static Worker_Pool pool;
+        return pool;
+    }
+
+    i64 get_hardware_concurrency() {
+        i64 const concurrency = std::thread::hardware_concurrency();
+        return math::max(concurrency, (i64)1);
+    }
+
+    Array<Worker_Statistics> execute_tasks(i64 const worker_count, i64 const task_count, Task_Callback const callback, void* const user_data) {
+        ANTON_ASSERT(worker_count > 0, "worker_count must be at least 1");
+        ANTON_ASSERT(task_count < (i64(1) << 32), "task_count must be less than 2^32");
+        std::unique_ptr<Task_Range[]> queues{new Task_Range[worker_count]};
+        for(i64 i = 0; i < worker_count; ++i) {
+            u64 const begin = (task_count * i) / worker_count;
+            u64 const end = (task_count * (i + 1)) / worker_count;
+            queues[i].range.store(pack_range(begin, end), std::memory_order_relaxed);
+        }
+
+        Slice<Task_Range> const queues_slice{queues.get(), worker_count};
+        Array<Worker_Statistics> statistics{reserve, worker_count};
+        statistics.force_size(worker_count);
+        for(Worker_Statistics& s: statistics) {
+            s = Worker_Statistics{};
+        }
+
+        if(worker_count == 1) {
+            run_worker(0, queues_slice, callback, user_data, statistics[0]);
+            return statistics;
+        }
+
+        Worker_Pool& pool = get_worker_pool();
+        std::lock_guard<std::mutex> submit_lock{pool.submit_mutex};
+        {
+            std::lock_guard<std::mutex> lock{pool.mutex};
+            // The new threads start waiting for the generation of this batch.
+            for(i64 i = pool.threads.size(); i < worker_count - 1; ++i) {
+                pool.threads.push_back(std::thread(run_pool_thread, std::ref(pool), i + 1, pool.generation));
+            }
+
+            pool.batch = Batch{queues_slice, Slice<Worker_Statistics>{statistics.data(), worker_count}, callback, user_data};
+            pool.batch_workers = worker_count;
+            pool.running_threads = worker_count - 1;
+            pool.generation += 1;
+        }
+        pool.batch_started.notify_all();
+
+        run_worker(0, queues_slice, callback, user_data, statistics[0]);
+        {
+            std::unique_lock<std::mutex> lock{pool.mutex};
+            pool.batch_finished.wait(lock, [&pool]() { return pool.running_threads == 0; });
+        }
+
+        return statistics;
+    }
+} // namespace raytracing
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <anton/array.hpp>
+#include <build_config.hpp>
+
+namespace raytracing {
+    struct Worker_Statistics {
+        // Number of tasks executed by the worker.
+        i64 tasks = 0;
+        // Number of times the worker stole tasks from another worker.
+        i64 steals = 0;
+        // Time spent executing tasks in nanoseconds.
+        i64 busy_time = 0;
+        // Time from the start of the worker until it ran out of tasks in nanoseconds.
+        i64 total_time = 0;
+    };
+
+    using Task_Callback = void (*)(void* user_data, i64 worker, i64 task);
+
+    // get_hardware_concurrency
+    //
+    // Returns:
+    // The number of hardware threads. Always at least 1.
+    //
+    [[nodiscard]] i64 get_hardware_concurrency();
+
+    // execute_tasks
+    // Executes tasks [0, task_count) on worker_count threads. The calling thread
+    // is used as worker 0. The tasks are initially split into contiguous ranges,
+    // one per worker. A worker that runs out of tasks steals the upper half of
+    // the remaining range of another worker. The other workers run on threads
+    // that are started by the first call needing them and are kept alive between
+    // the calls. Concurrent calls are executed one after another, hence tasks
+    // must not call execute_tasks.
+    //
+    // Parameters:
+    //  worker_count - number of workers. Must be at least 1.
+    //    task_count - number of tasks to execute. Must be less than 2^32.
+    //      callback - invoked once for every task with the index of the worker executing it.
+    //
+    // Returns:
+    // Statistics of each worker.
+    //
+    [[nodiscard]] Array<Worker_Statistics> execute_tasks(i64 worker_count, i64 task_count, Task_Callback callback, void* user_data);
+
+    template<typename Callable>
+    [[nodiscard]] Array<Worker_Statistics> execute_tasks(i64 const worker_count, i64 const task_count, Callable& callable) {
+        Task_Callback const callback = [](void* const user_data, i64 const worker, i64 const task) {
+            (*static_cast<Callable*>(user_data))(worker, task);
+        };
+        return execute_tasks(worker_count, task_count, callback, &callable);
+    }
+} // namespace raytracing
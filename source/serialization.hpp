@@ -0,0 +1,76 @@
+#pragma once
+
+#include <anton/array.hpp>
+#include <anton/slice.hpp>
+#include <anton/stream.hpp>
+#include <build_config.hpp>
+
+#include <cstring>
+#include <type_traits>
+
+namespace raytracing {
+    // Binary serialization of trivially copyable values and arrays in the layout of the host.
+    // The data is meant to be read back by the same build, hence no conversions are performed.
+
+    template<typename T>
+    void write_value(Output_Stream& stream, T const& value) {
+        static_assert(std::is_trivially_copyable_v<T>, "T must be trivially copyable");
+        stream.write(Slice<u8 const>{reinterpret_cast<u8 const*>(&value), static_cast<i64>(sizeof(T))});
+    }
+
+    // write_array
+    // Writes the number of the elements followed by the elements.
+    //
+    template<typename T>
+    void write_array(Output_Stream& stream, Slice<T const> const elements) {
+        static_assert(std::is_trivially_copyable_v<T>, "T must be trivially copyable");
+        write_value(stream, elements.size());
+        stream.write(Slice<u8 const>{reinterpret_cast<u8 const*>(elements.data()), static_cast<i64>(elements.size() * sizeof(T))});
+    }
+
+    // Binary_Reader
+    // Reads the values written by write_value and write_array from memory, e.g. a mapped file.
+    // Every read fails without advancing the reader if the data is truncated.
+    //
+    struct Binary_Reader {
+        Slice<u8 const> data;
+        i64 offset = 0;
+
+        template<typename T>
+        [[nodiscard]] bool read_value(T& value) {
+            static_assert(std::is_trivially_copyable_v<T>, "T must be trivially copyable");
+            if(data.size() - offset < static_cast<i64>(sizeof(T))) {
+                return false;
+            }
+
+            memcpy(&value, data.data() + offset, sizeof(T));
+            offset += sizeof(T);
+            return true;
+        }
+
+        // read_array
+        // Replaces the contents of elements with the elements of the array.
+        //
+        template<typename T>
+        [[nodiscard]] bool read_array(Array<T>& elements) {
+            static_assert(std::is_trivially_copyable_v<T>, "T must be trivially copyable");
+            i64 const begin = offset;
+            i64 size = 0;
+            if(!read_value(size)) {
+                return false;
+            }
+
+            if(size < 0 || (data.size() - offset) / static_cast<i64>(sizeof(T)) < size) {
+                offset = begin;
+                return false;
+            }
+
+            elements.clear();
+            elements.ensure_capacity(size);
+            elements.force_size(size);
+            memcpy(elements.data(), data.data() + offset, size * sizeof(T));
+            offset += size * sizeof(T);
+            return true;
+        }
+    };
+} // namespace raytracing
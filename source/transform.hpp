@@ -0,0 +1,99 @@
+#pragma once
+
+#include <anton/math/math.hpp>
+#include <build_config.hpp>
+
+namespace raytracing {
+    // Transform
+    // Affine transform made of a linear part stored as its columns followed by a translation.
+    //
+    struct Transform {
+        Vec3 x{1.0f, 0.0f, 0.0f};
+        Vec3 y{0.0f, 1.0f, 0.0f};
+        Vec3 z{0.0f, 0.0f, 1.0f};
+        Vec3 translation{0.0f, 0.0f, 0.0f};
+    };
+
+    [[nodiscard]] inline Vec3 transform_point(Transform const& transform, Vec3 const point) {
+        return transform.x * point.x + transform.y * point.y + transform.z * point.z + transform.translation;
+    }
+
+    [[nodiscard]] inline Vec3 transform_vector(Transform const& transform, Vec3 const vector) {
+        return transform.x * vector.x + transform.y * vector.y + transform.z * vector.z;
+    }
+
+    // transform_normal
+    // Transforms a normal with the inverse transpose of the linear part of a transform.
+    //
+    // Parameters:
+    // inverse - inverse of the transform the surface has been transformed with.
+    //
+    [[nodiscard]] inline Vec3 transform_normal(Transform const& inverse, Vec3 const normal) {
+        return Vec3{math::dot(inverse.x, normal), math::dot(inverse.y, normal), math::dot(inverse.z, normal)};
+    }
+
+    // compose
+    //
+    // Returns:
+    // The transform applying second first and first afterwards.
+    //
+    [[nodiscard]] inline Transform compose(Transform const& first, Transform const& second) {
+        return Transform{transform_vector(first, second.x), transform_vector(first, second.y), transform_vector(first, second.z),
+                         transform_point(first, second.translation)};
+    }
+
+    // invert
+    // The linear part of the transform must not be singular.
+    //
+    [[nodiscard]] inline Transform invert(Transform const& transform) {
+        // The rows of the inverse of the linear part are the cross products of its columns divided by the determinant.
+        Vec3 const row0 = math::cross(transform.y, transform.z);
+        Vec3 const row1 = math::cross(transform.z, transform.x);
+        Vec3 const row2 = math::cross(transform.x, transform.y);
+        f32 const inv_determinant = 1.0f / math::dot(transform.x, row0);
+        Transform inverse{Vec3{row0.x, row1.x, row2.x} * inv_determinant, Vec3{row0.y, row1.y, row2.y} * inv_determinant,
+                          Vec3{row0.z, row1.z, row2.z} * inv_determinant, Vec3{0.0f}};
+        inverse.translation = Vec3{0.0f} - transform_vector(inverse, transform.translation);
+        return inverse;
+    }
+
+    [[nodiscard]] inline Transform translate(Vec3 const translation) {
+        Transform transform;
+        transform.translation = translation;
+        return transform;
+    }
+
+    [[nodiscard]] inline Transform scale(f32 const factor) {
+        return Transform{Vec3{factor, 0.0f, 0.0f}, Vec3{0.0f, factor, 0.0f}, Vec3{0.0f, 0.0f, factor}, Vec3{0.0f}};
+    }
+
+    // rotate
+    // Rotation by angle radians counterclockwise around a normalized axis.
+    //
+    [[nodiscard]] inline Transform rotate(Vec3 const axis, f32 const angle) {
+        // Rodrigues' rotation formula applied to the basis vectors.
+        f32 const sin = math::sin(angle);
+        f32 const cos = math::cos(angle);
+        auto rotate_vector = [axis, sin, cos](Vec3 const v) {
+            return v * cos + math::cross(axis, v) * sin + axis * (math::dot(axis, v) * (1.0f - cos));
+        };
+        return Transform{rotate_vector(Vec3{1.0f, 0.0f, 0.0f}), rotate_vector(Vec3{0.0f, 1.0f, 0.0f}), rotate_vector(Vec3{0.0f, 0.0f, 1.0f}), Vec3{0.0f}};
+    }
+
+    // transform_extent
+    //
+    // Returns:
+    // The bounds of the transformed corners of extent.
+    //
+    [[nodiscard]] inline Extent3 transform_extent(Transform const& transform, Extent3 const& extent) {
+        Extent3 result{Vec3{math::infinity}, Vec3{-math::infinity}};
+        for(i32 corner = 0; corner < 8; ++corner) {
+            Vec3 const point{(corner & 1) ? extent.max.x : extent.min.x, (corner & 2) ? extent.max.y : extent.min.y,
+                             (corner & 4) ? extent.max.z : extent.min.z};
+            Vec3 const transformed = transform_point(transform, point);
+            result.min = math::min(result.min, transformed);
+            result.max = math::max(result.max, transformed);
+        }
+        return result;
+    }
+} // namespace raytracing
@@ -0,0 +1,292 @@
+#include <triangle_packets.hpp>
+
+#include <anton/assert.hpp>
+
+#if defined(__x86_64__) || defined(_M_X64)
+    // SSE2 is part of x86-64, hence the SSE kernel is always available.
+    #define RT_TRIANGLE_KERNEL_SSE 1
+    #include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && defined(__x86_64__)
+    // The AVX2 kernel is compiled with the target attribute and selected at runtime.
+    #define RT_TRIANGLE_KERNEL_AVX2 1
+    #include <immintrin.h>
+#endif
+
+namespace raytracing {
+    Triangle_Packet make_triangle_packet(Slice<u32 const> const indices, Slice<Triangle_Data const> const triangles) {
+        ANTON_ASSERT(indices.size() <= triangle_packet_width, "too many triangles for a single packet");
+        // Zero initialised lanes are degenerate triangles which are never hit.
+        Triangle_Packet packet = {};
+        for(i64 lane = 0; lane < triangle_packet_width; ++lane) {
+            packet.indices[lane] = empty_lane_index;
+        }
+
+        for(i64 lane = 0; lane < indices.size(); ++lane) {
+            u32 const index = indices[lane];
+            Triangle_Data const& triangle = triangles[index];
+            for(i32 axis = 0; axis < 3; ++axis) {
+                packet.v1[axis][lane] = triangle.v1[axis];
+                packet.edge1[axis][lane] = triangle.edge1[axis];
+                packet.edge2[axis][lane] = triangle.edge2[axis];
+                packet.normal[axis][lane] = triangle.normal[axis];
+            }
+            packet.indices[lane] = index;
+        }
+        return packet;
+    }
+
+    [[nodiscard]] static Optional<Triangle_Packet_Hit> intersect_triangle_packets_scalar(Ray const& ray, Triangle_Packet const* const packets, i64 const count,
+                                                                                        f32 const max_distance) {
+        f32 best_distance = max_distance;
+        Triangle_Packet const* best_packet = nullptr;
+        i64 best_lane = -1;
+        Vec3 const d = ray.direction;
+        for(i64 i = 0; i < count; ++i) {
+            Triangle_Packet const& packet = packets[i];
+            for(i64 lane = 0; lane < triangle_packet_width; ++lane) {
+                Vec3 const v1{packet.v1[0][lane], packet.v1[1][lane], packet.v1[2][lane]};
+                Vec3 const edge1{packet.edge1[0][lane], packet.edge1[1][lane], packet.edge1[2][lane]};
+                Vec3 const edge2{packet.edge2[0][lane], packet.edge2[1][lane], packet.edge2[2][lane]};
+                Vec3 const p = math::cross(d, edge2);
+                f32 const det = math::dot(edge1, p);
+                // See intersect_triangle_distance.
+                if(det == 0.0f) {
+                    continue;
+                }
+
+                f32 const inv_det = 1.0f / det;
+                Vec3 const t = ray.origin - v1;
+                f32 const u = math::dot(t, p) * inv_det;
+                Vec3 const q = math::cross(t, edge1);
+                f32 const v = math::dot(d, q) * inv_det;
+                f32 const distance = math::dot(edge2, q) * inv_det;
+                if(u >= 0.0f & v >= 0.0f & u + v <= 1.0f & distance >= 0.001f & distance < best_distance) {
+                    best_distance = distance;
+                    best_packet = &packet;
+                    best_lane = lane;
+                }
+            }
+        }
+
+        if(best_packet != nullptr) {
+            Vec3 const normal{best_packet->normal[0][best_lane], best_packet->normal[1][best_lane], best_packet->normal[2][best_lane]};
+            return Triangle_Packet_Hit{best_packet->indices[best_lane], best_distance, normal};
+        } else {
+            return null_optional;
+        }
+    }
+
+    // reduce_lanes
+    // Selects the closest of the per-lane hits. Lanes that hit at the same
+    // distance are resolved in favour of the earliest triangle.
+    //
+    // Parameters:
+    //    distances - the closest distance found by each lane.
+    //    positions - position of the triangle found by each lane or -1.
+    //        lanes - number of lanes.
+    // max_distance - the distance the lanes have been initialized with.
+    //
+    [[nodiscard]] static Optional<Triangle_Packet_Hit> reduce_lanes(f32 const* const distances, f32 const* const positions, i64 const lanes,
+                                                                   Triangle_Packet const* const packets, f32 const max_distance) {
+        f32 best_distance = max_distance;
+        f32 best_position = -1.0f;
+        for(i64 lane = 0; lane < lanes; ++lane) {
+            if(positions[lane] < 0.0f) {
+                continue;
+            }
+
+            if(distances[lane] < best_distance || (distances[lane] == best_distance && positions[lane] < best_position)) {
+                best_distance = distances[lane];
+                best_position = positions[lane];
+            }
+        }
+
+        if(best_position >= 0.0f) {
+            i64 const position = (i64)best_position;
+            Triangle_Packet const& packet = packets[position / triangle_packet_width];
+            i64 const lane = position % triangle_packet_width;
+            Vec3 const normal{packet.normal[0][lane], packet.normal[1][lane], packet.normal[2][lane]};
+            return Triangle_Packet_Hit{packet.indices[lane], best_distance, normal};
+        } else {
+            return null_optional;
+        }
+    }
+
+#if RT_TRIANGLE_KERNEL_SSE
+    [[nodiscard]] static Optional<Triangle_Packet_Hit> intersect_triangle_packets_sse(Ray const& ray, Triangle_Packet const* const packets, i64 const count,
+                                                                                     f32 const max_distance) {
+        __m128 const dx = _mm_set1_ps(ray.direction.x);
+        __m128 const dy = _mm_set1_ps(ray.direction.y);
+        __m128 const dz = _mm_set1_ps(ray.direction.z);
+        __m128 const ox = _mm_set1_ps(ray.origin.x);
+        __m128 const oy = _mm_set1_ps(ray.origin.y);
+        __m128 const oz = _mm_set1_ps(ray.origin.z);
+        __m128 const zero = _mm_setzero_ps();
+        __m128 const one = _mm_set1_ps(1.0f);
+        __m128 const min_distance = _mm_set1_ps(0.001f);
+        __m128 const lane_offsets = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+        __m128 best_distance = _mm_set1_ps(max_distance);
+        __m128 best_position = _mm_set1_ps(-1.0f);
+        for(i64 i = 0; i < count; ++i) {
+            Triangle_Packet const& packet = packets[i];
+            __m128 const e1x = _mm_load_ps(packet.edge1[0]);
+            __m128 const e1y = _mm_load_ps(packet.edge1[1]);
+            __m128 const e1z = _mm_load_ps(packet.edge1[2]);
+            __m128 const e2x = _mm_load_ps(packet.edge2[0]);
+            __m128 const e2y = _mm_load_ps(packet.edge2[1]);
+            __m128 const e2z = _mm_load_ps(packet.edge2[2]);
+            // p = cross(d, edge2)
+            __m128 const px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+            __m128 const py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+            __m128 const pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+            __m128 const det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+            __m128 const valid = _mm_cmpneq_ps(det, zero);
+            __m128 const inv_det = _mm_div_ps(one, det);
+            __m128 const tx = _mm_sub_ps(ox, _mm_load_ps(packet.v1[0]));
+            __m128 const ty = _mm_sub_ps(oy, _mm_load_ps(packet.v1[1]));
+            __m128 const tz = _mm_sub_ps(oz, _mm_load_ps(packet.v1[2]));
+            __m128 const u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), inv_det);
+            // q = cross(t, edge1)
+            __m128 const qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+            __m128 const qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+            __m128 const qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+            __m128 const v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inv_det);
+            __m128 const distance = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inv_det);
+            __m128 mask = _mm_and_ps(valid, _mm_cmpge_ps(u, zero));
+            mask = _mm_and_ps(mask, _mm_cmpge_ps(v, zero));
+            mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), one));
+            mask = _mm_and_ps(mask, _mm_cmpge_ps(distance, min_distance));
+            mask = _mm_and_ps(mask, _mm_cmplt_ps(distance, best_distance));
+            __m128 const position = _mm_add_ps(_mm_set1_ps((f32)(i * triangle_packet_width)), lane_offsets);
+            best_distance = _mm_or_ps(_mm_and_ps(mask, distance), _mm_andnot_ps(mask, best_distance));
+            best_position = _mm_or_ps(_mm_and_ps(mask, position), _mm_andnot_ps(mask, best_position));
+        }
+
+        alignas(16) f32 distances[4];
+        alignas(16) f32 positions[4];
+        _mm_store_ps(distances, best_distance);
+        _mm_store_ps(positions, best_position);
+        return reduce_lanes(distances, positions, 4, packets, max_distance);
+    }
+#endif
+
+#if RT_TRIANGLE_KERNEL_AVX2
+    [[nodiscard]] __attribute__((target("avx2"))) static __m256 load_packet_pair(f32 const* const first, f32 const* const second) {
+        return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_load_ps(first)), _mm_load_ps(second), 1);
+    }
+
+    [[nodiscard]] __attribute__((target("avx2"))) static Optional<Triangle_Packet_Hit>
+    intersect_triangle_packets_avx2(Ray const& ray, Triangle_Packet const* const packets, i64 const count, f32 const max_distance) {
+        // Pairs the last packet with a degenerate one when the number of packets is odd.
+        static Triangle_Packet const empty_packet = {};
+        __m256 const dx = _mm256_set1_ps(ray.direction.x);
+        __m256 const dy = _mm256_set1_ps(ray.direction.y);
+        __m256 const dz = _mm256_set1_ps(ray.direction.z);
+        __m256 const ox = _mm256_set1_ps(ray.origin.x);
+        __m256 const oy = _mm256_set1_ps(ray.origin.y);
+        __m256 const oz = _mm256_set1_ps(ray.origin.z);
+        __m256 const zero = _mm256_setzero_ps();
+        __m256 const one = _mm256_set1_ps(1.0f);
+        __m256 const min_distance = _mm256_set1_ps(0.001f);
+        __m256 const lane_offsets = _mm256_set_ps(7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f, 0.0f);
+        __m256 best_distance = _mm256_set1_ps(max_distance);
+        __m256 best_position = _mm256_set1_ps(-1.0f);
+        for(i64 i = 0; i < count; i += 2) {
+            Triangle_Packet const& first = packets[i];
+            Triangle_Packet const& second = (i + 1 < count ? packets[i + 1] : empty_packet);
+            __m256 const e1x = load_packet_pair(first.edge1[0], second.edge1[0]);
+            __m256 const e1y = load_packet_pair(first.edge1[1], second.edge1[1]);
+            __m256 const e1z = load_packet_pair(first.edge1[2], second.edge1[2]);
+            __m256 const e2x = load_packet_pair(first.edge2[0], second.edge2[0]);
+            __m256 const e2y = load_packet_pair(first.edge2[1], second.edge2[1]);
+            __m256 const e2z = load_packet_pair(first.edge2[2], second.edge2[2]);
+            // p = cross(d, edge2)
+            __m256 const px = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(dz, e2y));
+            __m256 const py = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(dx, e2z));
+            __m256 const pz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(dy, e2x));
+            __m256 const det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, px), _mm256_mul_ps(e1y, py)), _mm256_mul_ps(e1z, pz));
+            __m256 const valid = _mm256_cmp_ps(det, zero, _CMP_NEQ_OQ);
+            __m256 const inv_det = _mm256_div_ps(one, det);
+            __m256 const tx = _mm256_sub_ps(ox, load_packet_pair(first.v1[0], second.v1[0]));
+            __m256 const ty = _mm256_sub_ps(oy, load_packet_pair(first.v1[1], second.v1[1]));
+            __m256 const tz = _mm256_sub_ps(oz, load_packet_pair(first.v1[2], second.v1[2]));
+            __m256 const u = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tx, px), _mm256_mul_ps(ty, py)), _mm256_mul_ps(tz, pz)), inv_det);
+            // q = cross(t, edge1)
+            __m256 const qx = _mm256_sub_ps(_mm256_mul_ps(ty, e1z), _mm256_mul_ps(tz, e1y));
+            __m256 const qy = _mm256_sub_ps(_mm256_mul_ps(tz, e1x), _mm256_mul_ps(tx, e1z));
+            __m256 const qz = _mm256_sub_ps(_mm256_mul_ps(tx, e1y), _mm256_mul_ps(ty, e1x));
+            __m256 const v = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)), _mm256_mul_ps(dz, qz)), inv_det);
+            __m256 const distance =
+                _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)), _mm256_mul_ps(e2z, qz)), inv_det);
+            __m256 mask = _mm256_and_ps(valid, _mm256_cmp_ps(u, zero, _CMP_GE_OQ));
+            mask = _mm256_and_ps(mask, _mm256_cmp_ps(v, zero, _CMP_GE_OQ));
+            mask = _mm256_and_ps(mask, _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ));
+            mask = _mm256_and_ps(mask, _mm256_cmp_ps(distance, min_distance, _CMP_GE_OQ));
+            mask = _mm256_and_ps(mask, _mm256_cmp_ps(distance, best_distance, _CMP_LT_OQ));
+            __m256 const position = _mm256_add_ps(_mm256_set1_ps((f32)(i * triangle_packet_width)), lane_offsets);
+            best_distance = _mm256_blendv_ps(best_distance, distance, mask);
+            best_position = _mm256_blendv_ps(best_position, position, mask);
+        }
+
+        alignas(32) f32 distances[8];
+        alignas(32) f32 positions[8];
+        _mm256_store_ps(distances, best_distance);
+        _mm256_store_ps(positions, best_position);
+        return reduce_lanes(distances, positions, 8, packets, max_distance);
+    }
+#endif
+
+    Triangle_Kernel get_supported_triangle_kernel() {
+#if RT_TRIANGLE_KERNEL_AVX2
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx2")) {
+            return Triangle_Kernel::avx2;
+        }
+#endif
+#if RT_TRIANGLE_KERNEL_SSE
+        return Triangle_Kernel::sse;
+#else
+        return Triangle_Kernel::scalar;
+#endif
+    }
+
+    Intersect_Triangle_Packets get_triangle_kernel(Triangle_Kernel const kernel) {
+        switch(kernel) {
+            case Triangle_Kernel::scalar:
+                return intersect_triangle_packets_scalar;
+            case Triangle_Kernel::sse:
+#if RT_TRIANGLE_KERNEL_SSE
+                return intersect_triangle_packets_sse;
+#else
+                return nullptr;
+#endif
+            case Triangle_Kernel::avx2:
+#if RT_TRIANGLE_KERNEL_AVX2
+                if(get_supported_triangle_kernel() == Triangle_Kernel::avx2) {
+                    return intersect_triangle_packets_avx2;
+                }
+#endif
+                return nullptr;
+        }
+        return nullptr;
+    }
+
+    // Selected once during static initialization so that the dispatch is a single indirect call.
+    static Intersect_Triangle_Packets selected_triangle_kernel = get_triangle_kernel(get_supported_triangle_kernel());
+
+    bool select_triangle_kernel(Triangle_Kernel const kernel) {
+        Intersect_Triangle_Packets const function = get_triangle_kernel(kernel);
+        if(function == nullptr) {
+            return false;
+        }
+
+        selected_triangle_kernel = function;
+        return true;
+    }
+
+    Optional<Triangle_Packet_Hit> intersect_triangle_packets(Ray const& ray, Triangle_Packet const* const packets, i64 const count, f32 const max_distance) {
+        return selected_triangle_kernel(ray, packets, count, max_distance);
+    }
+} // namespace raytracing
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <anton/optional.hpp>
+#include <anton/slice.hpp>
+#include <build_config.hpp>
+#include <intersections.hpp>
+
+namespace raytracing {
+    constexpr i64 triangle_packet_width = 4;
+    // Index of the unused lanes of a Triangle_Packet.
+    constexpr u32 empty_lane_index = 0xFFFFFFFF;
+
+    // Triangle_Packet
+    // triangle_packet_width triangles in the SoA layout of the Moller-Trumbore test.
+    // Unused lanes hold degenerate triangles which are never hit and have index empty_lane_index.
+    //
+    struct alignas(16) Triangle_Packet {
+        f32 v1[3][triangle_packet_width];
+        f32 edge1[3][triangle_packet_width];
+        f32 edge2[3][triangle_packet_width];
+        // The normals of precompute_triangle. Only read for the closest hit.
+        f32 normal[3][triangle_packet_width];
+        u32 indices[triangle_packet_width];
+    };
+
+    struct Triangle_Packet_Hit {
+        // Index of the triangle that has been hit.
+        i64 index;
+        f32 distance;
+        // Normal of the triangle that has been hit.
+        Vec3 normal;
+    };
+
+    // make_triangle_packet
+    //
+    // Parameters:
+    //   indices - indices of at most triangle_packet_width triangles to store in the packet.
+    // triangles - intersection data of all triangles.
+    //
+    [[nodiscard]] Triangle_Packet make_triangle_packet(Slice<u32 const> indices, Slice<Triangle_Data const> triangles);
+
+    // Intersect_Triangle_Packets
+    // Finds the closest triangle in packets hit by ray. Triangles are ordered by lane
+    // in the first packet, then by lane in the second one and so on. When multiple
+    // triangles are hit at the same distance, the first one is reported. All kernels
+    // perform the same floating point operations as intersect_triangle(Ray, Triangle_Data)
+    // in the same order and therefore produce identical results.
+    //
+    // Parameters:
+    //          ray - the ray to intersect the triangles with.
+    //      packets - pointer to the first packet.
+    //        count - number of packets.
+    // max_distance - only hits closer than max_distance are reported.
+    //
+    // Returns:
+    // The closest hit or null_optional if no triangle has been hit.
+    //
+    using Intersect_Triangle_Packets = Optional<Triangle_Packet_Hit> (*)(Ray const& ray, Triangle_Packet const* packets, i64 count, f32 max_distance);
+
+    enum struct Triangle_Kernel {
+        scalar,
+        sse,
+        avx2,
+    };
+
+    // get_supported_triangle_kernel
+    // The widest kernel supported by the CPU. Used by intersect_triangle_packets.
+    //
+    [[nodiscard]] Triangle_Kernel get_supported_triangle_kernel();
+
+    // get_triangle_kernel
+    //
+    // Returns:
+    // The kernel or nullptr if it has not been compiled in or is not supported by the CPU.
+    //
+    [[nodiscard]] Intersect_Triangle_Packets get_triangle_kernel(Triangle_Kernel kernel);
+
+    // select_triangle_kernel
+    // Replaces the kernel used by intersect_triangle_packets. Must not be called
+    // while other threads intersect triangles.
+    //
+    // Returns:
+    // false if the kernel is not available in which case the selection is not changed.
+    //
+    bool select_triangle_kernel(Triangle_Kernel kernel);
+
+    // intersect_triangle_packets
+    // Dispatches to the selected kernel which by default is the widest kernel supported by the CPU.
+    //
+    [[nodiscard]] Optional<Triangle_Packet_Hit> intersect_triangle_packets(Ray const& ray, Triangle_Packet const* packets, i64 count, f32 max_distance);
+} // namespace raytracing